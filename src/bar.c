@@ -39,6 +39,10 @@
 #include"item.h"
 #include"output.h"
 #include"bar.h"
+#include"snapshot.h"
+#include"reload.h"
+#include"label.h"
+#include"hash.h"
 #include"types/colour_t.h"
 #include"types/box_t.h"
 
@@ -57,6 +61,7 @@ static void bar_config_sensible_defaults (struct Lava_bar_configuration *config)
 	config->hidden_mode       = HIDDEN_MODE_NEVER;
 	config->icon_padding      = 4;
 	config->exclusive_zone    = 1;
+	config->separate_icon_surfaces = false;
 	config->indicator_padding = 0;
 	config->indicator_style   = STYLE_ROUNDED_RECTANGLE;
 
@@ -68,6 +73,8 @@ static void bar_config_sensible_defaults (struct Lava_bar_configuration *config)
 	colour_t_from_string(&config->border_colour, "#ffffff");
 	colour_t_from_string(&config->indicator_hover_colour, "#404040");
 	colour_t_from_string(&config->indicator_active_colour, "#606060");
+	colour_t_from_string(&config->tooltip_colour, "#ffffff");
+	colour_t_from_string(&config->label_colour, "#ffffff");
 
 	config->condition_scale      = 0;
 	config->condition_transform  = -1;
@@ -76,6 +83,7 @@ static void bar_config_sensible_defaults (struct Lava_bar_configuration *config)
 	config->cursor_name = NULL;
 	config->only_output = NULL;
 	config->namespace   = NULL;
+	config->label_font  = NULL;
 }
 
 static void bar_config_copy_settings (struct Lava_bar_configuration *config,
@@ -83,6 +91,20 @@ static void bar_config_copy_settings (struct Lava_bar_configuration *config,
 {
 	memcpy(config, default_config, sizeof(struct Lava_bar_configuration));
 
+	/* The cached gradient strips of the colours belong to the default
+	 * configuration set.
+	 */
+	colour_t *colours[] = {
+		&config->bar_colour, &config->border_colour,
+		&config->indicator_hover_colour, &config->indicator_active_colour,
+		&config->tooltip_colour, &config->label_colour
+	};
+	FOR_ARRAY(colours, i)
+	{
+		memset(colours[i]->strips, 0, sizeof(colours[i]->strips));
+		colours[i]->next_strip = 0;
+	}
+
 	/* If the configuration set has any strings, we just copied the pointers.
 	 * To make later logic simpler, every configuration set should have their
 	 * own copy of the string.
@@ -93,6 +115,8 @@ static void bar_config_copy_settings (struct Lava_bar_configuration *config,
 		config->only_output = strdup(default_config->only_output);
 	if ( config->namespace  != NULL )
 		config->namespace  = strdup(default_config->namespace);
+	if ( config->label_font != NULL )
+		config->label_font = strdup(default_config->label_font);
 }
 
 bool create_bar_config (struct Lava_bar *bar, bool default_config)
@@ -115,9 +139,16 @@ bool create_bar_config (struct Lava_bar *bar, bool default_config)
 
 static void destroy_bar_config (struct Lava_bar_configuration *config)
 {
+	colour_t_finish(&config->bar_colour);
+	colour_t_finish(&config->border_colour);
+	colour_t_finish(&config->indicator_hover_colour);
+	colour_t_finish(&config->indicator_active_colour);
+	colour_t_finish(&config->tooltip_colour);
+	colour_t_finish(&config->label_colour);
 	free_if_set(config->cursor_name);
 	free_if_set(config->only_output);
 	free_if_set(config->namespace);
+	free_if_set(config->label_font);
 	free(config);
 }
 
@@ -207,6 +238,7 @@ bool create_bar (void)
 	bar->last_item      = NULL;
 	bar->last_config    = NULL;
 	bar->default_config = NULL;
+	bar->fragment       = parse_fragment;
 
 	wl_list_init(&bar->items);
 	wl_list_init(&bar->configs);
@@ -218,8 +250,8 @@ bool create_bar (void)
 		return false;
 	}
 
-	wl_list_insert(&context.bars, &bar->link);
-	context.last_bar = bar;
+	wl_list_insert(&parse_generation->bars, &bar->link);
+	parse_generation->last_bar = bar;
 
 	return true;
 }
@@ -233,6 +265,24 @@ bool finalize_bar (struct Lava_bar *bar)
 	return true;
 }
 
+/* Load the images of all bars in the list. This is done after the
+ * configuration has been parsed and the Wayland globals have been bound, so
+ * the compositor can answer our output requests while we are busy decoding
+ * images.
+ */
+bool load_all_bar_images (struct wl_list *bars, bool sandbox, uint32_t scale)
+{
+	log_message(1, "[bar] Loading images.\n");
+	if (sandbox)
+		return load_item_images_sandboxed(bars, scale);
+
+	struct Lava_bar *bar;
+	wl_list_for_each(bar, bars, link)
+		if (! load_item_images(bar))
+			return false;
+	return true;
+}
+
 static void destroy_bar (struct Lava_bar *bar)
 {
 	wl_list_remove(&bar->link);
@@ -241,11 +291,11 @@ static void destroy_bar (struct Lava_bar *bar)
 	free(bar);
 }
 
-void destroy_all_bars (void)
+void destroy_all_bars (struct wl_list *bars)
 {
 	log_message(1, "[bar] Destroying all bars.\n");
 	struct Lava_bar *bar, *temp;
-	wl_list_for_each_safe(bar, temp, &context.bars, link)
+	wl_list_for_each_safe(bar, temp, bars, link)
 		destroy_bar(bar);
 }
 
@@ -323,11 +373,14 @@ done:
 
 BAR_CONFIG_STRING(bar_config_set_cursor_name, cursor_name)
 BAR_CONFIG_STRING(bar_config_set_namespace, namespace)
+BAR_CONFIG_STRING(bar_config_set_label_font, label_font)
 
 BAR_CONFIG_COLOUR(bar_config_set_bar_colour, bar_colour)
 BAR_CONFIG_COLOUR(bar_config_set_border_colour, border_colour)
 BAR_CONFIG_COLOUR(bar_config_set_indicator_colour_active, indicator_active_colour)
 BAR_CONFIG_COLOUR(bar_config_set_indicator_colour_hover, indicator_hover_colour)
+BAR_CONFIG_COLOUR(bar_config_set_tooltip_colour, tooltip_colour)
+BAR_CONFIG_COLOUR(bar_config_set_label_colour, label_colour)
 
 BAR_CONFIG(bar_config_set_only_output)
 {
@@ -463,6 +516,11 @@ BAR_CONFIG(bar_config_set_icon_padding)
 	return true;
 }
 
+BAR_CONFIG(bar_config_set_separate_icon_surfaces)
+{
+	return set_boolean(&config->separate_icon_surfaces, arg);
+}
+
 BAR_CONFIG(bar_config_set_exclusive_zone)
 {
 	if (is_boolean_true(arg))
@@ -502,7 +560,7 @@ BAR_CONFIG(bar_config_set_hidden_mode)
 	else if (! strcmp(arg, "river-auto"))
 	{
 		config->hidden_mode = HIDDEN_MODE_RIVER_AUTO;
-		context.need_river_status = true;
+		parse_generation->need_river_status = true;
 	}
 	else
 	{
@@ -623,6 +681,8 @@ bool bar_config_set_variable (struct Lava_bar_configuration *config,
 		{ .variable = "indicator-hover-colour",  .set = bar_config_set_indicator_colour_hover  },
 		{ .variable = "indicator-padding",       .set = bar_config_set_indicator_padding       },
 		{ .variable = "indicator-style",         .set = bar_config_set_indicator_style,        },
+		{ .variable = "label-colour",            .set = bar_config_set_label_colour            },
+		{ .variable = "label-font",              .set = bar_config_set_label_font              },
 		{ .variable = "layer",                   .set = bar_config_set_layer                   },
 		{ .variable = "margin",                  .set = bar_config_set_margin_size             },
 		{ .variable = "mode",                    .set = bar_config_set_mode                    },
@@ -630,7 +690,9 @@ bool bar_config_set_variable (struct Lava_bar_configuration *config,
 		{ .variable = "output",                  .set = bar_config_set_only_output             },
 		{ .variable = "position",                .set = bar_config_set_position                },
 		{ .variable = "radius",                  .set = bar_config_set_radius                  },
-		{ .variable = "size",                    .set = bar_config_set_size                    }
+		{ .variable = "separate-icon-surfaces",  .set = bar_config_set_separate_icon_surfaces  },
+		{ .variable = "size",                    .set = bar_config_set_size                    },
+		{ .variable = "tooltip-colour",          .set = bar_config_set_tooltip_colour          }
 	};
 
 	FOR_ARRAY(configs, i) if (! strcmp(configs[i].variable, variable))
@@ -643,7 +705,7 @@ bool bar_config_set_variable (struct Lava_bar_configuration *config,
 	log_message(0, "ERROR: Unrecognized bar setting \"%s\".\n", variable);
 exit:
 	log_message(0, "INFO: The error is on line %d in \"%s\".\n",
-			line, context.config_path);
+			line, fragment_path(parse_fragment));
 	return false;
 }
 
@@ -674,30 +736,101 @@ static void clear_buffer (cairo_t *cairo)
 	cairo_restore(cairo);
 }
 
+/* Buffer scale and subsurface position are kept by the compositor until they
+ * are changed, so they are only sent when they differ from the last ones.
+ * Both return whether a request has been sent.
+ */
+bool surface_set_buffer_scale (struct wl_surface *surface, uint32_t *current, uint32_t scale)
+{
+	if ( *current == scale )
+		return false;
+	*current = scale;
+	wl_surface_set_buffer_scale(surface, (int32_t)scale);
+	return true;
+}
+
+bool subsurface_set_position (struct wl_subsurface *subsurface,
+		int32_t *current_x, int32_t *current_y, int32_t x, int32_t y)
+{
+	if ( *current_x == x && *current_y == y )
+		return false;
+	*current_x = x;
+	*current_y = y;
+	wl_subsurface_set_position(subsurface, x, y);
+	return true;
+}
+
 /**************
  * Indicators *
  **************/
-void destroy_indicator (struct Lava_item_indicator *indicator)
+static void indicator_shape_rectangle (cairo_t *cairo, uint32_t size, uradii_t *radii)
 {
-	DESTROY(indicator->indicator_subsurface, wl_subsurface_destroy);
-	DESTROY(indicator->indicator_surface, wl_surface_destroy);
+	/* Cairo implicitly fills everything if no shape has been drawn. */
+	cairo_rectangle(cairo, 0, 0, size, size);
+}
+
+static void indicator_shape_rounded_rectangle (cairo_t *cairo, uint32_t size, uradii_t *radii)
+{
+	rounded_rectangle(cairo, 0, 0, size, size, radii);
+}
+
+static void indicator_shape_circle (cairo_t *cairo, uint32_t size, uradii_t *radii)
+{
+	circle(cairo, 0, 0, size);
+}
 
-	/* Cleanup in the parent. */
+static void indicator_forget_parent (struct Lava_item_indicator *indicator)
+{
 	if ( indicator->seat != NULL )
 		indicator->seat->pointer.indicator = NULL;
 	if ( indicator->touchpoint != NULL )
 		indicator->touchpoint->indicator = NULL;
+	indicator->seat       = NULL;
+	indicator->touchpoint = NULL;
+}
+
+static void free_indicator (struct Lava_item_indicator *indicator)
+{
+	indicator_forget_parent(indicator);
+
+	DESTROY(indicator->indicator_subsurface, wl_subsurface_destroy);
+	DESTROY(indicator->indicator_surface, wl_surface_destroy);
 
 	finish_buffer(&indicator->indicator_buffers[0]);
 	finish_buffer(&indicator->indicator_buffers[1]);
 
-	wl_surface_commit(indicator->instance->bar_surface);
 	wl_list_remove(&indicator->link);
 	free(indicator);
 }
 
+/* Indicators come and go with every hover and touch, so instead of being
+ * destroyed they are only unmapped and kept for the next one.
+ */
+void destroy_indicator (struct Lava_item_indicator *indicator)
+{
+	struct Lava_bar_instance *instance = indicator->instance;
+
+	indicator_forget_parent(indicator);
+
+	wl_surface_attach(indicator->indicator_surface, NULL, 0, 0);
+	wl_surface_commit(indicator->indicator_surface);
+	wl_surface_commit(instance->bar_surface);
+
+	wl_list_remove(&indicator->link);
+	wl_list_insert(&instance->spare_indicators, &indicator->link);
+}
+
 struct Lava_item_indicator *create_indicator (struct Lava_bar_instance *instance)
 {
+	if (! wl_list_empty(&instance->spare_indicators))
+	{
+		struct Lava_item_indicator *indicator = wl_container_of(
+				instance->spare_indicators.next, indicator, link);
+		wl_list_remove(&indicator->link);
+		wl_list_insert(&instance->indicators, &indicator->link);
+		return indicator;
+	}
+
 	TRY_NEW(struct Lava_item_indicator, indicator, NULL);
 
 	wl_list_insert(&instance->indicators, &indicator->link);
@@ -705,6 +838,10 @@ struct Lava_item_indicator *create_indicator (struct Lava_bar_instance *instance
 	indicator->seat       = NULL;
 	indicator->touchpoint = NULL;
 	indicator->instance   = instance;
+	indicator->scale      = 0;
+	indicator->x          = INT32_MIN;
+	indicator->y          = INT32_MIN;
+	indicator->dirty      = false;
 
 	if ( NULL == (indicator->indicator_surface = wl_compositor_create_surface(context.compositor)) )
 	{
@@ -720,16 +857,12 @@ struct Lava_item_indicator *create_indicator (struct Lava_bar_instance *instance
 	}
 
 	wl_subsurface_place_below(indicator->indicator_subsurface, instance->icon_surface);
-	wl_subsurface_set_position(indicator->indicator_subsurface, 0, 0);
-
-	struct wl_region *region = wl_compositor_create_region(context.compositor);
-	wl_surface_set_input_region(indicator->indicator_surface, region);
-	wl_region_destroy(region);
+	wl_surface_set_input_region(indicator->indicator_surface, context.empty_region);
 
 	return indicator;
 
 error:
-	destroy_indicator(indicator);
+	free_indicator(indicator);
 	return NULL;
 }
 
@@ -755,48 +888,58 @@ void indicator_set_colour (struct Lava_item_indicator *indicator, colour_t *colo
 	clear_buffer(cairo);
 	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
 
-	switch (config->indicator_style)
-	{
-		case STYLE_RECTANGLE:
-			/* Cairo implicitly fills everything if no shape has been drawn. */
-			cairo_rectangle(cairo, 0, 0, buffer_size, buffer_size);
-			break;
-
-		case STYLE_ROUNDED_RECTANGLE:
-			rounded_rectangle(cairo, 0, 0, buffer_size, buffer_size, &config->radii);
-			break;
-
-		case STYLE_CIRCLE:
-			circle(cairo, 0, 0, buffer_size);
-			break;
-	}
+	instance->ops.indicator_shape(cairo, buffer_size, &config->radii);
 
-	colour_t_set_cairo_source(cairo, colour);
+	ubox_t area = { .x = 0, .y = 0, .w = buffer_size, .h = buffer_size };
+	colour_t_set_cairo_source(cairo, colour, &area);
 	cairo_fill(cairo);
 
-	wl_surface_set_buffer_scale(indicator->indicator_surface, (int32_t)scale);
-	wl_surface_attach(indicator->indicator_surface,
-			indicator->current_indicator_buffer->buffer, 0, 0);
+	surface_set_buffer_scale(indicator->indicator_surface, &indicator->scale, scale);
+	buffer_attach(indicator->current_indicator_buffer, indicator->indicator_surface);
 	wl_surface_damage_buffer(indicator->indicator_surface, 0, 0, INT32_MAX, INT32_MAX);
+	indicator->dirty = true;
 }
 
-void move_indicator (struct Lava_item_indicator *indicator, struct Lava_item *item)
-{
-	struct Lava_bar_instance      *instance = indicator->instance;
-	struct Lava_bar_configuration *config   = instance->config;
+/* Declare POS as the position of an item with the given ordinate relative to
+ * the item area. The items are laid out along the MAIN axis. All functions
+ * placing items are generated per orientation with this, so the orientation
+ * is chosen once through the ops and not for every item.
+ */
+#define ITEM_POSITION(POS, MAIN, ORDINATE) \
+	struct { uint32_t x, y; } POS = { .x = 0, .y = 0 }; \
+	POS.MAIN = (ORDINATE)
 
-	int32_t x = (int32_t)(instance->item_area_dim.x + config->indicator_padding);
-	int32_t y = (int32_t)(instance->item_area_dim.y + config->indicator_padding);
-	if ( config->orientation == ORIENTATION_HORIZONTAL )
-		x += (int32_t)item->ordinate;
-	else
-		y += (int32_t)item->ordinate;
+#define DEFINE_MOVE_INDICATOR(NAME, MAIN) \
+	static void NAME (struct Lava_item_indicator *indicator, struct Lava_item *item) \
+	{ \
+		struct Lava_bar_instance *instance = indicator->instance; \
+		const uint32_t padding = instance->config->indicator_padding; \
+		ITEM_POSITION(pos, MAIN, item->ordinate); \
+		if (subsurface_set_position(indicator->indicator_subsurface, \
+					&indicator->x, &indicator->y, \
+					(int32_t)(instance->item_area_dim.x + pos.x + padding), \
+					(int32_t)(instance->item_area_dim.y + pos.y + padding))) \
+			indicator->dirty = true; \
+	}
+
+DEFINE_MOVE_INDICATOR(move_indicator_horizontal, x)
+DEFINE_MOVE_INDICATOR(move_indicator_vertical, y)
 
-	wl_subsurface_set_position(indicator->indicator_subsurface, x, y);
+#undef DEFINE_MOVE_INDICATOR
+
+void move_indicator (struct Lava_item_indicator *indicator, struct Lava_item *item)
+{
+	indicator->instance->ops.move_indicator(indicator, item);
 }
 
+/* Pointer motion moves the indicator to the item it already is on most of the
+ * time, which then needs no commit.
+ */
 void indicator_commit (struct Lava_item_indicator *indicator)
 {
+	if (! indicator->dirty)
+		return;
+	indicator->dirty = false;
 	wl_surface_commit(indicator->indicator_surface);
 	wl_surface_commit(indicator->instance->bar_surface);
 }
@@ -804,31 +947,57 @@ void indicator_commit (struct Lava_item_indicator *indicator)
 /****************
  * Bar instance *
  ****************/
-static void draw_items (struct Lava_bar_instance *instance, cairo_t *cairo)
+/* Draw the image of the item or, if it has none, its label. */
+static void draw_item_content (cairo_t *cairo, struct Lava_bar_configuration *config,
+		struct Lava_item *item, uint32_t x, uint32_t y, uint32_t size)
 {
-	struct Lava_bar_configuration *config = instance->config;
-	struct Lava_bar               *bar    = instance->bar;
-
-	uint32_t scale = instance->output->scale;
-	uint32_t size = config->size * scale;
-	uint32_t *increment, increment_offset;
-	uint32_t x = 0, y = 0;
-	if ( config->orientation == ORIENTATION_HORIZONTAL )
-		increment = &x, increment_offset = x;
-	else
-		increment = &y, increment_offset = y;
+	if ( item->img != NULL )
+		image_t_draw_to_cairo(cairo, item->img, x, y, size, size);
+	else if ( item->label != NULL )
+		label_draw_to_cairo(cairo, item->label,
+				config->label_font != NULL ? config->label_font : "sans-serif",
+				&config->label_colour, x, y, size, size);
+}
 
-	struct Lava_item *item;
-	wl_list_for_each_reverse(item, &bar->items, link) if ( item->type == TYPE_BUTTON )
-	{
-		*increment = (item->ordinate * scale) + increment_offset;
-		if ( item->img != NULL )
-			image_t_draw_to_cairo(cairo, item->img,
-					x + config->icon_padding,
-					y + config->icon_padding,
-					size - (2 * config->icon_padding),
-					size - (2 * config->icon_padding));
+#define DEFINE_DRAW_ITEMS(NAME, MAIN) \
+	static void NAME (struct Lava_bar_instance *instance, cairo_t *cairo) \
+	{ \
+		const uint32_t scale   = instance->output->scale; \
+		const uint32_t padding = instance->config->icon_padding; \
+		const uint32_t size    = (instance->config->size * scale) - (2 * padding); \
+		\
+		struct Lava_item *item; \
+		wl_list_for_each_reverse(item, &instance->bar->items, link) \
+		{ \
+			if ( item->img == NULL && item->label == NULL ) \
+				continue; \
+			ITEM_POSITION(pos, MAIN, item->ordinate * scale); \
+			draw_item_content(cairo, instance->config, item, \
+					pos.x + padding, pos.y + padding, size); \
+		} \
 	}
+
+DEFINE_DRAW_ITEMS(draw_items_horizontal, x)
+DEFINE_DRAW_ITEMS(draw_items_vertical, y)
+
+#undef DEFINE_DRAW_ITEMS
+
+/* Avoid radii so big they cause unexpected drawing behaviour. The input
+ * region uses the same limit, so it matches the drawn shape.
+ */
+static void clamp_bar_radii (uradii_t *radii, ubox_t *dim, udirections_t *border)
+{
+	const uint32_t w = dim->w - (border->left + border->right);
+	const uint32_t h = dim->h - (border->top + border->bottom);
+	const uint32_t max = (w < h ? w : h) / 2;
+	if ( radii->top_left > max )
+		radii->top_left = max;
+	if ( radii->top_right > max )
+		radii->top_right = max;
+	if ( radii->bottom_left > max )
+		radii->bottom_left = max;
+	if ( radii->bottom_right > max )
+		radii->bottom_right = max;
 }
 
 /* Draw a rectangle with configurable borders and corners. */
@@ -846,16 +1015,7 @@ void draw_bar_background (cairo_t *cairo, ubox_t *_dim, udirections_t *_border,
 		.h = dim.h - (border.top + border.bottom)
 	};
 
-	/* Avoid radii so big they cause unexpected drawing behaviour. */
-	uint32_t smallest_side = center.w < center.h ? center.w : center.h;
-	if ( radii.top_left > smallest_side / 2 )
-		radii.top_left = smallest_side / 2;
-	if ( radii.top_right > smallest_side / 2 )
-		radii.top_right = smallest_side / 2;
-	if ( radii.bottom_left > smallest_side / 2 )
-		radii.bottom_left = smallest_side / 2;
-	if ( radii.bottom_right > smallest_side / 2 )
-		radii.bottom_right = smallest_side / 2;
+	clamp_bar_radii(&radii, &dim, &border);
 
 	cairo_save(cairo);
 	cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
@@ -865,7 +1025,7 @@ void draw_bar_background (cairo_t *cairo, ubox_t *_dim, udirections_t *_border,
 		if ( border.top == 0 && border.bottom == 0 && border.left == 0 && border.right == 0 )
 		{
 			cairo_rectangle(cairo, dim.x, dim.y, dim.w, dim.h);
-			colour_t_set_cairo_source(cairo, bar_colour);
+			colour_t_set_cairo_source(cairo, bar_colour, &center);
 			cairo_fill(cairo);
 		}
 		else
@@ -877,12 +1037,12 @@ void draw_bar_background (cairo_t *cairo, ubox_t *_dim, udirections_t *_border,
 			cairo_rectangle(cairo, dim.x, dim.y + dim.h - border.bottom, dim.w, border.bottom);
 			cairo_rectangle(cairo, dim.x, dim.y + border.top, border.left,
 					dim.h - border.top - border.bottom);
-			colour_t_set_cairo_source(cairo, border_colour);
+			colour_t_set_cairo_source(cairo, border_colour, &dim);
 			cairo_fill(cairo);
 
 			/* Center. */
 			cairo_rectangle(cairo, center.x, center.y, center.w, center.h);
-			colour_t_set_cairo_source(cairo, bar_colour);
+			colour_t_set_cairo_source(cairo, bar_colour, &center);
 			cairo_fill(cairo);
 		}
 	}
@@ -891,17 +1051,17 @@ void draw_bar_background (cairo_t *cairo, ubox_t *_dim, udirections_t *_border,
 		if ( border.top == 0 && border.bottom == 0 && border.left == 0 && border.right == 0 )
 		{
 			rounded_rectangle(cairo, dim.x, dim.y, dim.w, dim.h, &radii);
-			colour_t_set_cairo_source(cairo, bar_colour);
+			colour_t_set_cairo_source(cairo, bar_colour, &center);
 			cairo_fill(cairo);
 		}
 		else
 		{
 			rounded_rectangle(cairo, dim.x, dim.y, dim.w, dim.h, &radii);
-			colour_t_set_cairo_source(cairo, border_colour);
+			colour_t_set_cairo_source(cairo, border_colour, &dim);
 			cairo_fill(cairo);
 
 			rounded_rectangle(cairo, center.x, center.y, center.w, center.h, &radii);
-			colour_t_set_cairo_source(cairo, bar_colour);
+			colour_t_set_cairo_source(cairo, bar_colour, &center);
 			cairo_fill(cairo);
 		}
 	}
@@ -909,18 +1069,29 @@ void draw_bar_background (cairo_t *cairo, ubox_t *_dim, udirections_t *_border,
 	cairo_restore(cairo);
 }
 
-static void bar_instance_render_icon_frame (struct Lava_bar_instance *instance)
+static bool bar_instance_next_icon_buffer (struct Lava_bar_instance *instance)
+{
+	uint32_t scale = instance->output->scale;
+	return next_buffer(&instance->current_icon_buffer, context.shm, instance->icon_buffers,
+			instance->item_area_dim.w  * scale, instance->item_area_dim.h * scale);
+}
+
+static bool bar_instance_next_bar_buffer (struct Lava_bar_instance *instance)
 {
-	struct Lava_output *output  = instance->output;
-	uint32_t            scale   = output->scale;
+	uint32_t scale = instance->output->scale;
+	ubox_t *buffer_dim = instance->hidden ? &instance->surface_hidden_dim : &instance->surface_dim;
+	return next_buffer(&instance->current_bar_buffer, context.shm, instance->bar_buffers,
+			buffer_dim->w  * scale, buffer_dim->h * scale);
+}
 
+static bool bar_instance_draw_icon_frame (struct Lava_bar_instance *instance)
+{
 	log_message(2, "[bar] Render icon frame: global_name=%d\n",
 			instance->output->global_name);
 
 	/* Get new/next buffer. */
-	if (! next_buffer(&instance->current_icon_buffer, context.shm, instance->icon_buffers,
-				instance->item_area_dim.w  * scale, instance->item_area_dim.h * scale))
-		return;
+	if (! bar_instance_next_icon_buffer(instance))
+		return false;
 
 	cairo_t *cairo = instance->current_icon_buffer->cairo;
 	clear_buffer(cairo);
@@ -929,31 +1100,108 @@ static void bar_instance_render_icon_frame (struct Lava_bar_instance *instance)
 
 	/* Draw icons. */
 	if (! instance->hidden)
-		draw_items(instance, cairo);
+		instance->ops.draw_items(instance, cairo);
+
+	return true;
+}
 
-	wl_surface_set_buffer_scale(instance->icon_surface, (int32_t)scale);
-	wl_surface_attach(instance->icon_surface, instance->current_icon_buffer->buffer, 0, 0);
+static void bar_instance_attach_icon_frame (struct Lava_bar_instance *instance)
+{
+	surface_set_buffer_scale(instance->icon_surface, &instance->icon_buffer_scale,
+			instance->output->scale);
+	buffer_attach(instance->current_icon_buffer, instance->icon_surface);
 	wl_surface_damage_buffer(instance->icon_surface, 0, 0, INT32_MAX, INT32_MAX);
 }
 
-static void bar_instance_render_background_frame (struct Lava_bar_instance *instance)
+/* Draw the icon of the item to its own surface, unless the attached frame
+ * already shows it. Returns whether the surface has been changed.
+ */
+/* Hash over everything the icon of the item depends on. The configuration
+ * set stands for the size, padding and label style.
+ */
+static uint64_t item_surface_frame_hash (struct Lava_bar_instance *instance,
+		struct Lava_item *item, uint32_t scale)
 {
-	struct Lava_bar_configuration *config = instance->config;
-	struct Lava_output            *output = instance->output;
-	uint32_t                       scale  = output->scale;
+	uint64_t hash = HASH_INIT;
+	hash = hash_update(hash, &instance->config, sizeof(instance->config));
+	hash = hash_update(hash, &scale, sizeof(scale));
+	hash = hash_update(hash, &item->img, sizeof(item->img));
+	if ( item->img != NULL )
+		hash = hash_update(hash, &item->img->generation, sizeof(item->img->generation));
+	hash = hash_update(hash, &item->label, sizeof(item->label));
+	return hash;
+}
 
-	ubox_t *buffer_dim, *bar_dim;
-	if (instance->hidden)
-		buffer_dim = &instance->surface_hidden_dim, bar_dim = &instance->bar_hidden_dim;
-	else
-		buffer_dim = &instance->surface_dim, bar_dim = &instance->bar_dim;
+static bool item_surface_render (struct Lava_bar_instance *instance,
+		struct Lava_item_surface *item_surface, bool force)
+{
+	struct Lava_item *item = item_surface->item;
+
+	if ( instance->hidden || ( item->img == NULL && item->label == NULL ) )
+	{
+		if (! item_surface->attached)
+			return false;
+		wl_surface_attach(item_surface->surface, NULL, 0, 0);
+		wl_surface_commit(item_surface->surface);
+		item_surface->attached = false;
+		return true;
+	}
+
+	const uint32_t scale   = instance->output->scale;
+	const uint32_t size    = instance->config->size * scale;
+	const uint32_t padding = instance->config->icon_padding;
+	const uint64_t hash    = item_surface_frame_hash(instance, item, scale);
+
+	if ( ! force && item_surface->attached && item_surface->frame_hash == hash )
+		return false;
+
+	if (! next_buffer(&item_surface->current_buffer, context.shm,
+				item_surface->buffers, size, size))
+		return false;
+
+	cairo_t *cairo = item_surface->current_buffer->cairo;
+	clear_buffer(cairo);
+	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
+	draw_item_content(cairo, instance->config, item, padding, padding,
+			size - (2 * padding));
+
+	if ( item_surface->scale != scale )
+		wl_surface_set_buffer_scale(item_surface->surface, (int32_t)scale);
+	buffer_attach(item_surface->current_buffer, item_surface->surface);
+	wl_surface_damage_buffer(item_surface->surface, 0, 0, INT32_MAX, INT32_MAX);
+	wl_surface_commit(item_surface->surface);
+
+	item_surface->attached   = true;
+	item_surface->scale      = scale;
+	item_surface->frame_hash = hash;
+	return true;
+}
+
+static void bar_instance_render_icon_frame (struct Lava_bar_instance *instance)
+{
+	if (instance->separate_icon_surfaces)
+	{
+		struct Lava_item_surface *item_surface;
+		wl_list_for_each(item_surface, &instance->item_surfaces, link)
+			item_surface_render(instance, item_surface, false);
+		return;
+	}
+
+	if (bar_instance_draw_icon_frame(instance))
+		bar_instance_attach_icon_frame(instance);
+}
+
+static bool bar_instance_draw_background_frame (struct Lava_bar_instance *instance)
+{
+	struct Lava_bar_configuration *config = instance->config;
+	uint32_t                       scale  = instance->output->scale;
+	ubox_t *bar_dim = instance->hidden ? &instance->bar_hidden_dim : &instance->bar_dim;
 
 	log_message(2, "[bar] Render bar frame: global_name=%d\n", instance->output->global_name);
 
 	/* Get new/next buffer. */
-	if (! next_buffer(&instance->current_bar_buffer, context.shm, instance->bar_buffers,
-				buffer_dim->w  * scale, buffer_dim->h * scale))
-		return;
+	if (! bar_instance_next_bar_buffer(instance))
+		return false;
 
 	cairo_t *cairo = instance->current_bar_buffer->cairo;
 	clear_buffer(cairo);
@@ -968,389 +1216,905 @@ static void bar_instance_render_background_frame (struct Lava_bar_instance *inst
 				scale, &config->bar_colour, &config->border_colour);
 	}
 
-	wl_surface_set_buffer_scale(instance->bar_surface, (int32_t)scale);
-	wl_surface_attach(instance->bar_surface, instance->current_bar_buffer->buffer, 0, 0);
-	wl_surface_damage_buffer(instance->bar_surface, 0, 0, INT32_MAX, INT32_MAX);
+	return true;
 }
 
-static uint32_t get_anchor (struct Lava_bar_configuration *config)
+static void bar_instance_attach_background_frame (struct Lava_bar_instance *instance)
 {
-	/* Look-Up-Table; Not fancy but still the best solution for this. */
-	struct
-	{
-		uint32_t triplet; /* Used for MODE_FULL and MODE_AGGRESSIVE. */
-		uint32_t mode_default[3];
-	} anchors[4] = {
-		[POSITION_TOP] = {
-			.triplet  = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
-			.mode_default = {
-				[ALIGNMENT_START]  = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT,
-				[ALIGNMENT_CENTER] = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP,
-				[ALIGNMENT_END]    = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT
-			}
-		},
-		[POSITION_RIGHT] = {
-			.triplet  = ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT | ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM,
-			.mode_default = {
-				[ALIGNMENT_START]  = ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT | ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP,
-				[ALIGNMENT_CENTER] = ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
-				[ALIGNMENT_END]    = ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM
-			}
-		},
-		[POSITION_BOTTOM] = {
-			.triplet  = ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
-			.mode_default = {
-				[ALIGNMENT_START]  = ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT,
-				[ALIGNMENT_CENTER] = ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM,
-				[ALIGNMENT_END]    = ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT
-			}
-		},
-		[POSITION_LEFT] = {
-			.triplet  = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM,
-			.mode_default = {
-				[ALIGNMENT_START]  = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP,
-				[ALIGNMENT_CENTER] = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT,
-				[ALIGNMENT_END]    = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM
-			}
-		},
-	};
+	surface_set_buffer_scale(instance->bar_surface, &instance->bar_buffer_scale,
+			instance->output->scale);
+	buffer_attach(instance->current_bar_buffer, instance->bar_surface);
+	wl_surface_damage_buffer(instance->bar_surface, 0, 0, INT32_MAX, INT32_MAX);
+}
 
-	if ( config->mode == MODE_DEFAULT )
-		return anchors[config->position].mode_default[config->alignment];
-	else
-		return anchors[config->position].triplet;
+static void bar_instance_render_background_frame (struct Lava_bar_instance *instance)
+{
+	if (bar_instance_draw_background_frame(instance))
+		bar_instance_attach_background_frame(instance);
 }
 
-static void bar_instance_configure_layer_surface (struct Lava_bar_instance *instance)
+/*************
+ * Snapshots *
+ *************/
+static void bar_instance_validate_snapshot (struct Lava_bar_instance *instance)
 {
-	struct Lava_bar_configuration *config = instance->config;
+	struct Lava_buffer *bar_snapshot  = instance->current_bar_buffer;
+	struct Lava_buffer *icon_snapshot = instance->current_icon_buffer;
 
-	log_message(1, "[bar] Configuring bar instance: global_name=%d\n",
+	log_message(2, "[bar] Validating snapshot: global_name=%d\n",
 			instance->output->global_name);
 
-	ubox_t *buffer_dim, *bar_dim;
-	if (instance->hidden)
-		buffer_dim = &instance->surface_hidden_dim, bar_dim = &instance->bar_hidden_dim;
-	else
-		buffer_dim = &instance->surface_dim, bar_dim = &instance->bar_dim;
-
-	zwlr_layer_surface_v1_set_size(instance->layer_surface, buffer_dim->w, buffer_dim->h);
+	/* The snapshot buffers are still attached, so the real frames must be
+	 * rendered into the other buffers. The compositor may already have
+	 * released them though, so they are held busy while rendering.
+	 */
+	const bool bar_snapshot_busy  = bar_snapshot->busy;
+	const bool icon_snapshot_busy = icon_snapshot->busy;
+	bar_snapshot->busy  = true;
+	icon_snapshot->busy = true;
 
-	/* Anchor the surface to the correct edge. */
-	zwlr_layer_surface_v1_set_anchor(instance->layer_surface, get_anchor(config));
+	if (! bar_instance_draw_icon_frame(instance))
+		goto error;
+	const bool icon_match = buffer_content_equal(icon_snapshot, instance->current_icon_buffer);
+	if (icon_match)
+		instance->current_icon_buffer = icon_snapshot;
+	else
+		bar_instance_attach_icon_frame(instance);
 
-	if ( config->mode == MODE_DEFAULT )
-		zwlr_layer_surface_v1_set_margin(instance->layer_surface,
-				(int32_t)config->margin.top, (int32_t)config->margin.right,
-				(int32_t)config->margin.bottom, (int32_t)config->margin.left);
-	else if ( config->orientation == ORIENTATION_HORIZONTAL )
-		zwlr_layer_surface_v1_set_margin(instance->layer_surface,
-				(int32_t)config->margin.top, 0,
-				(int32_t)config->margin.bottom, 0);
+	if (! bar_instance_draw_background_frame(instance))
+		goto error;
+	const bool bar_match = buffer_content_equal(bar_snapshot, instance->current_bar_buffer);
+	if (bar_match)
+		instance->current_bar_buffer = bar_snapshot;
 	else
-		zwlr_layer_surface_v1_set_margin(instance->layer_surface,
-				0, (int32_t)config->margin.right,
-				0, (int32_t)config->margin.left);
+		bar_instance_attach_background_frame(instance);
 
-	/* Set exclusive zone to prevent other surfaces from obstructing ours. */
-	int32_t exclusive_zone;
-	if ( config->exclusive_zone == 1 )
+	bar_snapshot->busy  = bar_snapshot_busy;
+	icon_snapshot->busy = icon_snapshot_busy;
+
+	if ( icon_match && bar_match )
 	{
-		if ( config->orientation == ORIENTATION_HORIZONTAL )
-			exclusive_zone = (int32_t)buffer_dim->h;
-		else
-			exclusive_zone = (int32_t)buffer_dim->w;
+		log_message(2, "[bar] Snapshot is up to date: global_name=%d\n",
+				instance->output->global_name);
+		return;
 	}
-	else
-		exclusive_zone = config->exclusive_zone;
-	zwlr_layer_surface_v1_set_exclusive_zone(instance->layer_surface,
-			exclusive_zone);
-
-	/* Create a region of the visible part of the surface.
-	 * Behold: In MODE_AGGRESSIVE, the actual surface is larger than the visible bar.
-	 */
-	struct wl_region *region = wl_compositor_create_region(context.compositor);
-	wl_region_add(region, (int32_t)instance->bar_dim.x, (int32_t)instance->bar_dim.y,
-			(int32_t)bar_dim->w, (int32_t)bar_dim->h);
 
-	/* Set input region. This is necessary to prevent the unused parts of
-	 * the surface to catch pointer and touch events.
-	 */
-	wl_surface_set_input_region(instance->bar_surface, region);
+	wl_surface_commit(instance->icon_surface);
+	wl_surface_commit(instance->bar_surface);
+	snapshot_save(instance, instance->current_bar_buffer, instance->current_icon_buffer);
+	return;
 
-	wl_region_destroy(region);
+error:
+	/* The snapshot stays in place, so the next update must render. */
+	bar_snapshot->busy            = bar_snapshot_busy;
+	icon_snapshot->busy           = icon_snapshot_busy;
+	instance->current_bar_buffer  = bar_snapshot;
+	instance->current_icon_buffer = icon_snapshot;
+	instance->bar_frame_hash      = 0;
+	instance->icon_frame_hash     = 0;
 }
 
-
-static void layer_surface_handle_configure (void *data,
-		struct zwlr_layer_surface_v1 *surface, uint32_t serial,
-		uint32_t w, uint32_t h)
+static void snapshot_callback_handle_done (void *data, struct wl_callback *wl_callback,
+		uint32_t time)
 {
 	struct Lava_bar_instance *instance = (struct Lava_bar_instance *)data;
+	wl_callback_destroy(wl_callback);
+	instance->snapshot_callback = NULL;
+	bar_instance_validate_snapshot(instance);
+}
 
-	log_message(1, "[bar] Layer surface configure request: global_name=%d w=%d h=%d serial=%d\n",
-			instance->output->global_name, w, h, serial);
+static const struct wl_callback_listener snapshot_callback_listener = {
+	.done = snapshot_callback_handle_done,
+};
 
-	// TODO respect new size
-	instance->configured = true;
-	zwlr_layer_surface_v1_ack_configure(surface, serial);
-	update_bar_instance(instance, true, false);
+static void snapshot_save_callback_handle_done (void *data, struct wl_callback *wl_callback,
+		uint32_t time)
+{
+	struct Lava_bar_instance *instance = (struct Lava_bar_instance *)data;
+	wl_callback_destroy(wl_callback);
+	instance->snapshot_save_callback = NULL;
+
+	if ( instance->current_bar_buffer == NULL || instance->current_icon_buffer == NULL )
+		return;
+	if (snapshot_is_current(instance, instance->current_bar_buffer, instance->current_icon_buffer))
+		return;
+	snapshot_save(instance, instance->current_bar_buffer, instance->current_icon_buffer);
 }
 
-static void layer_surface_handle_closed (void *data, struct zwlr_layer_surface_v1 *surface)
+static const struct wl_callback_listener snapshot_save_callback_listener = {
+	.done = snapshot_save_callback_handle_done,
+};
+
+/* Save the current frames as snapshot for the next run, unless the stored
+ * one already holds them. Writing it must not delay the frame, so this waits
+ * until the compositor has processed the commit.
+ */
+static void bar_instance_schedule_snapshot_save (struct Lava_bar_instance *instance)
 {
-	struct Lava_bar_instance *instance = (struct Lava_bar_instance *)data;
-	log_message(1, "[bar] Layer surface has been closed: global_name=%d\n",
-				instance->output->global_name);
-	destroy_bar_instance(instance);
+	if ( instance->snapshot_save_callback != NULL )
+		return;
+	if ( NULL == (instance->snapshot_save_callback = wl_display_sync(context.display)) )
+		return;
+	wl_callback_add_listener(instance->snapshot_save_callback,
+			&snapshot_save_callback_listener, instance);
 }
 
-static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
-	.configure = layer_surface_handle_configure,
-	.closed    = layer_surface_handle_closed
+/* Try to display the snapshot from the last run. The real frames are
+ * rendered once the snapshot has been presented and only committed if they
+ * differ from it.
+ */
+static bool bar_instance_apply_snapshot (struct Lava_bar_instance *instance)
+{
+	/* Snapshots only contain the shared icon surface. */
+	if (instance->separate_icon_surfaces)
+		return false;
+
+	if ( ! bar_instance_next_icon_buffer(instance) || ! bar_instance_next_bar_buffer(instance) )
+		return false;
+	if (! snapshot_load(instance, instance->current_bar_buffer, instance->current_icon_buffer))
+		return false;
+
+	bar_instance_attach_icon_frame(instance);
+	bar_instance_attach_background_frame(instance);
+
+	instance->snapshot_callback = wl_surface_frame(instance->bar_surface);
+	wl_callback_add_listener(instance->snapshot_callback, &snapshot_callback_listener, instance);
+
+	wl_surface_commit(instance->icon_surface);
+	wl_surface_commit(instance->bar_surface);
+	return true;
+}
+
+/**************
+ * Visibility *
+ **************/
+/* An instance is visible while its surface is on an output, it is not hidden
+ * and the compositor presents its frames, which it stops doing for example
+ * for disabled outputs or surfaces under a fullscreen window. Work which only
+ * changes what an instance shows is deferred while it is not visible.
+ *
+ * A frame callback is outstanding after every commit, so only one which has
+ * not been answered within FRAME_STALL_MS counts as the compositor no longer
+ * presenting frames.
+ */
+#define FRAME_STALL_MS 500
+
+static struct wl_signal visibility_signal = {
+	.listener_list = { .prev = &visibility_signal.listener_list, .next = &visibility_signal.listener_list },
 };
 
-static void bar_instance_configure_subsurface (struct Lava_bar_instance *instance)
+bool bar_instance_is_visible (struct Lava_bar_instance *instance)
 {
-	log_message(1, "[bar] Configuring icons: global_name=%d\n", instance->output->global_name);
+	return instance->entered_outputs > 0 && ! instance->frame_stalled
+		&& ! instance->hidden;
+}
 
-	wl_subsurface_set_position(instance->subsurface,
-			(int32_t)instance->item_area_dim.x, (int32_t)instance->item_area_dim.y);
+bool any_bar_instance_visible (void)
+{
+	struct Lava_output *output;
+	struct Lava_bar_instance *instance;
+	wl_list_for_each(output, &context.outputs, link)
+		wl_list_for_each(instance, &output->bar_instances, link)
+			if (bar_instance_is_visible(instance))
+				return true;
+	return false;
+}
 
-	/* We do not want to receive any input events from the subsurface.
-	 * Almot everything in LavaLauncher uses the coords of the parent surface.
-	 */
-	struct wl_region *region = wl_compositor_create_region(context.compositor);
-	wl_surface_set_input_region(instance->icon_surface, region);
-	wl_region_destroy(region);
+/* The listener is notified with the instance whenever its visibility changes. */
+void add_bar_instance_visibility_listener (struct wl_listener *listener)
+{
+	wl_signal_add(&visibility_signal, listener);
 }
 
-/* Positions and dimensions for MODE_AGGRESSIVE. */
-static void bar_instance_mode_aggressive_dimensions (struct Lava_bar_instance *instance)
+static void bar_instance_update_visibility (struct Lava_bar_instance *instance)
 {
-	struct Lava_bar_configuration *config = instance->config;
-	struct Lava_output           *output  = instance->output;
+	const bool visible = bar_instance_is_visible(instance);
+	if ( visible == instance->visible )
+		return;
+	instance->visible = visible;
 
-	/* Position of item area. */
-	if ( config->orientation == ORIENTATION_HORIZONTAL ) switch (config->alignment)
-	{
-		case ALIGNMENT_START:
-			instance->item_area_dim.x = config->border.left + (uint32_t)config->margin.left;
-			instance->item_area_dim.y = config->border.top;
-			break;
+	log_message(2, "[bar] Visibility changed: global_name=%d visible=%d\n",
+			instance->output->global_name, visible);
 
-		case ALIGNMENT_CENTER:
-			instance->item_area_dim.x = (output->w / 2) - (instance->item_area_dim.w / 2)
-				+ (uint32_t)(config->margin.left - config->margin.right);
-			instance->item_area_dim.y = config->border.top;
-			break;
+	if ( visible && instance->redraw_pending )
+		update_bar_instance(instance, false, false);
 
-		case ALIGNMENT_END:
-			instance->item_area_dim.x = output->w - instance->item_area_dim.w
-				- config->border.right - (uint32_t)config->margin.right;
-			instance->item_area_dim.y = config->border.top;
-			break;
-	}
-	else switch (config->alignment)
-	{
-		case ALIGNMENT_START:
-			instance->item_area_dim.x = config->border.left;
-			instance->item_area_dim.y = config->border.top + (uint32_t)config->margin.top;
-			break;
+	wl_signal_emit(&visibility_signal, instance);
+}
 
-		case ALIGNMENT_CENTER:
-			instance->item_area_dim.x = config->border.left;
-			instance->item_area_dim.y = (output->h / 2) - (instance->item_area_dim.h / 2)
-				+ (uint32_t)(config->margin.top - config->margin.bottom);
-			break;
+static void frame_callback_handle_done (void *data, struct wl_callback *wl_callback,
+		uint32_t time)
+{
+	struct Lava_bar_instance *instance = (struct Lava_bar_instance *)data;
+	wl_callback_destroy(wl_callback);
+	instance->frame_callback = NULL;
+	instance->frame_stalled  = false;
+	timer_disarm(&instance->frame_timer);
+	bar_instance_update_visibility(instance);
+}
 
-		case ALIGNMENT_END:
-			instance->item_area_dim.x = config->border.left;
-			instance->item_area_dim.y = output->h - instance->item_area_dim.h
-				- config->border.bottom - (uint32_t)config->margin.bottom;
-			break;
+static const struct wl_callback_listener frame_callback_listener = {
+	.done = frame_callback_handle_done,
+};
+
+static void bar_instance_handle_frame_timer (struct Lava_timer *timer)
+{
+	struct Lava_bar_instance *instance = (struct Lava_bar_instance *)timer->data;
+	instance->frame_stalled = true;
+	bar_instance_update_visibility(instance);
+}
+
+/* Commit new content of the instance. If the compositor does not present it
+ * within FRAME_STALL_MS, the instance is no longer considered visible.
+ */
+static void bar_instance_commit (struct Lava_bar_instance *instance)
+{
+	if ( instance->frame_callback == NULL )
+	{
+		instance->frame_callback = wl_surface_frame(instance->bar_surface);
+		wl_callback_add_listener(instance->frame_callback, &frame_callback_listener, instance);
+		timer_arm(&instance->frame_timer, FRAME_STALL_MS);
 	}
+	wl_surface_commit(instance->bar_surface);
+}
 
-	/* Position of bar. */
-	instance->bar_dim.x = instance->item_area_dim.x - config->border.left;
-	instance->bar_dim.y = instance->item_area_dim.y - config->border.top;
+static void bar_surface_handle_enter (void *data, struct wl_surface *surface,
+		struct wl_output *wl_output)
+{
+	struct Lava_bar_instance *instance = (struct Lava_bar_instance *)data;
+	instance->entered_outputs++;
+	bar_instance_update_visibility(instance);
+}
 
-	/* Size of bar. */
-	instance->bar_dim.w = instance->item_area_dim.w + config->border.left + config->border.right;
-	instance->bar_dim.h = instance->item_area_dim.h + config->border.top  + config->border.bottom;
+static void bar_surface_handle_leave (void *data, struct wl_surface *surface,
+		struct wl_output *wl_output)
+{
+	struct Lava_bar_instance *instance = (struct Lava_bar_instance *)data;
+	if ( instance->entered_outputs > 0 )
+		instance->entered_outputs--;
+	bar_instance_update_visibility(instance);
+}
 
-	/* Size of buffer / surface and hidden dimensions. */
-	if ( config->orientation == ORIENTATION_HORIZONTAL )
-	{
-		instance->surface_dim.w = instance->output->w;
-		instance->surface_dim.h = config->size + config->border.top + config->border.bottom;
+static const struct wl_surface_listener bar_surface_listener = {
+	.enter = bar_surface_handle_enter,
+	.leave = bar_surface_handle_leave,
+};
+
+/* Clear and redraw the items showing the image and damage their area. */
+#define DEFINE_REDRAW_IMAGE_ITEMS(NAME, MAIN) \
+	static void NAME (struct Lava_bar_instance *instance, cairo_t *cairo, image_t *image) \
+	{ \
+		const uint32_t scale   = instance->output->scale; \
+		const uint32_t size    = instance->config->size * scale; \
+		const uint32_t padding = instance->config->icon_padding; \
+		\
+		struct Lava_item *item; \
+		wl_list_for_each(item, &instance->bar->items, link) \
+		{ \
+			if ( item->img != image ) \
+				continue; \
+			ITEM_POSITION(pos, MAIN, item->ordinate * scale); \
+			\
+			cairo_save(cairo); \
+			cairo_rectangle(cairo, pos.x, pos.y, size, size); \
+			cairo_clip(cairo); \
+			clear_buffer(cairo); \
+			cairo_restore(cairo); \
+			\
+			image_t_draw_to_cairo(cairo, image, pos.x + padding, pos.y + padding, \
+					size - (2 * padding), size - (2 * padding)); \
+			\
+			wl_surface_damage_buffer(instance->icon_surface, \
+					(int32_t)pos.x, (int32_t)pos.y, (int32_t)size, (int32_t)size); \
+		} \
+	}
 
-		instance->surface_hidden_dim.w = instance->surface_dim.w;
-		instance->surface_hidden_dim.h = config->hidden_size;
+DEFINE_REDRAW_IMAGE_ITEMS(redraw_image_items_horizontal, x)
+DEFINE_REDRAW_IMAGE_ITEMS(redraw_image_items_vertical, y)
 
-		instance->bar_hidden_dim.w = instance->bar_dim.w;
-		instance->bar_hidden_dim.h = config->hidden_size;
+#undef DEFINE_REDRAW_IMAGE_ITEMS
+
+/* Redraw only the items showing the given image, for example after it has
+ * been re-loaded, and only damage their area of the icon surface.
+ */
+void bar_instance_redraw_image (struct Lava_bar_instance *instance, image_t *image)
+{
+	if ( ! instance->configured || ! instance->drawn || instance->hidden )
+		return;
+
+	/* Redrawn once the instance is visible again. */
+	if (! bar_instance_is_visible(instance))
+	{
+		instance->redraw_pending = true;
+		return;
 	}
-	else
+
+	/* Only the surfaces of the buttons using the image need a new frame. */
+	if (instance->separate_icon_surfaces)
 	{
-		instance->surface_dim.w = config->size + config->border.left + config->border.right;
-		instance->surface_dim.h = instance->output->h;
+		bool changed = false;
+		struct Lava_item_surface *item_surface;
+		wl_list_for_each(item_surface, &instance->item_surfaces, link)
+			if ( item_surface->item->img == image )
+				changed |= item_surface_render(instance, item_surface, true);
+		if (changed)
+			bar_instance_commit(instance);
+		return;
+	}
 
-		instance->surface_hidden_dim.w = config->hidden_size;
-		instance->surface_hidden_dim.h = instance->surface_dim.h;
+	if ( instance->current_icon_buffer == NULL || instance->current_icon_buffer->size == 0 )
+		return;
 
-		instance->bar_hidden_dim.w = config->hidden_size;
-		instance->bar_hidden_dim.h = instance->bar_dim.h;
+	/* A snapshot validation is pending and will render everything anyway. */
+	if ( instance->snapshot_callback != NULL )
+		return;
+
+	struct Lava_buffer *previous = instance->current_icon_buffer;
+	const uint32_t scale = instance->output->scale;
+
+	if (! bar_instance_next_icon_buffer(instance))
+		return;
+
+	/* The new buffer starts out with the content of the current frame. */
+	struct Lava_buffer *buffer = instance->current_icon_buffer;
+	if ( buffer != previous )
+	{
+		if ( buffer->size != previous->size )
+		{
+			bar_instance_render_icon_frame(instance);
+			wl_surface_commit(instance->icon_surface);
+			bar_instance_commit(instance);
+			bar_instance_schedule_snapshot_save(instance);
+			return;
+		}
+		cairo_surface_flush(previous->surface);
+		cairo_surface_flush(buffer->surface);
+		memcpy(buffer->memory_object, previous->memory_object, buffer->size);
+		cairo_surface_mark_dirty(buffer->surface);
 	}
-	instance->bar_hidden_dim.x = instance->bar_dim.x;
-	instance->bar_hidden_dim.y = instance->bar_dim.y;
+
+	surface_set_buffer_scale(instance->icon_surface, &instance->icon_buffer_scale, scale);
+	buffer_attach(buffer, instance->icon_surface);
+
+	instance->ops.redraw_image_items(instance, buffer->cairo, image);
+
+	wl_surface_commit(instance->icon_surface);
+	bar_instance_commit(instance);
+
+	/* The snapshot of the next run should show the new image. */
+	bar_instance_schedule_snapshot_save(instance);
 }
 
-/* Positions and dimensions for MODE_FULL. */
-static void bar_instance_mode_full_dimensions (struct Lava_bar_instance *instance)
+/*****************
+ * Pre-rendering *
+ *****************/
+/* The dimensions of a new instance only depend on its configuration and its
+ * output, so its first frames can be rendered while waiting for the first
+ * configure event. They are attached right away if nothing changed meanwhile.
+ */
+static void bar_instance_prerender (struct Lava_bar_instance *instance)
 {
-	struct Lava_bar_configuration *config = instance->config;
-	struct Lava_output           *output  = instance->output;
+	if ( instance->output->w == 0 || instance->output->h == 0 )
+		return;
 
-	/* Position of item area. */
-	if ( config->orientation == ORIENTATION_HORIZONTAL ) switch (config->alignment)
-	{
-		case ALIGNMENT_START:
-			instance->item_area_dim.x = config->border.left + (uint32_t)config->margin.left;
-			instance->item_area_dim.y = config->border.top;
-			break;
+	log_message(2, "[bar] Pre-rendering first frames: global_name=%d\n",
+			instance->output->global_name);
 
-		case ALIGNMENT_CENTER:
-			instance->item_area_dim.x = (output->w / 2) - (instance->item_area_dim.w / 2)
-				+ (uint32_t)(config->margin.left - config->margin.right);
-			instance->item_area_dim.y = config->border.top;
-			break;
+	/* Separate icon surfaces are committed right away, but their content
+	 * only becomes visible with the first commit of the bar surface.
+	 */
+	if (instance->separate_icon_surfaces)
+		bar_instance_render_icon_frame(instance);
+	else if (! bar_instance_draw_icon_frame(instance))
+		return;
+	if (! bar_instance_draw_background_frame(instance))
+		return;
 
-		case ALIGNMENT_END:
-			instance->item_area_dim.x = output->w - instance->item_area_dim.w
-				- config->border.right - (uint32_t)config->margin.right;
-			instance->item_area_dim.y = config->border.top;
-			break;
-	}
-	else switch (config->alignment)
-	{
-		case ALIGNMENT_START:
-			instance->item_area_dim.x = config->border.left;
-			instance->item_area_dim.y = config->border.top + (uint32_t)config->margin.top;
-			break;
+	instance->prerendered        = true;
+	instance->prerendered_hidden = instance->hidden;
+	instance->prerendered_config = instance->config;
+}
 
-		case ALIGNMENT_CENTER:
-			instance->item_area_dim.x = config->border.left;
-			instance->item_area_dim.y = (output->h / 2) - (instance->item_area_dim.h / 2)
-				+ (uint32_t)(config->margin.top - config->margin.bottom);
-			break;
+static bool buffer_has_size (struct Lava_buffer *buffer, ubox_t *dim, uint32_t scale)
+{
+	return buffer != NULL && buffer->w == dim->w * scale && buffer->h == dim->h * scale;
+}
 
-		case ALIGNMENT_END:
-			instance->item_area_dim.x = config->border.left;
-			instance->item_area_dim.y = output->h - instance->item_area_dim.h
-				- config->border.bottom - (uint32_t)config->margin.bottom;
-			break;
-	}
+static bool bar_instance_apply_prerendered_frames (struct Lava_bar_instance *instance)
+{
+	if (! instance->prerendered)
+		return false;
+	instance->prerendered = false;
 
-	/* Position and size of bar and size of buffer / surface and hidden dimensions. */
-	if ( config->orientation == ORIENTATION_HORIZONTAL )
+	const uint32_t scale = instance->output->scale;
+	ubox_t *buffer_dim = instance->hidden ? &instance->surface_hidden_dim : &instance->surface_dim;
+	if ( instance->hidden != instance->prerendered_hidden
+			|| instance->config != instance->prerendered_config
+			|| ! buffer_has_size(instance->current_bar_buffer, buffer_dim, scale) )
+		return false;
+	if ( ! instance->separate_icon_surfaces
+			&& ! buffer_has_size(instance->current_icon_buffer, &instance->item_area_dim, scale) )
+		return false;
+
+	log_message(2, "[bar] Using pre-rendered frames: global_name=%d\n",
+			instance->output->global_name);
+
+	/* Separate icon surfaces are only re-rendered if they changed. */
+	if (instance->separate_icon_surfaces)
+		bar_instance_render_icon_frame(instance);
+	else
+		bar_instance_attach_icon_frame(instance);
+	bar_instance_attach_background_frame(instance);
+	wl_surface_commit(instance->icon_surface);
+	wl_surface_commit(instance->bar_surface);
+	return true;
+}
+
+static uint32_t get_anchor (struct Lava_bar_configuration *config)
+{
+	/* Look-Up-Table; Not fancy but still the best solution for this. */
+	struct
 	{
-		instance->bar_dim.x = (uint32_t)config->margin.left;
-		instance->bar_dim.y = 0;
+		uint32_t triplet; /* Used for MODE_FULL and MODE_AGGRESSIVE. */
+		uint32_t mode_default[3];
+	} anchors[4] = {
+		[POSITION_TOP] = {
+			.triplet  = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
+			.mode_default = {
+				[ALIGNMENT_START]  = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT,
+				[ALIGNMENT_CENTER] = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP,
+				[ALIGNMENT_END]    = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT
+			}
+		},
+		[POSITION_RIGHT] = {
+			.triplet  = ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT | ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM,
+			.mode_default = {
+				[ALIGNMENT_START]  = ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT | ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP,
+				[ALIGNMENT_CENTER] = ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
+				[ALIGNMENT_END]    = ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM
+			}
+		},
+		[POSITION_BOTTOM] = {
+			.triplet  = ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
+			.mode_default = {
+				[ALIGNMENT_START]  = ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT,
+				[ALIGNMENT_CENTER] = ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM,
+				[ALIGNMENT_END]    = ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT
+			}
+		},
+		[POSITION_LEFT] = {
+			.triplet  = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM,
+			.mode_default = {
+				[ALIGNMENT_START]  = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP,
+				[ALIGNMENT_CENTER] = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT,
+				[ALIGNMENT_END]    = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM
+			}
+		},
+	};
 
-		instance->bar_dim.w = output->w - (uint32_t)(config->margin.left + config->margin.right);
-		instance->bar_dim.h = instance->item_area_dim.h + config->border.top + config->border.bottom;
+	if ( config->mode == MODE_DEFAULT )
+		return anchors[config->position].mode_default[config->alignment];
+	else
+		return anchors[config->position].triplet;
+}
 
-		instance->surface_dim.w = instance->output->w;
-		instance->surface_dim.h = config->size + config->border.top + config->border.bottom;
+static uint32_t isqrt (uint32_t n)
+{
+	uint32_t root = 0;
+	while ( (root + 1) * (root + 1) <= n )
+		root++;
+	return root;
+}
 
-		instance->surface_hidden_dim.w = instance->surface_dim.w;
-		instance->surface_hidden_dim.h = config->hidden_size;
+/* Horizontal inset of the given row inside a rounded corner of radius r, where
+ * row 0 is the outermost row of the corner.
+ */
+static uint32_t corner_inset (uint32_t r, uint32_t row)
+{
+	if ( row >= r )
+		return 0;
+	const uint32_t dy = r - row;
+	return r - isqrt(r * r - dy * dy);
+}
 
-		instance->bar_hidden_dim.w = instance->bar_dim.w;
-		instance->bar_hidden_dim.h = config->hidden_size;
-	}
+/* Set the input region to the visible part of the surface, so that neither
+ * the margins nor the cut-off corners catch pointer and touch events. The
+ * rounded corners are approximated with one rectangle per run of rows with
+ * equal insets. As the input region is double-buffered surface state which
+ * persists across commits, it is only sent when the geometry changed.
+ *
+ * Behold: In MODE_AGGRESSIVE, the actual surface is larger than the visible bar.
+ */
+static void bar_instance_update_input_region (struct Lava_bar_instance *instance,
+		ubox_t *bar_dim)
+{
+	ubox_t dim = {
+		.x = instance->bar_dim.x,
+		.y = instance->bar_dim.y,
+		.w = bar_dim->w,
+		.h = bar_dim->h
+	};
+
+	/* The hidden bar is invisible, so the corners do not matter. */
+	uradii_t radii;
+	if (instance->hidden)
+		uradii_t_set_all(&radii, 0);
 	else
 	{
-		instance->bar_dim.x = 0;
-		instance->bar_dim.y = (uint32_t)config->margin.top;
+		radii = instance->config->radii;
+		clamp_bar_radii(&radii, &dim, &instance->config->border);
+	}
 
-		instance->bar_dim.w = instance->item_area_dim.w + config->border.left + config->border.right;
-		instance->bar_dim.h = output->h - (uint32_t)(config->margin.top + config->margin.bottom);
+	if ( instance->input_region_set
+			&& ! memcmp(&dim, &instance->input_region_dim, sizeof(ubox_t))
+			&& ! memcmp(&radii, &instance->input_region_radii, sizeof(uradii_t)) )
+		return;
+	instance->input_region_set   = true;
+	instance->input_region_dim   = dim;
+	instance->input_region_radii = radii;
 
-		instance->surface_dim.w = config->size + config->border.left + config->border.right;
-		instance->surface_dim.h = instance->output->h;
+	log_message(2, "[bar] Updating input region: global_name=%d\n",
+			instance->output->global_name);
 
-		instance->surface_hidden_dim.w = config->hidden_size;
-		instance->surface_hidden_dim.h = instance->surface_dim.h;
+	struct wl_region *region = wl_compositor_create_region(context.compositor);
+	uint32_t run_start = 0, run_left = 0, run_right = 0;
+	for (uint32_t row = 0; row <= dim.h; row++)
+	{
+		uint32_t left = 0, right = 0;
+		if ( row < dim.h )
+		{
+			left = corner_inset(radii.top_left, row);
+			if ( left == 0 )
+				left = corner_inset(radii.bottom_left, dim.h - 1 - row);
+			right = corner_inset(radii.top_right, row);
+			if ( right == 0 )
+				right = corner_inset(radii.bottom_right, dim.h - 1 - row);
+		}
+
+		if ( row > 0 && row < dim.h && left == run_left && right == run_right )
+			continue;
+
+		if ( row > run_start )
+			wl_region_add(region, (int32_t)(dim.x + run_left),
+					(int32_t)(dim.y + run_start),
+					(int32_t)(dim.w - run_left - run_right),
+					(int32_t)(row - run_start));
 
-		instance->bar_hidden_dim.w = config->hidden_size;
-		instance->bar_hidden_dim.h = instance->bar_dim.h;
+		run_start = row, run_left = left, run_right = right;
 	}
+
+	wl_surface_set_input_region(instance->bar_surface, region);
+	wl_region_destroy(region);
 }
 
-/* Position and size for MODE_DEFAULT. */
-static void bar_instance_mode_default_dimensions (struct Lava_bar_instance *instance)
+static void bar_instance_configure_layer_surface (struct Lava_bar_instance *instance)
 {
 	struct Lava_bar_configuration *config = instance->config;
 
-	/* Position of item area. */
-	instance->item_area_dim.x = config->border.left;
-	instance->item_area_dim.y = config->border.top;
+	log_message(1, "[bar] Configuring bar instance: global_name=%d\n",
+			instance->output->global_name);
+
+	ubox_t *buffer_dim, *bar_dim;
+	if (instance->hidden)
+		buffer_dim = &instance->surface_hidden_dim, bar_dim = &instance->bar_hidden_dim;
+	else
+		buffer_dim = &instance->surface_dim, bar_dim = &instance->bar_dim;
 
-	/* Position of bar. */
-	instance->bar_dim.x = 0;
-	instance->bar_dim.y = 0;
+	/* In MODE_FULL and MODE_AGGRESSIVE the surface is anchored to both
+	 * ends of the edge, so its length is left to the compositor.
+	 */
+	if ( config->mode == MODE_DEFAULT )
+		zwlr_layer_surface_v1_set_size(instance->layer_surface, buffer_dim->w, buffer_dim->h);
+	else if ( config->orientation == ORIENTATION_HORIZONTAL )
+		zwlr_layer_surface_v1_set_size(instance->layer_surface, 0, buffer_dim->h);
+	else
+		zwlr_layer_surface_v1_set_size(instance->layer_surface, buffer_dim->w, 0);
 
-	/* Size of bar. */
-	instance->bar_dim.w = instance->item_area_dim.w + config->border.left + config->border.right;
-	instance->bar_dim.h = instance->item_area_dim.h + config->border.top  + config->border.bottom;
+	/* Anchor the surface to the correct edge. */
+	zwlr_layer_surface_v1_set_anchor(instance->layer_surface, get_anchor(config));
 
-	/* Size of hidden bar. */
-	if ( config->orientation == ORIENTATION_HORIZONTAL )
+	if ( config->mode == MODE_DEFAULT )
+		zwlr_layer_surface_v1_set_margin(instance->layer_surface,
+				(int32_t)config->margin.top, (int32_t)config->margin.right,
+				(int32_t)config->margin.bottom, (int32_t)config->margin.left);
+	else if ( config->orientation == ORIENTATION_HORIZONTAL )
+		zwlr_layer_surface_v1_set_margin(instance->layer_surface,
+				(int32_t)config->margin.top, 0,
+				(int32_t)config->margin.bottom, 0);
+	else
+		zwlr_layer_surface_v1_set_margin(instance->layer_surface,
+				0, (int32_t)config->margin.right,
+				0, (int32_t)config->margin.left);
+
+	/* Set exclusive zone to prevent other surfaces from obstructing ours. */
+	int32_t exclusive_zone;
+	if ( config->exclusive_zone == 1 )
 	{
-		instance->bar_hidden_dim.w = instance->bar_dim.w;
-		instance->bar_hidden_dim.h = config->hidden_size;
+		if ( config->orientation == ORIENTATION_HORIZONTAL )
+			exclusive_zone = (int32_t)buffer_dim->h;
+		else
+			exclusive_zone = (int32_t)buffer_dim->w;
 	}
 	else
+		exclusive_zone = config->exclusive_zone;
+	zwlr_layer_surface_v1_set_exclusive_zone(instance->layer_surface,
+			exclusive_zone);
+
+	bar_instance_update_input_region(instance, bar_dim);
+}
+
+static void layer_surface_handle_configure (void *data,
+		struct zwlr_layer_surface_v1 *surface, uint32_t serial,
+		uint32_t w, uint32_t h)
+{
+	struct Lava_bar_instance *instance = (struct Lava_bar_instance *)data;
+
+	log_message(1, "[bar] Layer surface configure request: global_name=%d w=%d h=%d serial=%d\n",
+			instance->output->global_name, w, h, serial);
+
+	zwlr_layer_surface_v1_ack_configure(surface, serial);
+
+	/* Most configure events just confirm the size of the current frame,
+	 * for example after the bar has been hidden or unhidden.
+	 */
+	ubox_t *buffer_dim = instance->hidden ? &instance->surface_hidden_dim : &instance->surface_dim;
+	if ( instance->configured && instance->drawn
+			&& ( w == 0 || w == buffer_dim->w )
+			&& ( h == 0 || h == buffer_dim->h ) )
 	{
-		instance->bar_hidden_dim.w = config->hidden_size;
-		instance->bar_hidden_dim.h = instance->bar_dim.h;
+		log_message(2, "[bar] Configure does not change anything: global_name=%d\n",
+				instance->output->global_name);
+		return;
 	}
 
-	/* Size of buffer / surface. */
-	instance->surface_dim        = instance->bar_dim;
-	instance->surface_hidden_dim = instance->bar_hidden_dim;
+	instance->configured       = true;
+	instance->configured_dim.w = w;
+	instance->configured_dim.h = h;
+	update_bar_instance(instance, true, false);
 }
 
-static void bar_instance_update_dimensions (struct Lava_bar_instance *instance)
+static void layer_surface_handle_closed (void *data, struct zwlr_layer_surface_v1 *surface)
 {
-	struct Lava_bar_configuration *config  = instance->config;
-	struct Lava_bar               *bar     = instance->bar;
-	struct Lava_output            *output  = instance->output;
+	struct Lava_bar_instance *instance = (struct Lava_bar_instance *)data;
+	log_message(1, "[bar] Layer surface has been closed: global_name=%d\n",
+				instance->output->global_name);
+	destroy_bar_instance(instance);
+}
+
+static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
+	.configure = layer_surface_handle_configure,
+	.closed    = layer_surface_handle_closed
+};
+
+/* X and Y are the position of the item area. */
+#define DEFINE_POSITION_ITEM_SURFACES(NAME, MAIN) \
+	static void NAME (struct Lava_bar_instance *instance, int32_t x, int32_t y) \
+	{ \
+		struct Lava_item_surface *item_surface; \
+		wl_list_for_each(item_surface, &instance->item_surfaces, link) \
+		{ \
+			ITEM_POSITION(pos, MAIN, item_surface->item->ordinate); \
+			subsurface_set_position(item_surface->subsurface, \
+					&item_surface->x, &item_surface->y, \
+					x + (int32_t)pos.x, y + (int32_t)pos.y); \
+		} \
+	}
+
+DEFINE_POSITION_ITEM_SURFACES(position_item_surfaces_horizontal, x)
+DEFINE_POSITION_ITEM_SURFACES(position_item_surfaces_vertical, y)
+
+#undef DEFINE_POSITION_ITEM_SURFACES
+#undef ITEM_POSITION
+
+static void bar_instance_configure_subsurface (struct Lava_bar_instance *instance)
+{
+	log_message(1, "[bar] Configuring icons: global_name=%d\n", instance->output->global_name);
 
+	const int32_t x = (int32_t)instance->item_area_dim.x;
+	const int32_t y = (int32_t)instance->item_area_dim.y;
+	subsurface_set_position(instance->subsurface,
+			&instance->subsurface_x, &instance->subsurface_y, x, y);
+
+	instance->ops.position_item_surfaces(instance, x, y);
+}
+
+/* The dimension functions are generated once per orientation. MAIN is the
+ * axis along which the items are laid out, CROSS the other one. LEN and XLEN
+ * are the matching sizes, START / END and CSTART / CEND the matching sides.
+ */
+#define DEFINE_DIMENSIONS(SUFFIX, MAIN, CROSS, LEN, XLEN, START, END, CSTART, CEND) \
+	static void bar_instance_item_area_size_##SUFFIX (struct Lava_bar_instance *instance) \
+	{ \
+		instance->item_area_dim.LEN  = get_item_length_sum(instance->bar); \
+		instance->item_area_dim.XLEN = instance->config->size; \
+	} \
+	\
+	/* Length of the surface for MODE_FULL and MODE_AGGRESSIVE. This is \
+	 * what the compositor has configured, as it knows about the exclusive \
+	 * zones of other surfaces, or the length of the output before that. \
+	 */ \
+	static uint32_t bar_instance_available_length_##SUFFIX (struct Lava_bar_instance *instance) \
+	{ \
+		if ( instance->configured_dim.LEN != 0 ) \
+			return instance->configured_dim.LEN; \
+		return instance->output->LEN; \
+	} \
+	\
+	/* Position of item area for MODE_FULL and MODE_AGGRESSIVE. */ \
+	static void bar_instance_item_area_position_##SUFFIX (struct Lava_bar_instance *instance) \
+	{ \
+		struct Lava_bar_configuration *config = instance->config; \
+		const uint32_t length = bar_instance_available_length_##SUFFIX(instance); \
+		switch (config->alignment) \
+		{ \
+			case ALIGNMENT_START: \
+				instance->item_area_dim.MAIN = config->border.START + (uint32_t)config->margin.START; \
+				break; \
+			\
+			case ALIGNMENT_CENTER: \
+				instance->item_area_dim.MAIN = (length / 2) - (instance->item_area_dim.LEN / 2) \
+					+ (uint32_t)(config->margin.START - config->margin.END); \
+				break; \
+			\
+			case ALIGNMENT_END: \
+				instance->item_area_dim.MAIN = length - instance->item_area_dim.LEN \
+					- config->border.END - (uint32_t)config->margin.END; \
+				break; \
+		} \
+		instance->item_area_dim.CROSS = config->border.CSTART; \
+	} \
+	\
+	/* Size of buffer / surface and hidden dimensions for MODE_FULL and MODE_AGGRESSIVE. */ \
+	static void bar_instance_surface_size_##SUFFIX (struct Lava_bar_instance *instance) \
+	{ \
+		struct Lava_bar_configuration *config = instance->config; \
+		instance->surface_dim.LEN  = bar_instance_available_length_##SUFFIX(instance); \
+		instance->surface_dim.XLEN = config->size + config->border.CSTART + config->border.CEND; \
+		\
+		instance->surface_hidden_dim.LEN  = instance->surface_dim.LEN; \
+		instance->surface_hidden_dim.XLEN = config->hidden_size; \
+		\
+		instance->bar_hidden_dim.LEN  = instance->bar_dim.LEN; \
+		instance->bar_hidden_dim.XLEN = config->hidden_size; \
+	} \
+	\
+	/* Positions and dimensions for MODE_AGGRESSIVE. */ \
+	static void bar_instance_mode_aggressive_dimensions_##SUFFIX (struct Lava_bar_instance *instance) \
+	{ \
+		struct Lava_bar_configuration *config = instance->config; \
+		bar_instance_item_area_size_##SUFFIX(instance); \
+		bar_instance_item_area_position_##SUFFIX(instance); \
+		\
+		/* Position of bar. */ \
+		instance->bar_dim.x = instance->item_area_dim.x - config->border.left; \
+		instance->bar_dim.y = instance->item_area_dim.y - config->border.top; \
+		\
+		/* Size of bar. */ \
+		instance->bar_dim.w = instance->item_area_dim.w + config->border.left + config->border.right; \
+		instance->bar_dim.h = instance->item_area_dim.h + config->border.top  + config->border.bottom; \
+		\
+		bar_instance_surface_size_##SUFFIX(instance); \
+		instance->bar_hidden_dim.x = instance->bar_dim.x; \
+		instance->bar_hidden_dim.y = instance->bar_dim.y; \
+	} \
+	\
+	/* Positions and dimensions for MODE_FULL. */ \
+	static void bar_instance_mode_full_dimensions_##SUFFIX (struct Lava_bar_instance *instance) \
+	{ \
+		struct Lava_bar_configuration *config = instance->config; \
+		bar_instance_item_area_size_##SUFFIX(instance); \
+		bar_instance_item_area_position_##SUFFIX(instance); \
+		\
+		/* Position and size of bar. */ \
+		instance->bar_dim.MAIN  = (uint32_t)config->margin.START; \
+		instance->bar_dim.CROSS = 0; \
+		instance->bar_dim.LEN   = bar_instance_available_length_##SUFFIX(instance) \
+			- (uint32_t)(config->margin.START + config->margin.END); \
+		instance->bar_dim.XLEN  = instance->item_area_dim.XLEN \
+			+ config->border.CSTART + config->border.CEND; \
+		\
+		bar_instance_surface_size_##SUFFIX(instance); \
+	} \
+	\
+	/* Position and size for MODE_DEFAULT. */ \
+	static void bar_instance_mode_default_dimensions_##SUFFIX (struct Lava_bar_instance *instance) \
+	{ \
+		struct Lava_bar_configuration *config = instance->config; \
+		bar_instance_item_area_size_##SUFFIX(instance); \
+		\
+		/* Position of item area. */ \
+		instance->item_area_dim.x = config->border.left; \
+		instance->item_area_dim.y = config->border.top; \
+		\
+		/* Position of bar. */ \
+		instance->bar_dim.x = 0; \
+		instance->bar_dim.y = 0; \
+		\
+		/* Size of bar. */ \
+		instance->bar_dim.w = instance->item_area_dim.w + config->border.left + config->border.right; \
+		instance->bar_dim.h = instance->item_area_dim.h + config->border.top  + config->border.bottom; \
+		\
+		/* Size of hidden bar. */ \
+		instance->bar_hidden_dim.LEN  = instance->bar_dim.LEN; \
+		instance->bar_hidden_dim.XLEN = config->hidden_size; \
+		\
+		/* Size of buffer / surface. */ \
+		instance->surface_dim        = instance->bar_dim; \
+		instance->surface_hidden_dim = instance->bar_hidden_dim; \
+	}
+
+DEFINE_DIMENSIONS(horizontal, x, y, w, h, left, right, top, bottom)
+DEFINE_DIMENSIONS(vertical, y, x, h, w, top, bottom, left, right)
+
+#undef DEFINE_DIMENSIONS
+
+static void bar_instance_update_dimensions (struct Lava_bar_instance *instance)
+{
+	struct Lava_output *output = instance->output;
 	if ( output->w == 0 || output->h == 0 )
 		return;
+	instance->ops.update_dimensions(instance);
+}
+
+/* Select the routines specialized for the orientation, mode and indicator
+ * style of the current configuration of the instance, so that the hot paths
+ * do not need to branch on them.
+ */
+static void bar_instance_select_ops (struct Lava_bar_instance *instance)
+{
+	struct Lava_bar_configuration *config = instance->config;
+	if ( config == NULL )
+		return;
+
+	static void (*const indicator_shapes[])(cairo_t *, uint32_t, uradii_t *) = {
+		[STYLE_RECTANGLE]         = indicator_shape_rectangle,
+		[STYLE_ROUNDED_RECTANGLE] = indicator_shape_rounded_rectangle,
+		[STYLE_CIRCLE]            = indicator_shape_circle
+	};
+	instance->ops.indicator_shape = indicator_shapes[config->indicator_style];
 
-	/* Size of item area. */
 	if ( config->orientation == ORIENTATION_HORIZONTAL )
 	{
-		instance->item_area_dim.w = get_item_length_sum(bar);
-		instance->item_area_dim.h = config->size;
+		static void (*const dimensions[])(struct Lava_bar_instance *) = {
+			[MODE_DEFAULT]    = bar_instance_mode_default_dimensions_horizontal,
+			[MODE_FULL]       = bar_instance_mode_full_dimensions_horizontal,
+			[MODE_AGGRESSIVE] = bar_instance_mode_aggressive_dimensions_horizontal
+		};
+		instance->ops.update_dimensions      = dimensions[config->mode];
+		instance->ops.draw_items             = draw_items_horizontal;
+		instance->ops.redraw_image_items     = redraw_image_items_horizontal;
+		instance->ops.position_item_surfaces = position_item_surfaces_horizontal;
+		instance->ops.move_indicator         = move_indicator_horizontal;
+		instance->ops.item_from_coords       = item_from_coords_horizontal;
 	}
 	else
 	{
-		instance->item_area_dim.w = config->size;
-		instance->item_area_dim.h = get_item_length_sum(bar);
+		static void (*const dimensions[])(struct Lava_bar_instance *) = {
+			[MODE_DEFAULT]    = bar_instance_mode_default_dimensions_vertical,
+			[MODE_FULL]       = bar_instance_mode_full_dimensions_vertical,
+			[MODE_AGGRESSIVE] = bar_instance_mode_aggressive_dimensions_vertical
+		};
+		instance->ops.update_dimensions      = dimensions[config->mode];
+		instance->ops.draw_items             = draw_items_vertical;
+		instance->ops.redraw_image_items     = redraw_image_items_vertical;
+		instance->ops.position_item_surfaces = position_item_surfaces_vertical;
+		instance->ops.move_indicator         = move_indicator_vertical;
+		instance->ops.item_from_coords       = item_from_coords_vertical;
 	}
+}
 
-	/* Other dimensions. */
-	switch (instance->config->mode)
-	{
-		case MODE_DEFAULT:    bar_instance_mode_default_dimensions(instance);    break;
-		case MODE_FULL:       bar_instance_mode_full_dimensions(instance);       break;
-		case MODE_AGGRESSIVE: bar_instance_mode_aggressive_dimensions(instance); break;
-	}
+/* Change the configuration set of the instance. A NULL configuration will
+ * cause the instance to be destroyed on its next update.
+ */
+void bar_instance_set_config (struct Lava_bar_instance *instance,
+		struct Lava_bar_configuration *config)
+{
+	instance->config = config;
+	bar_instance_select_ops(instance);
+
+	/* A size configured for the old anchors does not apply to the new ones. */
+	instance->configured_dim.w = 0;
+	instance->configured_dim.h = 0;
 }
 
 /* Return a bool indicating if the bar instance should currently be hidden or not. */
@@ -1370,6 +2134,51 @@ static bool bar_instance_should_hide (struct Lava_bar_instance *instance)
 	}
 }
 
+static void destroy_item_surface (struct Lava_item_surface *item_surface)
+{
+	wl_list_remove(&item_surface->link);
+	DESTROY(item_surface->subsurface, wl_subsurface_destroy);
+	DESTROY(item_surface->surface, wl_surface_destroy);
+	finish_buffer(&item_surface->buffers[0]);
+	finish_buffer(&item_surface->buffers[1]);
+	free(item_surface);
+}
+
+static bool create_item_surface (struct Lava_bar_instance *instance, struct Lava_item *item)
+{
+	TRY_NEW(struct Lava_item_surface, item_surface, false);
+
+	item_surface->item       = item;
+	item_surface->subsurface = NULL;
+	item_surface->attached   = false;
+	item_surface->scale      = 0;
+	item_surface->frame_hash = 0;
+	item_surface->x          = INT32_MIN;
+	item_surface->y          = INT32_MIN;
+	wl_list_insert(&instance->item_surfaces, &item_surface->link);
+
+	if ( NULL == (item_surface->surface = wl_compositor_create_surface(context.compositor)) )
+	{
+		log_message(0, "ERROR: Compositor did not create wl_surface.\n");
+		goto error;
+	}
+	if ( NULL == (item_surface->subsurface = wl_subcompositor_get_subsurface(
+					context.subcompositor, item_surface->surface,
+					instance->bar_surface)) )
+	{
+		log_message(0, "ERROR: Compositor did not create wl_subsurface.\n");
+		goto error;
+	}
+
+	wl_surface_set_input_region(item_surface->surface, context.empty_region);
+
+	return true;
+
+error:
+	destroy_item_surface(item_surface);
+	return false;
+}
+
 bool create_bar_instance (struct Lava_bar *bar, struct Lava_bar_configuration *config,
 		struct Lava_output *output)
 {
@@ -1379,17 +2188,40 @@ bool create_bar_instance (struct Lava_bar *bar, struct Lava_bar_configuration *c
 
 	wl_list_insert(&output->bar_instances, &instance->link);
 	instance->bar           = bar;
-	instance->config        = config;
 	instance->output        = output;
 	instance->bar_surface   = NULL;
 	instance->icon_surface  = NULL;
 	instance->layer_surface = NULL;
 	instance->subsurface    = NULL;
 	instance->configured    = false;
+	instance->drawn         = false;
 	instance->hover         = false;
+	instance->snapshot_callback = NULL;
+	instance->snapshot_save_callback = NULL;
+	instance->input_region_set  = false;
+	instance->prerendered       = false;
+	instance->bar_frame_hash    = 0;
+	instance->icon_frame_hash   = 0;
+	instance->frame_callback    = NULL;
+	instance->frame_stalled     = false;
+	instance->entered_outputs   = 0;
+	instance->visible           = false;
+	instance->redraw_pending    = false;
+	instance->bar_buffer_scale  = 0;
+	instance->icon_buffer_scale = 0;
+	instance->subsurface_x      = INT32_MIN;
+	instance->subsurface_y      = INT32_MIN;
+	bar_instance_set_config(instance, config);
 	instance->hidden        = bar_instance_should_hide(instance);
 
 	wl_list_init(&instance->indicators);
+	wl_list_init(&instance->spare_indicators);
+	wl_list_init(&instance->item_surfaces);
+	timer_init(&instance->frame_timer, bar_instance_handle_frame_timer, instance);
+	tooltip_init(instance);
+
+	/* Like the namespace, this can not be changed for an existing instance. */
+	instance->separate_icon_surfaces = config->separate_icon_surfaces;
 
 	/* Main surface for the bar. */
 	if ( NULL == (instance->bar_surface = wl_compositor_create_surface(context.compositor)) )
@@ -1397,6 +2229,7 @@ bool create_bar_instance (struct Lava_bar *bar, struct Lava_bar_configuration *c
 		log_message(0, "ERROR: Compositor did not create wl_surface.\n");
 		return false;
 	}
+	wl_surface_add_listener(instance->bar_surface, &bar_surface_listener, instance);
 	if ( NULL == (instance->layer_surface = zwlr_layer_shell_v1_get_layer_surface(
 					context.layer_shell, instance->bar_surface,
 					output->wl_output, config->layer,
@@ -1420,6 +2253,20 @@ bool create_bar_instance (struct Lava_bar *bar, struct Lava_bar_configuration *c
 		return false;
 	}
 
+	/* We do not want to receive any input events from the subsurface.
+	 * Almot everything in LavaLauncher uses the coords of the parent surface.
+	 */
+	wl_surface_set_input_region(instance->icon_surface, context.empty_region);
+
+	/* Subsurfaces for the individual icons. */
+	if (instance->separate_icon_surfaces)
+	{
+		struct Lava_item *item;
+		wl_list_for_each(item, &bar->items, link)
+			if ( item->type == TYPE_BUTTON && ! create_item_surface(instance, item) )
+				return false;
+	}
+
 	bar_instance_update_dimensions(instance);
 	bar_instance_configure_layer_surface(instance);
 	bar_instance_configure_subsurface(instance);
@@ -1428,6 +2275,9 @@ bool create_bar_instance (struct Lava_bar *bar, struct Lava_bar_configuration *c
 	wl_surface_commit(instance->icon_surface);
 	wl_surface_commit(instance->bar_surface);
 
+	/* Render the first frames while waiting for the configure event. */
+	bar_instance_prerender(instance);
+
 	return true;
 }
 
@@ -1438,8 +2288,19 @@ void destroy_bar_instance (struct Lava_bar_instance *instance)
 
 	struct Lava_item_indicator *indicator, *temp;
 	wl_list_for_each_safe(indicator, temp, &instance->indicators, link)
-		destroy_indicator(indicator);
-
+		free_indicator(indicator);
+	wl_list_for_each_safe(indicator, temp, &instance->spare_indicators, link)
+		free_indicator(indicator);
+
+	struct Lava_item_surface *item_surface, *temp_surface;
+	wl_list_for_each_safe(item_surface, temp_surface, &instance->item_surfaces, link)
+		destroy_item_surface(item_surface);
+
+	tooltip_finish(instance);
+	DESTROY(instance->snapshot_callback, wl_callback_destroy);
+	DESTROY(instance->snapshot_save_callback, wl_callback_destroy);
+	DESTROY(instance->frame_callback, wl_callback_destroy);
+	timer_disarm(&instance->frame_timer);
 	DESTROY(instance->layer_surface, zwlr_layer_surface_v1_destroy);
 	DESTROY(instance->subsurface, wl_subsurface_destroy);
 	DESTROY(instance->bar_surface, wl_surface_destroy);
@@ -1462,6 +2323,44 @@ void destroy_all_bar_instances (struct Lava_output *output)
 		destroy_bar_instance(instance);
 }
 
+/* Hashes over everything the content of the frames depends on. If they did
+ * not change, the attached frames are still up to date.
+ */
+static uint64_t bar_instance_bar_frame_hash (struct Lava_bar_instance *instance)
+{
+	uint64_t hash = HASH_INIT;
+	hash = hash_update(hash, &instance->config, sizeof(instance->config));
+	hash = hash_update(hash, &instance->hidden, sizeof(instance->hidden));
+	hash = hash_update(hash, &instance->output->scale, sizeof(instance->output->scale));
+	hash = hash_update(hash, &instance->surface_dim, sizeof(ubox_t));
+	hash = hash_update(hash, &instance->surface_hidden_dim, sizeof(ubox_t));
+	hash = hash_update(hash, &instance->bar_dim, sizeof(ubox_t));
+	hash = hash_update(hash, &instance->bar_hidden_dim, sizeof(ubox_t));
+	hash = hash_update(hash, &instance->item_area_dim, sizeof(ubox_t));
+	return hash;
+}
+
+static uint64_t bar_instance_icon_frame_hash (struct Lava_bar_instance *instance)
+{
+	uint64_t hash = HASH_INIT;
+	hash = hash_update(hash, &instance->config, sizeof(instance->config));
+	hash = hash_update(hash, &instance->hidden, sizeof(instance->hidden));
+	hash = hash_update(hash, &instance->output->scale, sizeof(instance->output->scale));
+	hash = hash_update(hash, &instance->item_area_dim, sizeof(ubox_t));
+
+	struct Lava_item *item;
+	wl_list_for_each(item, &instance->bar->items, link)
+	{
+		hash = hash_update(hash, &item->ordinate, sizeof(item->ordinate));
+		hash = hash_update(hash, &item->length, sizeof(item->length));
+		hash = hash_update(hash, &item->img, sizeof(item->img));
+		if ( item->img != NULL )
+			hash = hash_update(hash, &item->img->generation, sizeof(item->img->generation));
+		hash = hash_update(hash, &item->label, sizeof(item->label));
+	}
+	return hash;
+}
+
 void update_bar_instance (struct Lava_bar_instance *instance, bool need_new_dimensions,
 		bool only_update_on_hide_change)
 {
@@ -1491,14 +2390,67 @@ void update_bar_instance (struct Lava_bar_instance *instance, bool need_new_dime
 	if ( only_update_on_hide_change && ( currently_hidden == instance->hidden ) )
 		return;
 
+	if (instance->hidden)
+		tooltip_hide(instance);
+
+	/* Skip attaching and committing frames identical to the current ones.
+	 * A pending snapshot validation still needs the real frames.
+	 */
+	const uint64_t bar_hash  = bar_instance_bar_frame_hash(instance);
+	const uint64_t icon_hash = bar_instance_icon_frame_hash(instance);
+	const bool bar_changed   = bar_hash != instance->bar_frame_hash
+		|| instance->snapshot_callback != NULL;
+	const bool icon_changed  = icon_hash != instance->icon_frame_hash
+		|| instance->snapshot_callback != NULL;
+	if ( instance->drawn && ! bar_changed && ! icon_changed )
+	{
+		log_message(2, "[bar] Frames unchanged, skipping commit: global_name=%d\n",
+				instance->output->global_name);
+		return;
+	}
+	instance->bar_frame_hash  = bar_hash;
+	instance->icon_frame_hash = icon_hash;
+
 	bar_instance_configure_subsurface(instance);
 	bar_instance_configure_layer_surface(instance);
 
-	bar_instance_render_icon_frame(instance);
-	bar_instance_render_background_frame(instance);
+	/* A real render makes a pending snapshot validation pointless. */
+	DESTROY_NULL(instance->snapshot_callback, wl_callback_destroy);
 
-	wl_surface_commit(instance->icon_surface);
-	wl_surface_commit(instance->bar_surface);
+	/* The first frame of an instance may have been rendered before the
+	 * first configure event or come from a snapshot of the last run.
+	 */
+	if ( ! instance->drawn )
+	{
+		instance->drawn = true;
+		retire_replaced_bars();
+		if (bar_instance_apply_prerendered_frames(instance))
+		{
+			bar_instance_schedule_snapshot_save(instance);
+			return;
+		}
+		if (bar_instance_apply_snapshot(instance))
+			return;
+
+		bar_instance_render_icon_frame(instance);
+		bar_instance_render_background_frame(instance);
+		wl_surface_commit(instance->icon_surface);
+		bar_instance_commit(instance);
+		bar_instance_schedule_snapshot_save(instance);
+		return;
+	}
+
+	if (icon_changed)
+	{
+		bar_instance_render_icon_frame(instance);
+		wl_surface_commit(instance->icon_surface);
+		instance->redraw_pending = false;
+	}
+	if (bar_changed)
+		bar_instance_render_background_frame(instance);
+
+	/* Also applies the state of the sub-surface. */
+	bar_instance_commit(instance);
 }
 
 /* Call this to handle all changes to a bar instance when it is entered by a pointer. */
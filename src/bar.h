@@ -27,8 +27,13 @@
 #include"types/colour_t.h"
 #include"types/box_t.h"
 #include"types/buffer.h"
+#include"types/image_t.h"
+#include"tooltip.h"
 
 struct Lava_item;
+struct Lava_bar_instance;
+struct Lava_item_indicator;
+struct Lava_fragment;
 
 enum Bar_position
 {
@@ -111,6 +116,17 @@ struct Lava_bar_configuration
 	colour_t indicator_active_colour;
 	enum Item_indicator_style indicator_style;
 
+	colour_t tooltip_colour;
+
+	/* Font and colour of the labels of buttons without an image. */
+	char *label_font;
+	colour_t label_colour;
+
+	/* Give every button its own subsurface and buffer instead of drawing
+	 * all icons into a single one.
+	 */
+	bool separate_icon_surfaces;
+
 	/* If only_output is NULL, a surface will be created for all outputs.
 	 * Otherwise only on the output which name is equal to *only_output.
 	 * Examples of valid names are "eDP-1" or "HDMI-A-1" (likely compositor
@@ -139,6 +155,43 @@ struct Lava_bar_configuration
 	enum Condition_resolution condition_resolution;
 };
 
+/* Routines specialized for the orientation, mode and indicator style of the
+ * configuration of a bar instance.
+ */
+struct Lava_bar_instance_ops
+{
+	void (*update_dimensions)(struct Lava_bar_instance *instance);
+	void (*draw_items)(struct Lava_bar_instance *instance, cairo_t *cairo);
+	void (*redraw_image_items)(struct Lava_bar_instance *instance, cairo_t *cairo,
+			image_t *image);
+	void (*position_item_surfaces)(struct Lava_bar_instance *instance, int32_t x, int32_t y);
+	void (*move_indicator)(struct Lava_item_indicator *indicator, struct Lava_item *item);
+	void (*indicator_shape)(cairo_t *cairo, uint32_t size, uradii_t *radii);
+	struct Lava_item *(*item_from_coords)(struct Lava_bar_instance *instance,
+			uint32_t x, uint32_t y);
+};
+
+/* Surface of a single button, used when icons are not drawn to a shared surface. */
+struct Lava_item_surface
+{
+	struct wl_list link;
+
+	struct Lava_item     *item;
+	struct wl_surface    *surface;
+	struct wl_subsurface *subsurface;
+
+	struct Lava_buffer  buffers[2];
+	struct Lava_buffer *current_buffer;
+
+	/* State of the attached frame, so unchanged icons are not uploaded again. */
+	bool     attached;
+	uint32_t scale;
+	uint64_t frame_hash;
+
+	/* Position of the subsurface last sent to the compositor. */
+	int32_t x, y;
+};
+
 /* This struct corresponds to one instance of a bar. */
 struct Lava_bar_instance
 {
@@ -146,6 +199,7 @@ struct Lava_bar_instance
 
 	struct Lava_bar               *bar;
 	struct Lava_bar_configuration *config;
+	struct Lava_bar_instance_ops   ops;
 	struct Lava_output            *output;
 	struct wl_surface             *bar_surface;
 	struct wl_surface             *icon_surface;
@@ -158,17 +212,55 @@ struct Lava_bar_instance
 	ubox_t bar_hidden_dim;
 	ubox_t item_area_dim;
 
+	/* Size of the last configure event, the position is unused. */
+	ubox_t configured_dim;
+
 	bool hidden, hover;
 
+	/* Geometry of the current input region of the bar surface. */
+	bool     input_region_set;
+	ubox_t   input_region_dim;
+	uradii_t input_region_radii;
+
 	struct Lava_buffer  bar_buffers[2];
 	struct Lava_buffer *current_bar_buffer;
 
 	struct Lava_buffer  icon_buffers[2];
 	struct Lava_buffer *current_icon_buffer;
 
+	/* Surface state last sent to the compositor, see surface_set_buffer_scale(). */
+	uint32_t bar_buffer_scale, icon_buffer_scale;
+	int32_t  subsurface_x, subsurface_y;
+
+	/* Indicators currently shown and hidden ones kept for re-use. */
 	struct wl_list indicators;
+	struct wl_list spare_indicators;
+
+	/* Only used when the icons have separate surfaces. */
+	bool separate_icon_surfaces;
+	struct wl_list item_surfaces;
+
+	struct Lava_tooltip tooltip;
+
+	/* First frames rendered before the first configure event. */
+	bool prerendered, prerendered_hidden;
+	struct Lava_bar_configuration *prerendered_config;
 
-	bool configured;
+	/* Hashes of the inputs of the currently attached frames. */
+	uint64_t bar_frame_hash, icon_frame_hash;
+
+	/* Visibility, see bar_instance_is_visible(). */
+	struct wl_callback *frame_callback;
+	struct Lava_timer frame_timer;
+	uint32_t entered_outputs;
+	bool frame_stalled, visible, redraw_pending;
+
+	/* Pending validation of the snapshot used for the first frame and
+	 * pending save of the first frame as snapshot.
+	 */
+	struct wl_callback *snapshot_callback, *snapshot_save_callback;
+
+	bool configured, drawn;
 };
 
 struct Lava_item_indicator
@@ -183,6 +275,13 @@ struct Lava_item_indicator
 	struct wl_subsurface *indicator_subsurface;
 	struct Lava_buffer    indicator_buffers[2];
 	struct Lava_buffer   *current_indicator_buffer;
+
+	/* Surface state last sent to the compositor and whether there are
+	 * changes which still need to be committed.
+	 */
+	uint32_t scale;
+	int32_t  x, y;
+	bool     dirty;
 };
 
 /* This struct is a logical bar, which can have multiple configuration sets and
@@ -199,6 +298,9 @@ struct Lava_bar
 	/* The different configurations of the bar. The first one is treated as default. */
 	struct Lava_bar_configuration *current_config, *default_config, *last_config;
 	struct wl_list configs;
+
+	/* The fragment the bar has been defined in, NULL for the configuration file. */
+	struct Lava_fragment *fragment;
 };
 
 bool create_bar_config (struct Lava_bar *bar, bool default_config);
@@ -206,12 +308,15 @@ struct Lava_bar_configuration *get_bar_config_for_output (struct Lava_bar *bar,
 
 bool create_bar (void);
 bool finalize_bar (struct Lava_bar *bar);
-void destroy_all_bars (void);
+bool load_all_bar_images (struct wl_list *bars, bool sandbox, uint32_t scale);
+void destroy_all_bars (struct wl_list *bars);
 bool bar_config_set_variable (struct Lava_bar_configuration *config,
 		const char *variable, const char *value, int line);
 
 bool create_bar_instance (struct Lava_bar *bar, struct Lava_bar_configuration *config, struct Lava_output *output);
 void destroy_bar_instance (struct Lava_bar_instance *instance);
+void bar_instance_set_config (struct Lava_bar_instance *instance,
+		struct Lava_bar_configuration *config);
 void destroy_all_bar_instances (struct Lava_output *output);
 void update_bar_instance (struct Lava_bar_instance *instance, bool need_new_dimensions,
 		bool only_update_on_hide_change);
@@ -219,6 +324,16 @@ struct Lava_bar_instance *bar_instance_from_surface (struct wl_surface *surface)
 struct Lava_bar_instance *bar_instance_from_bar (struct Lava_bar *bar, struct Lava_output *output);
 void bar_instance_pointer_leave (struct Lava_bar_instance *instance);
 void bar_instance_pointer_enter (struct Lava_bar_instance *instance);
+void bar_instance_redraw_image (struct Lava_bar_instance *instance, image_t *image);
+bool bar_instance_is_visible (struct Lava_bar_instance *instance);
+bool any_bar_instance_visible (void);
+void add_bar_instance_visibility_listener (struct wl_listener *listener);
+void draw_bar_background (cairo_t *cairo, ubox_t *_dim, udirections_t *_border, uradii_t *_radii,
+		uint32_t scale, colour_t *bar_colour, colour_t *border_colour);
+
+bool surface_set_buffer_scale (struct wl_surface *surface, uint32_t *current, uint32_t scale);
+bool subsurface_set_position (struct wl_subsurface *subsurface,
+		int32_t *current_x, int32_t *current_y, int32_t x, int32_t y);
 
 void destroy_indicator (struct Lava_item_indicator *indicator);
 struct Lava_item_indicator *create_indicator (struct Lava_bar_instance *instance);
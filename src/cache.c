@@ -0,0 +1,73 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<sys/stat.h>
+
+#include"lavalauncher.h"
+#include"str.h"
+#include"cache.h"
+
+static bool make_directory (const char *path)
+{
+	errno = 0;
+	if ( mkdir(path, 0700) == 0 || errno == EEXIST )
+		return true;
+	log_message(1, "[cache] Can not create directory: %s: %s\n", path, strerror(errno));
+	return false;
+}
+
+/* Returns the path of the given file in the cache directory of LavaLauncher
+ * (usually ~/.cache/lavalauncher/), creating the directory if necessary.
+ * Returns NULL if there is no usable cache directory. The returned string
+ * must be freed by the caller.
+ */
+char *get_cache_file_path (const char *name)
+{
+	char *base = NULL;
+	const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	if ( xdg_cache_home != NULL && *xdg_cache_home != '\0' )
+		base = get_formatted_buffer("%s", xdg_cache_home);
+	else if ( home != NULL && *home != '\0' )
+		base = get_formatted_buffer("%s/.cache", home);
+	else
+		return NULL;
+	if ( base == NULL )
+		return NULL;
+
+	char *dir = get_formatted_buffer("%s/lavalauncher", base);
+	if ( dir == NULL || ! make_directory(base) || ! make_directory(dir) )
+	{
+		free(base);
+		free_if_set(dir);
+		return NULL;
+	}
+
+	char *path = get_formatted_buffer("%s/%s", dir, name);
+	free(base);
+	free(dir);
+	return path;
+}
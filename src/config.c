@@ -17,17 +17,26 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include<stdio.h>
 #include<stdlib.h>
 #include<stdbool.h>
 #include<errno.h>
 #include<string.h>
 #include<ctype.h>
+#include<dirent.h>
+#include<sys/stat.h>
 
 #include"lavalauncher.h"
 #include"str.h"
 #include"item.h"
 #include"bar.h"
+#include"hash.h"
+#include"config.h"
+
+struct Lava_generation *parse_generation = NULL;
+struct Lava_fragment   *parse_fragment   = NULL;
 
 bool is_boolean_true (const char *str)
 {
@@ -56,13 +65,33 @@ bool set_boolean (bool *b, const char *value)
 static bool global_set_watch (const char *arg)
 {
 #ifdef WATCH_CONFIG
-	return set_boolean(&context.watch, arg);
+	return set_boolean(&parse_generation->watch, arg);
 #else
 	log_message(0, "WARNING: LavaLauncher has been compiled without the ability to watch the configuration file for changes.\n");
 	return true;
 #endif
 }
 
+static bool global_set_watch_images (const char *arg)
+{
+#ifdef WATCH_CONFIG
+	return set_boolean(&parse_generation->watch_images, arg);
+#else
+	log_message(0, "WARNING: LavaLauncher has been compiled without the ability to watch image files for changes.\n");
+	return true;
+#endif
+}
+
+static bool global_set_sandbox_decode (const char *arg)
+{
+#if HAS_MEMFD
+	return set_boolean(&parse_generation->sandbox_decode, arg);
+#else
+	log_message(0, "WARNING: LavaLauncher has been compiled without the ability to decode images in sandboxed helper processes.\n");
+	return true;
+#endif
+}
+
 bool global_set_variable (const char *variable, const char *value, int line)
 {
 	struct
@@ -70,7 +99,9 @@ bool global_set_variable (const char *variable, const char *value, int line)
 		const char *variable;
 		bool (*set)(const char*);
 	} configs[] = {
-		{ .variable = "watch-config-file", .set = global_set_watch }
+		{ .variable = "watch-config-file",      .set = global_set_watch          },
+		{ .variable = "watch-image-files",      .set = global_set_watch_images   },
+		{ .variable = "sandbox-image-decoding", .set = global_set_sandbox_decode }
 	};
 
 	FOR_ARRAY(configs, i) if (! strcmp(configs[i].variable, variable))
@@ -109,6 +140,7 @@ struct Parser
 {
 	FILE *file;
 	int line;
+	uint64_t hash;
 
 	enum Parser_state   state;
 	enum Parser_context context;
@@ -133,7 +165,7 @@ static bool parser_get_char (struct Parser *parser, char *ch)
 				return false;
 			}
 			*ch = '\0';
-			break;
+			return true;
 
 		case '\n':
 			parser->line++;
@@ -143,6 +175,7 @@ static bool parser_get_char (struct Parser *parser, char *ch)
 			break;
 	}
 
+	parser->hash = hash_update(parser->hash, ch, 1);
 	return true;
 }
 
@@ -180,7 +213,7 @@ static bool parser_handle_bracket (struct Parser *parser, const char ch)
 		switch (parser->context)
 		{
 			case CONTEXT_BAR:
-				if (! finalize_bar(context.last_bar))
+				if (! finalize_bar(parse_generation->last_bar))
 					return false;
 				parser->context = CONTEXT_NONE;
 				break;
@@ -351,6 +384,267 @@ unexpected_quote:
 	return false;
 }
 
+static bool parser_run (struct Parser *parser);
+
+/* Relative paths of includes are relative to the configuration file. */
+static char *include_get_path (const char *path)
+{
+	const char *slash = strrchr(context.config_path, '/');
+	if ( path[0] == '/' || slash == NULL )
+		return strdup(path);
+	return get_formatted_buffer("%.*s/%s", (int)(slash - context.config_path),
+			context.config_path, path);
+}
+
+static char *read_fragment (const char *path, size_t *length)
+{
+	errno = 0;
+	FILE *file = fopen(path, "r");
+	if ( file == NULL )
+	{
+		log_message(0, "ERROR: Can not open fragment \"%s\".\n"
+				"ERROR: fopen: %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	char *content = NULL;
+	long size;
+	if ( fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0 )
+	{
+		log_message(0, "ERROR: Can not get size of fragment \"%s\".\n", path);
+		goto exit;
+	}
+
+	*length = (size_t)size;
+	if ( NULL == (content = malloc(*length + 1)) )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		goto exit;
+	}
+	if ( fread(content, 1, *length, file) != *length )
+	{
+		log_message(0, "ERROR: Can not read fragment \"%s\".\n", path);
+		DESTROY_NULL(content, free);
+	}
+
+exit:
+	fclose(file);
+	return content;
+}
+
+/* Fragments are identified by path and content. Only called while the
+ * installed configuration does not change, either on the main thread or on
+ * the reload worker.
+ */
+static struct Lava_fragment *find_installed_fragment (const char *path, uint64_t hash)
+{
+	struct Lava_include *include;
+	struct Lava_fragment *fragment;
+	wl_list_for_each(include, &context.includes, link)
+		wl_list_for_each(fragment, &include->fragments, link)
+			if ( fragment->hash == hash && ! strcmp(fragment->path, path) )
+				return fragment;
+	return NULL;
+}
+
+static bool fragment_is_included (struct Lava_generation *generation, const char *path)
+{
+	struct Lava_include *include;
+	struct Lava_fragment *fragment;
+	wl_list_for_each(include, &generation->includes, link)
+		wl_list_for_each(fragment, &include->fragments, link)
+			if (! strcmp(fragment->path, path))
+				return true;
+	return false;
+}
+
+static void generation_add_fragment_needs (struct Lava_generation *generation,
+		struct Lava_fragment *fragment)
+{
+	generation->need_keyboard         = generation->need_keyboard || fragment->need_keyboard;
+	generation->need_touch            = generation->need_touch || fragment->need_touch;
+	generation->need_pointer          = generation->need_pointer || fragment->need_pointer;
+	generation->need_river_status     = generation->need_river_status || fragment->need_river_status;
+	generation->need_foreign_toplevel = generation->need_foreign_toplevel || fragment->need_foreign_toplevel;
+	generation->need_dbus             = generation->need_dbus || fragment->need_dbus;
+}
+
+/* The bars of a fragment are parsed into a generation of their own, which
+ * collects what they need, and then moved into the generation being built.
+ */
+static bool parse_fragment_content (struct Lava_fragment *fragment, char *content, size_t length)
+{
+	struct Lava_generation *generation = parse_generation;
+	struct Lava_generation fragment_generation;
+	generation_init(&fragment_generation);
+
+	bool ret = true;
+	if ( length > 0 )
+	{
+		errno = 0;
+		struct Parser parser = {
+			.file    = NULL,
+			.line    = 1,
+			.hash    = HASH_INIT,
+			.context = CONTEXT_NONE,
+			.state   = STATE_EXPECT_NAME_OR_CB
+		};
+		if ( NULL == (parser.file = fmemopen(content, length, "r")) )
+		{
+			log_message(0, "ERROR: fmemopen: %s\n", strerror(errno));
+			return false;
+		}
+
+		parse_generation = &fragment_generation;
+		parse_fragment   = fragment;
+		ret = parser_run(&parser);
+		parse_generation = generation;
+		parse_fragment   = NULL;
+
+		fclose(parser.file);
+	}
+
+	fragment->need_keyboard         = fragment_generation.need_keyboard;
+	fragment->need_touch            = fragment_generation.need_touch;
+	fragment->need_pointer          = fragment_generation.need_pointer;
+	fragment->need_river_status     = fragment_generation.need_river_status;
+	fragment->need_foreign_toplevel = fragment_generation.need_foreign_toplevel;
+	fragment->need_dbus             = fragment_generation.need_dbus;
+	generation_add_fragment_needs(generation, fragment);
+
+	/* Also after an error, so the bars are destroyed with the generation. */
+	if ( fragment_generation.last_bar != NULL )
+	{
+		wl_list_insert_list(&generation->bars, &fragment_generation.bars);
+		generation->last_bar = fragment_generation.last_bar;
+	}
+
+	return ret;
+}
+
+static bool include_fragment (struct Lava_include *include, const char *path)
+{
+	struct Lava_generation *generation = parse_generation;
+
+	if (fragment_is_included(generation, path))
+	{
+		log_message(0, "ERROR: Fragment \"%s\" is included more than once.\n", path);
+		return false;
+	}
+
+	TRY_NEW(struct Lava_fragment, fragment, false);
+	wl_list_insert(include->fragments.prev, &fragment->link);
+	fragment->reuse        = NULL;
+	fragment->previous_bar = NULL;
+	if ( NULL == (fragment->path = strdup(path)) )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		return false;
+	}
+
+	size_t length;
+	char *content = read_fragment(path, &length);
+	if ( content == NULL )
+		return false;
+	fragment->hash = hash_update(HASH_INIT, content, length);
+
+	generation->config_hash = hash_update(generation->config_hash,
+			&fragment->hash, sizeof(fragment->hash));
+
+	bool ret = true;
+	if ( NULL != (fragment->reuse = find_installed_fragment(path, fragment->hash)) )
+	{
+		log_message(1, "[config] Fragment unchanged: %s\n", path);
+		fragment->previous_bar          = generation->last_bar;
+		fragment->need_keyboard         = fragment->reuse->need_keyboard;
+		fragment->need_touch            = fragment->reuse->need_touch;
+		fragment->need_pointer          = fragment->reuse->need_pointer;
+		fragment->need_river_status     = fragment->reuse->need_river_status;
+		fragment->need_foreign_toplevel = fragment->reuse->need_foreign_toplevel;
+		fragment->need_dbus             = fragment->reuse->need_dbus;
+		generation_add_fragment_needs(generation, fragment);
+	}
+	else
+	{
+		log_message(1, "[config] Parsing fragment: %s\n", path);
+		if (! (ret = parse_fragment_content(fragment, content, length)))
+			log_message(0, "INFO: The error is in \"%s\".\n", path);
+	}
+
+	free(content);
+	return ret;
+}
+
+static int fragment_name_filter (const struct dirent *dirent)
+{
+	const char *name = dirent->d_name;
+	const size_t len = strlen(name);
+	return name[0] != '.' && len > 5 && ! strcmp(name + len - 5, ".conf");
+}
+
+/* The fragments of a directory are included in alphabetical order. */
+static bool include_directory (struct Lava_include *include)
+{
+	struct dirent **names;
+	int count;
+	if ( 0 > (count = scandir(include->path, &names, fragment_name_filter, alphasort)) )
+	{
+		log_message(0, "ERROR: Can not read directory \"%s\".\n"
+				"ERROR: scandir: %s\n", include->path, strerror(errno));
+		return false;
+	}
+
+	bool ret = true;
+	for (int i = 0; i < count; i++)
+	{
+		char *path = NULL;
+		if ( ret && NULL != (path = get_formatted_buffer("%s/%s", include->path, names[i]->d_name)) )
+		{
+			struct stat st;
+			if ( stat(path, &st) == 0 && S_ISREG(st.st_mode) )
+				ret = include_fragment(include, path);
+			free(path);
+		}
+		free(names[i]);
+	}
+	free(names);
+
+	return ret;
+}
+
+static bool parse_include (const char *path, int line)
+{
+	TRY_NEW(struct Lava_include, include, false);
+	wl_list_init(&include->fragments);
+	wl_list_insert(parse_generation->includes.prev, &include->link);
+
+	errno = 0;
+	struct stat st;
+	if ( NULL == (include->path = include_get_path(path)) )
+		goto error;
+	if ( stat(include->path, &st) != 0 )
+	{
+		log_message(0, "ERROR: Can not include \"%s\".\n"
+				"ERROR: stat: %s\n", include->path, strerror(errno));
+		goto error;
+	}
+
+	if (S_ISDIR(st.st_mode))
+	{
+		if (! include_directory(include))
+			goto error;
+	}
+	else if (! include_fragment(include, include->path))
+		goto error;
+
+	return true;
+
+error:
+	log_message(0, "INFO: The error is on line %d in \"%s\".\n",
+			line, context.config_path);
+	return false;
+}
+
 static bool parser_handle_string (struct Parser *parser, const char ch)
 {
 	if ( parser->state == STATE_EXPECT_NAME_OR_CB )
@@ -362,12 +656,17 @@ static bool parser_handle_string (struct Parser *parser, const char ch)
 		/* Check if name is that of a context, which then should be entered. */
 		if ( parser->context == CONTEXT_NONE )
 		{
-			if (! strcmp(parser->name_buffer, "global-settings"))
+			if ( parse_fragment == NULL && ! strcmp(parser->name_buffer, "global-settings") )
 			{
 				parser->context = CONTEXT_GLOBAL_SETTINGS;
 				parser->state = STATE_EXPECT_OB;
 				return true;
 			}
+			else if ( parse_fragment == NULL && ! strcmp(parser->name_buffer, "include") )
+			{
+				parser->state = STATE_EXPECT_EQUALS;
+				return true;
+			}
 			else if (! strcmp(parser->name_buffer, "bar"))
 			{
 				parser->context = CONTEXT_BAR;
@@ -386,19 +685,19 @@ static bool parser_handle_string (struct Parser *parser, const char ch)
 			{
 				parser->context = CONTEXT_CONFIG;
 				parser->state = STATE_EXPECT_OB;
-				return create_bar_config(context.last_bar, false);
+				return create_bar_config(parse_generation->last_bar, false);
 			}
 			if (! strcmp(parser->name_buffer, "button"))
 			{
 				parser->context = CONTEXT_BUTTON;
 				parser->state = STATE_EXPECT_OB;
-				return create_item(context.last_bar, TYPE_BUTTON);
+				return create_item(parse_generation->last_bar, TYPE_BUTTON);
 			}
 			else if (! strcmp(parser->name_buffer, "spacer"))
 			{
 				parser->context = CONTEXT_SPACER;
 				parser->state = STATE_EXPECT_OB;
-				return create_item(context.last_bar, TYPE_SPACER);
+				return create_item(parse_generation->last_bar, TYPE_SPACER);
 			}
 		}
 
@@ -413,10 +712,14 @@ static bool parser_handle_string (struct Parser *parser, const char ch)
 					&parser->value_buffer_length, ch, false))
 			return false;
 
-		struct Lava_bar *last_bar = context.last_bar;
+		struct Lava_bar *last_bar = parse_generation->last_bar;
 		parser->state = STATE_EXPECT_SEMICOLON;
 		switch (parser->context)
 		{
+			case CONTEXT_NONE:
+				/* Only includes are assignments outside of a context. */
+				return parse_include(parser->value_buffer, parser->line);
+
 			case CONTEXT_GLOBAL_SETTINGS:
 				return global_set_variable(parser->name_buffer,
 						parser->value_buffer, parser->line);
@@ -448,64 +751,169 @@ static bool parser_handle_string (struct Parser *parser, const char ch)
 	return false;
 }
 
-bool parse_config_file (void)
+void generation_init (struct Lava_generation *generation)
 {
-	errno = 0;
-	struct Parser parser = {
-		.file    = NULL,
-		.line    = 1,
-		.context = CONTEXT_NONE,
-		.state   = STATE_EXPECT_NAME_OR_CB
-	};
-	if ( NULL == (parser.file = fopen(context.config_path, "r")) )
-	{
-		log_message(0, "ERROR: Can not open config file \"%s\".\n"
-				"ERROR: fopen: %s\n",
-				context.config_path, strerror(errno));
-		return false;
-	}
+	wl_list_init(&generation->bars);
+	wl_list_init(&generation->includes);
+	generation->last_bar          = NULL;
+	generation->need_keyboard     = false;
+	generation->need_touch        = false;
+	generation->need_pointer      = false;
+	generation->need_river_status = false;
+	generation->need_foreign_toplevel = false;
+	generation->need_dbus         = false;
+	generation->config_hash       = HASH_INIT;
+	generation->sandbox_decode    = false;
+#ifdef WATCH_CONFIG
+	generation->watch             = false;
+	generation->watch_images      = false;
+#endif
+}
 
-	bool ret = true;
-	for(char ch;;)
+/* Move the content of the generation into the context. */
+void install_generation (struct Lava_generation *generation)
+{
+	wl_list_init(&context.bars);
+	wl_list_insert_list(&context.bars, &generation->bars);
+	wl_list_init(&generation->bars);
+	wl_list_init(&context.includes);
+	wl_list_insert_list(&context.includes, &generation->includes);
+	wl_list_init(&generation->includes);
+	context.last_bar          = generation->last_bar;
+	context.need_keyboard     = generation->need_keyboard;
+	context.need_touch        = generation->need_touch;
+	context.need_pointer      = generation->need_pointer;
+	context.need_river_status = generation->need_river_status;
+	context.need_foreign_toplevel = generation->need_foreign_toplevel;
+	context.need_dbus         = generation->need_dbus;
+	context.config_hash       = generation->config_hash;
+	context.sandbox_decode    = generation->sandbox_decode;
+#ifdef WATCH_CONFIG
+	context.watch             = generation->watch;
+	context.watch_images      = generation->watch_images;
+#endif
+}
+
+static bool parser_run (struct Parser *parser)
+{
+	for (char ch;;)
 	{
-		if (! parser_get_char(&parser, &ch))
-		{
-			ret = false;
-			goto exit;
-		}
+		if (! parser_get_char(parser, &ch))
+			return false;
 
+		bool ret;
 		if ( ch == '\0' )
-		{
-			ret = parser_handle_eof(&parser);
-			goto exit;
-		}
+			return parser_handle_eof(parser);
 		else if ( ch == '#')
 		{
 			bool eof;
-			ret = parser_ignore_line(&parser, &eof);
+			ret = parser_ignore_line(parser, &eof);
 			if ( eof && ret )
-			{
-				ret = parser_handle_eof(&parser);
-				goto exit;
-			}
+				return parser_handle_eof(parser);
 		}
 		else if (isspace(ch))
 			continue;
 		else if ( ch == '{' || ch == '}' )
-			ret = parser_handle_bracket(&parser, ch);
+			ret = parser_handle_bracket(parser, ch);
 		else if ( ch == '=' )
-			ret = parser_handle_equals(&parser, ch);
+			ret = parser_handle_equals(parser, ch);
 		else if ( ch == ';' )
-			ret = parser_handle_semicolon(&parser, ch);
+			ret = parser_handle_semicolon(parser, ch);
 		else
-			ret = parser_handle_string(&parser, ch);
+			ret = parser_handle_string(parser, ch);
 
 		if (! ret)
-			goto exit;
+			return false;
 	}
+}
 
-exit:
+/* Move the bars of unchanged fragments from the context into the generation,
+ * to where their parsed replacements would have been. Bars are listed newest
+ * first, so the fragments are handled from the last to the first, each placing
+ * its bars right before the bar which has been parsed before its include.
+ */
+void generation_take_over_fragments (struct Lava_generation *generation)
+{
+	struct Lava_include *include;
+	struct Lava_fragment *fragment;
+	wl_list_for_each_reverse(include, &generation->includes, link)
+		wl_list_for_each_reverse(fragment, &include->fragments, link)
+	{
+		if ( fragment->reuse == NULL )
+			continue;
+
+		struct wl_list *before = fragment->previous_bar == NULL
+			? &generation->bars : &fragment->previous_bar->link;
+
+		struct Lava_bar *bar, *temp;
+		wl_list_for_each_safe(bar, temp, &context.bars, link)
+		{
+			if ( bar->fragment != fragment->reuse )
+				continue;
+			wl_list_remove(&bar->link);
+			wl_list_insert(before->prev, &bar->link);
+			bar->fragment = fragment;
+		}
+
+		fragment->reuse        = NULL;
+		fragment->previous_bar = NULL;
+	}
+}
+
+static void destroy_include (struct Lava_include *include)
+{
+	struct Lava_fragment *fragment, *temp;
+	wl_list_for_each_safe(fragment, temp, &include->fragments, link)
+	{
+		wl_list_remove(&fragment->link);
+		free_if_set(fragment->path);
+		free(fragment);
+	}
+	wl_list_remove(&include->link);
+	free_if_set(include->path);
+	free(include);
+}
+
+void destroy_all_includes (struct wl_list *includes)
+{
+	struct Lava_include *include, *temp;
+	wl_list_for_each_safe(include, temp, includes, link)
+		destroy_include(include);
+}
+
+/* The file a bar or setting comes from, for error messages. */
+const char *fragment_path (struct Lava_fragment *fragment)
+{
+	return fragment == NULL ? context.config_path : fragment->path;
+}
+
+/* Parse the configuration file into the given generation. */
+bool parse_config_file (struct Lava_generation *generation)
+{
+	errno = 0;
+	struct Parser parser = {
+		.file    = NULL,
+		.line    = 1,
+		.hash    = HASH_INIT,
+		.context = CONTEXT_NONE,
+		.state   = STATE_EXPECT_NAME_OR_CB
+	};
+	if ( NULL == (parser.file = fopen(context.config_path, "r")) )
+	{
+		log_message(0, "ERROR: Can not open config file \"%s\".\n"
+				"ERROR: fopen: %s\n",
+				context.config_path, strerror(errno));
+		return false;
+	}
+
+	parse_generation = generation;
+	const bool ret = parser_run(&parser);
+	parse_generation = NULL;
 	fclose(parser.file);
+
+	/* The fragments have already been hashed while they were included. */
+	generation->config_hash = hash_update(parser.hash,
+			&generation->config_hash, sizeof(generation->config_hash));
+
 	return ret;
 }
-
@@ -21,11 +21,91 @@
 #define LAVALAUNCHER_CONFIG_H
 
 #include<stdbool.h>
+#include<stdint.h>
+#include<wayland-server.h>
+
+struct Lava_bar;
+
+/* A file included by the configuration file. Fragments may only contain bars.
+ * The bars are cached by the hash of the content of the file, so a reload does
+ * not parse unchanged fragments again, but takes over their current bars.
+ */
+struct Lava_fragment
+{
+	struct wl_list link;
+	char *path;
+	uint64_t hash;
+
+	/* Which input devices and optional protocols do the bars need? */
+	bool need_keyboard;
+	bool need_touch;
+	bool need_pointer;
+	bool need_river_status;
+	bool need_foreign_toplevel;
+	bool need_dbus;
+
+	/* If the fragment is unchanged, the fragment of the installed
+	 * configuration whose bars are taken over and the bar they follow.
+	 */
+	struct Lava_fragment *reuse;
+	struct Lava_bar *previous_bar;
+};
+
+/* An include assignment, naming either a single fragment or a directory of
+ * them.
+ */
+struct Lava_include
+{
+	struct wl_list link;
+	char *path;
+	struct wl_list fragments;
+};
+
+/* Everything parsing the configuration file produces. A generation is filled
+ * by the parser and then installed into the context, which allows building a
+ * new one while the current one is still in use.
+ */
+struct Lava_generation
+{
+	struct wl_list bars;
+	struct Lava_bar *last_bar;
+	struct wl_list includes;
+
+	/* Which input devices and optional protocols are needed? */
+	bool need_keyboard;
+	bool need_touch;
+	bool need_pointer;
+	bool need_river_status;
+	bool need_foreign_toplevel;
+	bool need_dbus;
+
+	/* Hash of the content of the configuration file and all fragments. */
+	uint64_t config_hash;
+
+	/* Decode images in sandboxed helper processes? */
+	bool sandbox_decode;
+
+#ifdef WATCH_CONFIG
+	bool watch;
+	bool watch_images;
+#endif
+};
+
+/* The generation the parser currently fills. */
+extern struct Lava_generation *parse_generation;
+
+/* The fragment the parser currently reads, NULL for the configuration file. */
+extern struct Lava_fragment *parse_fragment;
 
 bool is_boolean_true (const char *str);
 bool is_boolean_false (const char *str);
 bool set_boolean (bool *b, const char *value);
-bool parse_config_file (void);
+void generation_init (struct Lava_generation *generation);
+void install_generation (struct Lava_generation *generation);
+void generation_take_over_fragments (struct Lava_generation *generation);
+void destroy_all_includes (struct wl_list *includes);
+const char *fragment_path (struct Lava_fragment *fragment);
+bool parse_config_file (struct Lava_generation *generation);
 
 #endif
 
@@ -0,0 +1,628 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<stddef.h>
+#include<unistd.h>
+#include<string.h>
+#include<ctype.h>
+#include<poll.h>
+#include<errno.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+
+#include"lavalauncher.h"
+#include"event-loop.h"
+#include"str.h"
+#include"dbus.h"
+
+/* Just enough of a D-Bus client to activate applications implementing the
+ * org.freedesktop.Application interface: It authenticates with the session
+ * bus, sends method calls without waiting for their replies and only looks
+ * at the messages it receives to report errors.
+ */
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define DBUS_NATIVE_ENDIAN 'l'
+#else
+#define DBUS_NATIVE_ENDIAN 'B'
+#endif
+
+#define DBUS_MESSAGE_METHOD_CALL 1
+#define DBUS_MESSAGE_ERROR       3
+
+#define DBUS_FIELD_PATH        1
+#define DBUS_FIELD_INTERFACE   2
+#define DBUS_FIELD_MEMBER      3
+#define DBUS_FIELD_ERROR_NAME  4
+#define DBUS_FIELD_DESTINATION 6
+#define DBUS_FIELD_SIGNATURE   8
+
+/* Larger messages are a protocol violation of the bus. */
+#define DBUS_MAX_MESSAGE_SIZE (128 * 1024 * 1024)
+
+struct Dbus_buffer
+{
+	char  *data;
+	size_t len, size;
+	bool   failed;
+};
+
+static int  dbus_fd = -1;
+static bool dbus_authenticated = false;
+static uint32_t dbus_serial = 0;
+
+/* Messages not yet written to and data not yet parsed from the socket. */
+static struct Dbus_buffer dbus_out = { NULL, 0, 0, false };
+static struct Dbus_buffer dbus_in  = { NULL, 0, 0, false };
+
+/****************
+ *              *
+ *  Marshaling  *
+ *              *
+ ****************/
+static bool buffer_reserve (struct Dbus_buffer *buffer, size_t len)
+{
+	if (buffer->failed)
+		return false;
+	if ( buffer->len + len <= buffer->size )
+		return true;
+
+	size_t size = buffer->size == 0 ? 256 : buffer->size;
+	while ( size < buffer->len + len )
+		size *= 2;
+	char *data = realloc(buffer->data, size);
+	if ( data == NULL )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		buffer->failed = true;
+		return false;
+	}
+	buffer->data = data;
+	buffer->size = size;
+	return true;
+}
+
+static void buffer_append (struct Dbus_buffer *buffer, const void *data, size_t len)
+{
+	if (! buffer_reserve(buffer, len))
+		return;
+	memcpy(buffer->data + buffer->len, data, len);
+	buffer->len += len;
+}
+
+static void buffer_consume (struct Dbus_buffer *buffer, size_t len)
+{
+	memmove(buffer->data, buffer->data + len, buffer->len - len);
+	buffer->len -= len;
+}
+
+static void buffer_finish (struct Dbus_buffer *buffer)
+{
+	free_if_set(buffer->data);
+	buffer->data   = NULL;
+	buffer->len    = 0;
+	buffer->size   = 0;
+	buffer->failed = false;
+}
+
+/* Alignment is relative to the start of the message. */
+static void marshal_pad (struct Dbus_buffer *buffer, size_t alignment)
+{
+	static const char zeroes[8] = { 0 };
+	if ( buffer->len % alignment != 0 )
+		buffer_append(buffer, zeroes, alignment - buffer->len % alignment);
+}
+
+static void marshal_byte (struct Dbus_buffer *buffer, uint8_t byte)
+{
+	buffer_append(buffer, &byte, 1);
+}
+
+static void marshal_uint32 (struct Dbus_buffer *buffer, uint32_t value)
+{
+	marshal_pad(buffer, 4);
+	buffer_append(buffer, &value, 4);
+}
+
+/* Also used for object paths. */
+static void marshal_string (struct Dbus_buffer *buffer, const char *str)
+{
+	const size_t len = strlen(str);
+	marshal_uint32(buffer, (uint32_t)len);
+	buffer_append(buffer, str, len + 1);
+}
+
+static void marshal_signature (struct Dbus_buffer *buffer, const char *signature)
+{
+	const size_t len = strlen(signature);
+	marshal_byte(buffer, (uint8_t)len);
+	buffer_append(buffer, signature, len + 1);
+}
+
+static void marshal_header_field (struct Dbus_buffer *buffer, uint8_t code,
+		const char *type, const char *value)
+{
+	marshal_pad(buffer, 8);
+	marshal_byte(buffer, code);
+	marshal_signature(buffer, type);
+	if ( *type == 'g' )
+		marshal_signature(buffer, value);
+	else
+		marshal_string(buffer, value);
+}
+
+/* Queue a method call. The body must have been marshaled starting at an
+ * offset aligned to 8 bytes, which is where the body of a message starts.
+ */
+static bool dbus_call (const char *destination, const char *path, const char *interface,
+		const char *member, const char *signature, struct Dbus_buffer *body)
+{
+	struct Dbus_buffer message = { NULL, 0, 0, false };
+	marshal_byte(&message, DBUS_NATIVE_ENDIAN);
+	marshal_byte(&message, DBUS_MESSAGE_METHOD_CALL);
+	marshal_byte(&message, 0);
+	marshal_byte(&message, 1);
+	marshal_uint32(&message, body == NULL ? 0 : (uint32_t)body->len);
+	marshal_uint32(&message, ++dbus_serial);
+
+	/* The length of the header field array is only known afterwards. */
+	marshal_uint32(&message, 0);
+	marshal_pad(&message, 8);
+	const size_t fields_start = message.len;
+	marshal_header_field(&message, DBUS_FIELD_PATH, "o", path);
+	marshal_header_field(&message, DBUS_FIELD_INTERFACE, "s", interface);
+	marshal_header_field(&message, DBUS_FIELD_MEMBER, "s", member);
+	marshal_header_field(&message, DBUS_FIELD_DESTINATION, "s", destination);
+	if ( signature != NULL )
+		marshal_header_field(&message, DBUS_FIELD_SIGNATURE, "g", signature);
+	if (! message.failed)
+	{
+		const uint32_t fields_len = (uint32_t)(message.len - fields_start);
+		memcpy(message.data + 12, &fields_len, 4);
+	}
+	marshal_pad(&message, 8);
+
+	if ( body != NULL && body->failed )
+		message.failed = true;
+	else if ( body != NULL )
+		buffer_append(&message, body->data, body->len);
+
+	if (! message.failed)
+		buffer_append(&dbus_out, message.data, message.len);
+	const bool ret = ! message.failed && ! dbus_out.failed;
+	buffer_finish(&message);
+	return ret;
+}
+
+/******************
+ *                *
+ *  Unmarshaling  *
+ *                *
+ ******************/
+static uint32_t unmarshal_uint32 (const char *data, bool native)
+{
+	uint32_t value;
+	memcpy(&value, data, 4);
+	if (! native)
+		value = __builtin_bswap32(value);
+	return value;
+}
+
+/* Get the string of the header field with the given code, if it exists. */
+static const char *message_get_string_field (const char *message, size_t fields_end,
+		bool native, uint8_t wanted)
+{
+	size_t i = 16;
+	while ( i + 4 < fields_end )
+	{
+		const uint8_t code = (uint8_t)message[i];
+		const uint8_t signature_len = (uint8_t)message[i+1];
+		if ( signature_len != 1 )
+			return NULL;
+		const char type = message[i+2];
+		i += 4;
+
+		if ( type == 's' || type == 'o' )
+		{
+			i = (i + 3) & ~(size_t)3;
+			if ( i + 4 > fields_end )
+				return NULL;
+			const uint32_t len = unmarshal_uint32(message + i, native);
+			if ( i + 4 + len + 1 > fields_end || message[i+4+len] != '\0' )
+				return NULL;
+			if ( code == wanted )
+				return message + i + 4;
+			i += 4 + len + 1;
+		}
+		else if ( type == 'g' )
+			i += 2 + (size_t)(uint8_t)message[i];
+		else if ( type == 'u' )
+			i = ((i + 3) & ~(size_t)3) + 4;
+		else
+			return NULL;
+
+		i = (i + 7) & ~(size_t)7;
+	}
+	return NULL;
+}
+
+static void dbus_handle_message (const char *message, size_t fields_end, size_t body_start,
+		size_t body_len, bool native)
+{
+	if ( message[1] != DBUS_MESSAGE_ERROR )
+		return;
+
+	/* Errors usually explain themselves in their first argument. */
+	const char *name = message_get_string_field(message, fields_end, native,
+			DBUS_FIELD_ERROR_NAME);
+	const char *description = NULL;
+	if ( body_len > 4 )
+	{
+		const uint32_t len = unmarshal_uint32(message + body_start, native);
+		if ( 4 + (size_t)len + 1 <= body_len && message[body_start+4+len] == '\0' )
+			description = message + body_start + 4;
+	}
+	log_message(0, "ERROR: D-Bus call failed: %s: %s\n", str_orelse(name, "unknown error"),
+			str_orelse(description, "no description"));
+}
+
+/* Returns false if the connection must be closed. */
+static bool dbus_parse_input (void)
+{
+	/* The server answers the authentication with a line of text. */
+	if (! dbus_authenticated)
+	{
+		char *end = memchr(dbus_in.data, '\n', dbus_in.len);
+		if ( end == NULL )
+			return true;
+		if (! string_starts_with(dbus_in.data, "OK "))
+		{
+			log_message(0, "ERROR: D-Bus authentication failed.\n");
+			return false;
+		}
+		log_message(2, "[dbus] Authenticated.\n");
+		dbus_authenticated = true;
+		buffer_consume(&dbus_in, (size_t)(end - dbus_in.data) + 1);
+	}
+
+	while ( dbus_in.len >= 16 )
+	{
+		const bool native = dbus_in.data[0] == DBUS_NATIVE_ENDIAN;
+		const size_t body_len   = unmarshal_uint32(dbus_in.data + 4, native);
+		const size_t fields_len = unmarshal_uint32(dbus_in.data + 12, native);
+		const size_t body_start = (16 + fields_len + 7) & ~(size_t)7;
+		if ( fields_len > DBUS_MAX_MESSAGE_SIZE || body_len > DBUS_MAX_MESSAGE_SIZE )
+		{
+			log_message(0, "ERROR: Invalid D-Bus message.\n");
+			return false;
+		}
+		if ( dbus_in.len < body_start + body_len )
+			return true;
+
+		dbus_handle_message(dbus_in.data, 16 + fields_len, body_start, body_len, native);
+		buffer_consume(&dbus_in, body_start + body_len);
+	}
+	return true;
+}
+
+/****************
+ *              *
+ *  Connection  *
+ *              *
+ ****************/
+/* Decode the %-escapes of a D-Bus address value. */
+static bool unescape_address_value (char *dest, size_t size, const char *value, size_t len)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		if ( n + 1 >= size )
+			return false;
+		if ( value[i] == '%' && i + 2 < len
+				&& isxdigit((unsigned char)value[i+1]) && isxdigit((unsigned char)value[i+2]) )
+		{
+			const char hex[3] = { value[i+1], value[i+2], '\0' };
+			dest[n++] = (char)strtol(hex, NULL, 16);
+			i += 2;
+		}
+		else
+			dest[n++] = value[i];
+	}
+	dest[n] = '\0';
+	return true;
+}
+
+/* Try to connect to a single "unix:" address. */
+static int connect_address (const char *address, size_t len)
+{
+	if ( len < 5 || strncmp(address, "unix:", 5) )
+		return -1;
+
+	struct sockaddr_un sa = { .sun_family = AF_UNIX };
+	socklen_t sa_len = 0;
+	for (const char *key = address + 5; key < address + len; )
+	{
+		const char *end = memchr(key, ',', (size_t)(address + len - key));
+		if ( end == NULL )
+			end = address + len;
+
+		if (! strncmp(key, "path=", 5))
+		{
+			if (! unescape_address_value(sa.sun_path, sizeof(sa.sun_path),
+						key + 5, (size_t)(end - key - 5)))
+				return -1;
+			sa_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + strlen(sa.sun_path) + 1);
+		}
+		else if (! strncmp(key, "abstract=", 9))
+		{
+			/* Abstract socket names start with a null byte. */
+			if (! unescape_address_value(sa.sun_path + 1, sizeof(sa.sun_path) - 1,
+						key + 9, (size_t)(end - key - 9)))
+				return -1;
+			sa_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + strlen(sa.sun_path + 1));
+		}
+
+		key = end + 1;
+	}
+	if ( sa_len == 0 )
+		return -1;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if ( fd == -1 )
+		return -1;
+	if ( connect(fd, (struct sockaddr *)&sa, sa_len) == -1 )
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int connect_session_bus (void)
+{
+	/* Without an address, the bus is expected in the runtime directory. */
+	const char *address = getenv("DBUS_SESSION_BUS_ADDRESS");
+	char buffer[sizeof(((struct sockaddr_un *)NULL)->sun_path) + 16];
+	if ( address == NULL )
+	{
+		const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+		if ( runtime_dir == NULL )
+			return -1;
+		snprintf(buffer, sizeof(buffer), "unix:path=%s/bus", runtime_dir);
+		address = buffer;
+	}
+
+	/* The address may list alternatives, separated by semicolons. */
+	for (const char *entry = address; *entry != '\0'; )
+	{
+		const size_t len = strcspn(entry, ";");
+		const int fd = connect_address(entry, len);
+		if ( fd != -1 )
+			return fd;
+		entry += len;
+		if ( *entry == ';' )
+			entry++;
+	}
+	return -1;
+}
+
+/* Send the whole handshake at once, without waiting for the answers. */
+static bool dbus_authenticate (void)
+{
+	char uid[16];
+	snprintf(uid, sizeof(uid), "%u", (unsigned int)getuid());
+
+	char line[64] = "\0AUTH EXTERNAL ";
+	size_t len = 1 + strlen(line + 1);
+	for (char *ch = uid; *ch != '\0'; ch++)
+		len += (size_t)snprintf(line + len, sizeof(line) - len, "%02x", (unsigned char)*ch);
+	len += (size_t)snprintf(line + len, sizeof(line) - len, "\r\nBEGIN\r\n");
+	buffer_append(&dbus_out, line, len);
+
+	return dbus_call("org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+			"Hello", NULL, NULL);
+}
+
+static void dbus_disconnect (struct pollfd *fd)
+{
+	if ( dbus_fd != -1 )
+		close(dbus_fd);
+	dbus_fd            = -1;
+	dbus_authenticated = false;
+	fd->fd             = -1;
+	buffer_finish(&dbus_out);
+	buffer_finish(&dbus_in);
+}
+
+/*****************
+ *               *
+ *  Application  *
+ *               *
+ *****************/
+/* Bus names consist of at least two elements of letters, digits, underscores
+ * and hyphens, separated by dots, none of which may start with a digit.
+ */
+bool dbus_is_valid_name (const char *name)
+{
+	size_t elements = 0;
+	for (const char *ch = name; ; ch++)
+	{
+		if ( isdigit((unsigned char)*ch) )
+			return false;
+		const size_t len = strspn(ch, "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+				"abcdefghijklmnopqrstuvwxyz0123456789_-");
+		if ( len == 0 )
+			return false;
+		elements++;
+		ch += len;
+		if ( *ch == '\0' )
+			break;
+		if ( *ch != '.' )
+			return false;
+	}
+	return elements >= 2 && strlen(name) <= 255;
+}
+
+/* Send org.freedesktop.Application.Activate to the given application. The
+ * bus starts the application if it is not running yet.
+ */
+bool dbus_activate (const char *app_id, const char *activation_token)
+{
+	if ( dbus_fd == -1 )
+	{
+		log_message(0, "ERROR: Can not activate %s: Not connected to D-Bus.\n", app_id);
+		return false;
+	}
+
+	log_message(1, "[dbus] Activating: %s\n", app_id);
+
+	/* The object path is the application ID with dots replaced by slashes. */
+	char path[258] = "/";
+	for (size_t i = 0; app_id[i] != '\0' && i + 2 < sizeof(path); i++)
+		path[i+1] = app_id[i] == '.' ? '/' : app_id[i] == '-' ? '_' : app_id[i];
+
+	/* Platform data, a{sv}. */
+	struct Dbus_buffer body = { NULL, 0, 0, false };
+	marshal_uint32(&body, 0);
+	marshal_pad(&body, 8);
+	const size_t array_start = body.len;
+	if ( activation_token != NULL )
+	{
+		const char *keys[] = { "activation-token", "desktop-startup-id" };
+		FOR_ARRAY(keys, i)
+		{
+			marshal_pad(&body, 8);
+			marshal_string(&body, keys[i]);
+			marshal_signature(&body, "s");
+			marshal_string(&body, activation_token);
+		}
+	}
+	if (! body.failed)
+	{
+		const uint32_t array_len = (uint32_t)(body.len - array_start);
+		memcpy(body.data, &array_len, 4);
+	}
+
+	const bool ret = dbus_call(app_id, path, "org.freedesktop.Application", "Activate",
+			"a{sv}", &body);
+	buffer_finish(&body);
+	return ret;
+}
+
+/************************
+ *                      *
+ *  D-Bus event source  *
+ *                      *
+ ************************/
+static bool dbus_source_init (struct pollfd *fd)
+{
+	log_message(1, "[loop] Setting up D-Bus event source.\n");
+
+	fd->events = POLLIN;
+	if ( -1 == (fd->fd = dbus_fd = connect_session_bus()) )
+	{
+		/* Not fatal, only D-Bus activation will not work. */
+		log_message(0, "ERROR: Can not connect to the D-Bus session bus.\n");
+		return true;
+	}
+
+	if (! dbus_authenticate())
+		dbus_disconnect(fd);
+	return true;
+}
+
+static bool dbus_source_finish (struct pollfd *fd)
+{
+	dbus_disconnect(fd);
+	return true;
+}
+
+static bool dbus_source_flush (struct pollfd *fd)
+{
+	if ( dbus_fd == -1 )
+		return true;
+
+	while ( dbus_out.len > 0 )
+	{
+		const ssize_t ret = send(dbus_fd, dbus_out.data, dbus_out.len,
+				MSG_DONTWAIT | MSG_NOSIGNAL);
+		if ( ret == -1 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+			break;
+		if ( ret == -1 )
+		{
+			log_message(0, "ERROR: Lost connection to D-Bus: %s\n", strerror(errno));
+			dbus_disconnect(fd);
+			return true;
+		}
+		buffer_consume(&dbus_out, (size_t)ret);
+	}
+
+	/* Only wait for the socket to become writable if there is something to write. */
+	fd->events = dbus_out.len > 0 ? POLLIN | POLLOUT : POLLIN;
+	return true;
+}
+
+static bool dbus_source_handle_in (struct pollfd *fd)
+{
+	if ( dbus_fd == -1 )
+		return true;
+
+	for (;;)
+	{
+		if (! buffer_reserve(&dbus_in, 4096))
+		{
+			dbus_disconnect(fd);
+			return true;
+		}
+		const ssize_t ret = recv(dbus_fd, dbus_in.data + dbus_in.len,
+				dbus_in.size - dbus_in.len, MSG_DONTWAIT);
+		if ( ret == -1 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+			break;
+		if ( ret <= 0 )
+		{
+			log_message(0, "ERROR: Lost connection to D-Bus.\n");
+			dbus_disconnect(fd);
+			return true;
+		}
+		dbus_in.len += (size_t)ret;
+	}
+
+	if (! dbus_parse_input())
+		dbus_disconnect(fd);
+	return true;
+}
+
+static bool dbus_source_handle_out (struct pollfd *fd)
+{
+	return dbus_source_flush(fd);
+}
+
+struct Lava_event_source dbus_source = {
+	.init       = dbus_source_init,
+	.finish     = dbus_source_finish,
+	.flush      = dbus_source_flush,
+	.handle_in  = dbus_source_handle_in,
+	.handle_out = dbus_source_handle_out
+};
@@ -0,0 +1,33 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LAVALAUNCHER_DBUS_H
+#define LAVALAUNCHER_DBUS_H
+
+#include<stdbool.h>
+
+struct Lava_event_source;
+
+extern struct Lava_event_source dbus_source;
+
+bool dbus_is_valid_name (const char *name);
+bool dbus_activate (const char *app_id, const char *activation_token);
+
+#endif
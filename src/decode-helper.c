@@ -0,0 +1,867 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/* memfd_create() and file sealing are not part of POSIX. */
+#define _GNU_SOURCE
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<stddef.h>
+#include<unistd.h>
+#include<string.h>
+#include<limits.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<poll.h>
+#include<signal.h>
+#include<time.h>
+#include<pthread.h>
+#include<sys/mman.h>
+#include<sys/socket.h>
+#include<sys/stat.h>
+#include<sys/wait.h>
+#include<sys/resource.h>
+#include<cairo/cairo.h>
+
+#if HAS_SECCOMP
+#include<sys/prctl.h>
+#include<sys/syscall.h>
+#include<linux/audit.h>
+#include<linux/filter.h>
+#include<linux/seccomp.h>
+#endif
+
+#include"lavalauncher.h"
+#include"str.h"
+#include"decode-helper.h"
+#include"types/image_t.h"
+
+/* Images can optionally be decoded by helper processes. A helper is this very
+ * executable, started with DECODE_HELPER_ARGUMENT and the socket to the
+ * launcher as fd 3. Before it touches any image, it limits its own resources
+ * and, where seccomp is available, forbids itself to execute programs, open
+ * sockets or modify files. A crafted image crashing or hijacking a decoder
+ * therefore takes down only the helper.
+ *
+ * For every request, which holds the path of an image, the icon size and the
+ * largest output scale, the helper replies with the resolved path and a sealed
+ * memfd holding the premultiplied ARGB32 raster. The launcher maps the memfd
+ * privately and uses it as the data of the image surface, so the pixels are
+ * never copied. SVG images are rasterized at the icon size times the output
+ * scale, but at least at SVG_MIN_RASTER_SCALE, and are decoded again once an
+ * output with a larger scale appears.
+ *
+ * A helper not answering in time is killed, which fails only the image it was
+ * working on. Several helpers decode in parallel.
+ */
+
+#if HAS_MEMFD
+
+#define DECODE_HELPER_FD       3
+#define MAX_DECODE_HELPERS     4
+#define DECODE_QUEUE_DEPTH     2
+#define DECODE_TIMEOUT_MS      5000
+#define SVG_MIN_RASTER_SCALE   2
+#define MAX_RASTER_SIDE        8192
+#define HELPER_MEMORY_LIMIT    (1024UL * 1024UL * 1024UL)
+#define HELPER_CPU_LIMIT       120
+#define HELPER_FILE_LIMIT      64
+#define REQUIRED_SEALS         (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)
+
+enum
+{
+	JOB_PENDING,
+	JOB_RUNNING,
+	JOB_DONE
+};
+
+struct Decode_request
+{
+	uint32_t size, scale;
+	uint32_t path_length;
+};
+
+struct Decode_reply
+{
+	uint32_t success;
+	uint32_t width, height, stride;
+	uint32_t raster_scale;
+	uint32_t path_length;
+};
+
+struct Decode_helper
+{
+	pid_t pid;
+	int fd;
+
+	/* Indices of the jobs sent to the helper, oldest first. */
+	size_t queue[DECODE_QUEUE_DEPTH];
+	size_t queued;
+
+	/* When the oldest job times out. */
+	int64_t deadline;
+};
+
+/* A raster mapped from a memfd, unmapped when its surface is destroyed. */
+struct Lava_raster_mapping
+{
+	void *data;
+	size_t length;
+};
+
+static struct Decode_helper helpers[MAX_DECODE_HELPERS];
+static size_t helper_count = 0;
+
+/* The main thread only decodes before the event loop runs, afterwards all
+ * decoding happens on the reload worker. The main thread therefore never
+ * waits for a helper while the loop runs.
+ */
+static pthread_mutex_t helper_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t get_time_ms (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Send a fixed size header, followed by a path and optionally a file
+ * descriptor, as a single packet.
+ */
+static bool send_packet (int sock, void *header, size_t header_size,
+		const char *path, uint32_t path_length, int fd)
+{
+	struct iovec iov[2] = {
+		{ .iov_base = header,       .iov_len = header_size },
+		{ .iov_base = (char *)path, .iov_len = path_length }
+	};
+	union
+	{
+		char buffer[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg = {
+		.msg_iov    = iov,
+		.msg_iovlen = path_length > 0 ? 2 : 1
+	};
+
+	if ( fd != -1 )
+	{
+		memset(&control, 0, sizeof(control));
+		msg.msg_control    = control.buffer;
+		msg.msg_controllen = sizeof(control.buffer);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type  = SCM_RIGHTS;
+		cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	}
+
+	ssize_t ret;
+	do
+		ret = sendmsg(sock, &msg, MSG_NOSIGNAL);
+	while ( ret == -1 && errno == EINTR );
+	return ret == (ssize_t)(header_size + path_length);
+}
+
+/* Receive a packet sent by send_packet(). The path buffer must be able to
+ * hold PATH_MAX bytes. Returns the length of the path, or -1 on error or when
+ * the other side has closed the connection.
+ */
+static ssize_t receive_packet (int sock, void *header, size_t header_size,
+		char *path, int *fd)
+{
+	struct iovec iov[2] = {
+		{ .iov_base = header, .iov_len = header_size },
+		{ .iov_base = path,   .iov_len = PATH_MAX - 1 }
+	};
+	union
+	{
+		char buffer[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg = {
+		.msg_iov        = iov,
+		.msg_iovlen     = 2,
+		.msg_control    = control.buffer,
+		.msg_controllen = sizeof(control.buffer)
+	};
+
+	ssize_t ret;
+	do
+		ret = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	while ( ret == -1 && errno == EINTR );
+
+	if ( fd != NULL )
+		*fd = -1;
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if ( cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS )
+			continue;
+		int received;
+		memcpy(&received, CMSG_DATA(cmsg), sizeof(int));
+		if ( fd != NULL && *fd == -1 )
+			*fd = received;
+		else
+			close(received);
+	}
+
+	if ( ret < (ssize_t)header_size || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) )
+	{
+		if ( fd != NULL && *fd != -1 )
+		{
+			close(*fd);
+			*fd = -1;
+		}
+		return -1;
+	}
+
+	const ssize_t path_length = ret - (ssize_t)header_size;
+	path[path_length] = '\0';
+	return path_length;
+}
+
+/*******************
+ *                 *
+ *  Helper side    *
+ *                 *
+ *******************/
+static void limit_resources (void)
+{
+	struct
+	{
+		int resource;
+		rlim_t limit;
+	} limits[] = {
+		{ .resource = RLIMIT_AS,     .limit = HELPER_MEMORY_LIMIT },
+		{ .resource = RLIMIT_CPU,    .limit = HELPER_CPU_LIMIT    },
+		{ .resource = RLIMIT_NOFILE, .limit = HELPER_FILE_LIMIT   },
+		{ .resource = RLIMIT_CORE,   .limit = 0                   }
+	};
+
+	FOR_ARRAY(limits, i)
+	{
+		struct rlimit rlimit = { .rlim_cur = limits[i].limit, .rlim_max = limits[i].limit };
+		if ( setrlimit(limits[i].resource, &rlimit) == -1 )
+			log_message(0, "WARNING: Decode helper: setrlimit: %s\n", strerror(errno));
+	}
+}
+
+#if HAS_SECCOMP
+#if defined(__x86_64__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_X86_64
+#elif defined(__aarch64__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#endif
+
+#ifdef SECCOMP_RET_KILL_PROCESS
+#define SECCOMP_KILL SECCOMP_RET_KILL_PROCESS
+#else
+#define SECCOMP_KILL SECCOMP_RET_KILL
+#endif
+
+#define SECCOMP_DENY(NR) \
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, NR, 0, 1), \
+	BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | (EPERM & SECCOMP_RET_DATA))
+
+/* Deny opening a file for writing. The accumulator must hold the syscall
+ * number and still holds it if the syscall does not match.
+ */
+#define SECCOMP_DENY_WRITE_OPEN(NR, ARG) \
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, NR, 0, 4), \
+	BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, args[ARG])), \
+	BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, O_WRONLY | O_RDWR | O_CREAT | O_TRUNC, 0, 1), \
+	BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | (EPERM & SECCOMP_RET_DATA)), \
+	BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW)
+#endif
+
+/* Decoders use threads, mmap and plenty of other syscalls, so instead of an
+ * allow list that breaks with every library update, only what a decoder
+ * never legitimately does is denied.
+ */
+static void install_seccomp_filter (void)
+{
+#if HAS_SECCOMP && defined(SECCOMP_AUDIT_ARCH)
+	struct sock_filter filter[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SECCOMP_AUDIT_ARCH, 1, 0),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_KILL),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+#if defined(__x86_64__)
+		/* No x32 syscalls. */
+		BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 0x40000000, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_KILL),
+#endif
+
+		SECCOMP_DENY(__NR_execve),
+		SECCOMP_DENY(__NR_execveat),
+		SECCOMP_DENY(__NR_ptrace),
+		SECCOMP_DENY(__NR_process_vm_readv),
+		SECCOMP_DENY(__NR_process_vm_writev),
+		SECCOMP_DENY(__NR_socket),
+		SECCOMP_DENY(__NR_connect),
+		SECCOMP_DENY(__NR_bind),
+		SECCOMP_DENY(__NR_listen),
+		SECCOMP_DENY(__NR_accept),
+		SECCOMP_DENY(__NR_accept4),
+		SECCOMP_DENY(__NR_unlinkat),
+		SECCOMP_DENY(__NR_renameat),
+		SECCOMP_DENY(__NR_mkdirat),
+		SECCOMP_DENY(__NR_linkat),
+		SECCOMP_DENY(__NR_symlinkat),
+		SECCOMP_DENY(__NR_fchmodat),
+		SECCOMP_DENY(__NR_fchownat),
+		SECCOMP_DENY(__NR_truncate),
+		SECCOMP_DENY(__NR_mount),
+		SECCOMP_DENY(__NR_open_by_handle_at),
+#ifdef __NR_renameat2
+		SECCOMP_DENY(__NR_renameat2),
+#endif
+#ifdef __NR_openat2
+		/* The flags are behind a pointer; The C library falls back to openat. */
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_openat2, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | (ENOSYS & SECCOMP_RET_DATA)),
+#endif
+#if defined(__x86_64__)
+		SECCOMP_DENY(__NR_fork),
+		SECCOMP_DENY(__NR_vfork),
+		SECCOMP_DENY(__NR_unlink),
+		SECCOMP_DENY(__NR_rename),
+		SECCOMP_DENY(__NR_mkdir),
+		SECCOMP_DENY(__NR_rmdir),
+		SECCOMP_DENY(__NR_link),
+		SECCOMP_DENY(__NR_symlink),
+		SECCOMP_DENY(__NR_chmod),
+		SECCOMP_DENY(__NR_chown),
+		SECCOMP_DENY(__NR_lchown),
+		SECCOMP_DENY(__NR_creat),
+		SECCOMP_DENY_WRITE_OPEN(__NR_open, 1),
+#endif
+		SECCOMP_DENY_WRITE_OPEN(__NR_openat, 2),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW)
+	};
+	struct sock_fprog program = {
+		.len    = (unsigned short)(sizeof(filter) / sizeof(filter[0])),
+		.filter = filter
+	};
+
+	if ( prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1 )
+		log_message(0, "WARNING: Decode helper: Can not set no_new_privs: %s\n", strerror(errno));
+	else if ( prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == -1 )
+		log_message(0, "WARNING: Decode helper: Can not install seccomp filter: %s\n", strerror(errno));
+#else
+	log_message(1, "[decode-helper] No seccomp filter available, only limiting resources.\n");
+#endif
+}
+
+/* Draw the image into a sealed memfd. Returns the memfd or -1 on error. */
+static int rasterize_image (image_t *image, uint32_t size, uint32_t scale,
+		struct Decode_reply *reply)
+{
+	int width, height;
+	if ( image->cairo_surface != NULL )
+	{
+		width  = cairo_image_surface_get_width(image->cairo_surface);
+		height = cairo_image_surface_get_height(image->cairo_surface);
+		reply->raster_scale = 0;
+	}
+	else
+	{
+		if ( scale < SVG_MIN_RASTER_SCALE )
+			scale = SVG_MIN_RASTER_SCALE;
+		const uint64_t side = (uint64_t)size * scale;
+		width = height = side > MAX_RASTER_SIDE ? -1 : (int)side;
+		reply->raster_scale = scale;
+	}
+	if ( width <= 0 || height <= 0 || width > MAX_RASTER_SIDE || height > MAX_RASTER_SIDE )
+	{
+		log_message(0, "ERROR: Decode helper: Bad image dimensions: %dx%d\n", width, height);
+		return -1;
+	}
+
+	const int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
+	const size_t length = (size_t)stride * (size_t)height;
+
+	int memfd = memfd_create("lavalauncher-image", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if ( memfd == -1 )
+	{
+		log_message(0, "ERROR: Decode helper: memfd_create: %s\n", strerror(errno));
+		return -1;
+	}
+	if ( ftruncate(memfd, (off_t)length) == -1 )
+	{
+		log_message(0, "ERROR: Decode helper: ftruncate: %s\n", strerror(errno));
+		goto error;
+	}
+
+	void *data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	if ( data == MAP_FAILED )
+	{
+		log_message(0, "ERROR: Decode helper: mmap: %s\n", strerror(errno));
+		goto error;
+	}
+
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(data,
+			CAIRO_FORMAT_ARGB32, width, height, stride);
+	cairo_t *cairo = cairo_create(surface);
+	image_t_draw_to_cairo(cairo, image, 0, 0, (uint32_t)width, (uint32_t)height);
+	cairo_destroy(cairo);
+	cairo_surface_flush(surface);
+	const bool drawn = cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS;
+	cairo_surface_destroy(surface);
+
+	/* Writes can only be sealed once there are no shared mappings left. */
+	munmap(data, length);
+	if (! drawn)
+	{
+		log_message(0, "ERROR: Decode helper: Can not draw image.\n");
+		goto error;
+	}
+	if ( fcntl(memfd, F_ADD_SEALS, REQUIRED_SEALS) == -1 )
+	{
+		log_message(0, "ERROR: Decode helper: Can not seal memfd: %s\n", strerror(errno));
+		goto error;
+	}
+
+	reply->width  = (uint32_t)width;
+	reply->height = (uint32_t)height;
+	reply->stride = (uint32_t)stride;
+	return memfd;
+
+error:
+	close(memfd);
+	return -1;
+}
+
+int decode_helper_main (void)
+{
+	limit_resources();
+	install_seccomp_filter();
+
+	static char path[PATH_MAX];
+	struct Decode_request request;
+	for (ssize_t length; (length = receive_packet(DECODE_HELPER_FD,
+					&request, sizeof(request), path, NULL)) != -1 ;)
+	{
+		if ( length == 0 || request.path_length != (uint32_t)length )
+			return EXIT_FAILURE;
+
+		struct Decode_reply reply = { .success = 0 };
+		int memfd = -1;
+		errno = 0;
+		image_t *image = image_t_create_from_file(path, request.size);
+		if ( image != NULL )
+		{
+			if ( -1 != (memfd = rasterize_image(image, request.size, request.scale, &reply)) )
+			{
+				reply.success     = 1;
+				reply.path_length = (uint32_t)strlen(image->path);
+			}
+		}
+
+		const bool sent = send_packet(DECODE_HELPER_FD, &reply, sizeof(reply),
+				reply.success ? image->path : NULL, reply.path_length, memfd);
+		if ( memfd != -1 )
+			close(memfd);
+		DESTROY(image, image_t_destroy);
+		if (! sent)
+			return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*******************
+ *                 *
+ *  Launcher side  *
+ *                 *
+ *******************/
+static bool start_helper (struct Decode_helper *helper)
+{
+	/* Only async-signal-safe functions may be used between fork() and
+	 * exec(), as other threads may hold locks, so prepare everything
+	 * beforehand.
+	 */
+	char *const argv[] = { "lavalauncher", DECODE_HELPER_ARGUMENT, NULL };
+	long max_fd = sysconf(_SC_OPEN_MAX);
+	if ( max_fd < 0 || max_fd > 4096 )
+		max_fd = 4096;
+	sigset_t mask;
+	sigemptyset(&mask);
+
+	int sv[2];
+	if ( socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1 )
+	{
+		log_message(0, "ERROR: socketpair: %s\n", strerror(errno));
+		return false;
+	}
+
+	errno = 0;
+	pid_t pid = fork();
+	if ( pid == 0 )
+	{
+		/* dup2() clears close-on-exec, except when the fds are equal. */
+		if ( sv[1] == DECODE_HELPER_FD )
+			fcntl(sv[1], F_SETFD, 0);
+		else if ( dup2(sv[1], DECODE_HELPER_FD) == -1 )
+			_exit(EXIT_FAILURE);
+
+		/* Not all our fds are close-on-exec. */
+		for (int fd = DECODE_HELPER_FD + 1; fd < (int)max_fd; fd++)
+			close(fd);
+		sigprocmask(SIG_SETMASK, &mask, NULL);
+
+		execv("/proc/self/exe", argv);
+		_exit(EXIT_FAILURE);
+	}
+	close(sv[1]);
+	if ( pid < 0 )
+	{
+		log_message(0, "ERROR: fork: %s\n", strerror(errno));
+		close(sv[0]);
+		return false;
+	}
+
+	log_message(1, "[decode-helper] Started decode helper: pid=%d\n", (int)pid);
+	helper->pid    = pid;
+	helper->fd     = sv[0];
+	helper->queued = 0;
+	return true;
+}
+
+static void stop_helper (struct Decode_helper *helper, bool kill_helper)
+{
+	if ( helper->pid == -1 )
+		return;
+	if (kill_helper)
+		kill(helper->pid, SIGKILL);
+
+	/* Without a connection, an idle helper exits right away. */
+	close(helper->fd);
+	waitpid(helper->pid, NULL, 0);
+	helper->pid = -1;
+	helper->fd  = -1;
+}
+
+static bool start_helpers (void)
+{
+	if ( helper_count > 0 )
+		return true;
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if ( cpus < 1 )
+		cpus = 1;
+	else if ( cpus > MAX_DECODE_HELPERS )
+		cpus = MAX_DECODE_HELPERS;
+
+	for (size_t i = 0; i < (size_t)cpus; i++)
+	{
+		if (! start_helper(&helpers[i]))
+			break;
+		helper_count++;
+	}
+
+	return helper_count > 0;
+}
+
+/* Helpers which died are restarted before the next request. */
+static bool ensure_helper (struct Decode_helper *helper)
+{
+	if ( helper->pid != -1 )
+		return true;
+	return start_helper(helper);
+}
+
+static const cairo_user_data_key_t raster_mapping_key;
+
+static void destroy_raster_mapping (void *data)
+{
+	struct Lava_raster_mapping *mapping = (struct Lava_raster_mapping *)data;
+	munmap(mapping->data, mapping->length);
+	free(mapping);
+}
+
+/* Map the raster the helper has sent. */
+static cairo_surface_t *surface_from_memfd (int memfd, struct Decode_reply *reply)
+{
+	if ( reply->width == 0 || reply->height == 0
+			|| reply->width > MAX_RASTER_SIDE || reply->height > MAX_RASTER_SIDE
+			|| reply->stride != (uint32_t)cairo_format_stride_for_width(
+				CAIRO_FORMAT_ARGB32, (int)reply->width) )
+	{
+		log_message(0, "ERROR: Decode helper sent bad image dimensions.\n");
+		return NULL;
+	}
+
+	/* Without these seals the helper could still change or shrink the file,
+	 * the latter of which would crash us when accessing the mapping.
+	 */
+	const size_t length = (size_t)reply->stride * reply->height;
+	struct stat stat;
+	const int seals = fcntl(memfd, F_GET_SEALS);
+	if ( seals == -1 || (seals & REQUIRED_SEALS) != REQUIRED_SEALS
+			|| fstat(memfd, &stat) == -1 || (size_t)stat.st_size < length )
+	{
+		log_message(0, "ERROR: Decode helper sent an unsealed or too small memfd.\n");
+		return NULL;
+	}
+
+	/* A private mapping is writable for cairo, despite the write seal. */
+	void *data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, memfd, 0);
+	if ( data == MAP_FAILED )
+	{
+		log_message(0, "ERROR: mmap: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	struct Lava_raster_mapping *mapping = malloc(sizeof(struct Lava_raster_mapping));
+	if ( mapping == NULL )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		munmap(data, length);
+		return NULL;
+	}
+	mapping->data   = data;
+	mapping->length = length;
+
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(data,
+			CAIRO_FORMAT_ARGB32, (int)reply->width, (int)reply->height,
+			(int)reply->stride);
+	if ( cairo_surface_set_user_data(surface, &raster_mapping_key, mapping,
+				destroy_raster_mapping) != CAIRO_STATUS_SUCCESS )
+	{
+		cairo_surface_destroy(surface);
+		destroy_raster_mapping(mapping);
+		return NULL;
+	}
+	return surface;
+}
+
+/* The oldest job of a failed helper is blamed, the others are retried. */
+static void helper_failed (struct Decode_helper *helper, struct Lava_decode_job *jobs,
+		size_t *next)
+{
+	stop_helper(helper, true);
+	for (size_t i = 0; i < helper->queued; i++)
+	{
+		const size_t index = helper->queue[i];
+		if ( i == 0 )
+			jobs[index].state = JOB_DONE;
+		else
+		{
+			jobs[index].state = JOB_PENDING;
+			if ( index < *next )
+				*next = index;
+		}
+	}
+	helper->queued = 0;
+}
+
+static void submit_jobs (struct Lava_decode_job *jobs, size_t count, size_t *next)
+{
+	for (size_t i = 0; i < helper_count; i++)
+	{
+		struct Decode_helper *helper = &helpers[i];
+		while ( helper->queued < DECODE_QUEUE_DEPTH )
+		{
+			while ( *next < count && jobs[*next].state != JOB_PENDING )
+				(*next)++;
+			if ( *next == count )
+				return;
+			if (! ensure_helper(helper))
+				break;
+
+			struct Lava_decode_job *job = &jobs[*next];
+			const size_t path_length = strlen(job->path);
+			if ( path_length == 0 || path_length >= PATH_MAX )
+			{
+				log_message(0, "ERROR: Bad image path: %s\n", job->path);
+				job->state = JOB_DONE;
+				continue;
+			}
+
+			if ( helper->queued == 0 )
+				helper->deadline = get_time_ms() + DECODE_TIMEOUT_MS;
+			helper->queue[helper->queued++] = *next;
+			job->state = JOB_RUNNING;
+
+			struct Decode_request request = {
+				.size        = job->size,
+				.scale       = job->scale,
+				.path_length = (uint32_t)path_length
+			};
+			if (! send_packet(helper->fd, &request, sizeof(request),
+						job->path, request.path_length, -1))
+			{
+				log_message(0, "ERROR: Can not send request to decode helper: %s\n",
+						strerror(errno));
+				helper_failed(helper, jobs, next);
+				break;
+			}
+		}
+	}
+}
+
+static void receive_reply (struct Decode_helper *helper, struct Lava_decode_job *jobs,
+		size_t *next)
+{
+	static char path[PATH_MAX];
+	struct Decode_reply reply;
+	int memfd;
+	const ssize_t length = receive_packet(helper->fd, &reply, sizeof(reply), path, &memfd);
+	if ( length == -1 )
+	{
+		log_message(0, "ERROR: Decode helper %d died while decoding %s\n",
+				(int)helper->pid, jobs[helper->queue[0]].path);
+		helper_failed(helper, jobs, next);
+		return;
+	}
+
+	struct Lava_decode_job *job = &jobs[helper->queue[0]];
+	job->state = JOB_DONE;
+	helper->queued--;
+	memmove(&helper->queue[0], &helper->queue[1], helper->queued * sizeof(size_t));
+	helper->deadline = get_time_ms() + DECODE_TIMEOUT_MS;
+
+	/* The helper has already logged why it failed. */
+	if ( reply.success && memfd != -1 && reply.path_length == (uint32_t)length
+			&& NULL != (job->surface = surface_from_memfd(memfd, &reply)) )
+	{
+		job->raster_scale = reply.raster_scale;
+		set_string(&job->resolved_path, path);
+		if ( job->resolved_path == NULL )
+		{
+			cairo_surface_destroy(job->surface);
+			job->surface = NULL;
+		}
+	}
+
+	if ( memfd != -1 )
+		close(memfd);
+}
+
+/* Decode the images of the jobs with the decode helpers. Jobs which failed
+ * have no surface.
+ */
+void decode_images_sandboxed (struct Lava_decode_job *jobs, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		jobs[i].surface       = NULL;
+		jobs[i].resolved_path = NULL;
+		jobs[i].raster_scale  = 0;
+		jobs[i].state         = JOB_PENDING;
+	}
+
+	pthread_mutex_lock(&helper_mutex);
+	if (! start_helpers())
+	{
+		log_message(0, "ERROR: Can not start decode helpers.\n");
+		goto exit;
+	}
+
+	for (size_t next = 0;;)
+	{
+		submit_jobs(jobs, count, &next);
+
+		struct pollfd fds[MAX_DECODE_HELPERS];
+		struct Decode_helper *polled[MAX_DECODE_HELPERS];
+		nfds_t nfds = 0;
+		int64_t deadline = INT64_MAX;
+		for (size_t i = 0; i < helper_count; i++) if ( helpers[i].queued > 0 )
+		{
+			fds[nfds].fd      = helpers[i].fd;
+			fds[nfds].events  = POLLIN;
+			fds[nfds].revents = 0;
+			polled[nfds++]    = &helpers[i];
+			if ( helpers[i].deadline < deadline )
+				deadline = helpers[i].deadline;
+		}
+
+		/* Nothing in flight means that either everything has been
+		 * decoded or no helper can be started.
+		 */
+		if ( nfds == 0 )
+			break;
+
+		int64_t timeout = deadline - get_time_ms();
+		if ( timeout < 0 )
+			timeout = 0;
+		if ( poll(fds, nfds, (int)timeout) == -1 && errno != EINTR )
+		{
+			log_message(0, "ERROR: poll: %s\n", strerror(errno));
+			for (nfds_t i = 0; i < nfds; i++)
+				helper_failed(polled[i], jobs, &next);
+			break;
+		}
+
+		for (nfds_t i = 0; i < nfds; i++)
+			if ( fds[i].revents != 0 )
+				receive_reply(polled[i], jobs, &next);
+
+		const int64_t now = get_time_ms();
+		for (nfds_t i = 0; i < nfds; i++)
+			if ( polled[i]->queued > 0 && polled[i]->deadline <= now )
+			{
+				log_message(0, "ERROR: Decoding timed out: %s\n",
+						jobs[polled[i]->queue[0]].path);
+				helper_failed(polled[i], jobs, &next);
+			}
+	}
+
+exit:
+	pthread_mutex_unlock(&helper_mutex);
+}
+
+void stop_decode_helpers (void)
+{
+	pthread_mutex_lock(&helper_mutex);
+	for (size_t i = 0; i < helper_count; i++)
+		stop_helper(&helpers[i], false);
+	helper_count = 0;
+	pthread_mutex_unlock(&helper_mutex);
+}
+
+#else
+
+int decode_helper_main (void)
+{
+	log_message(0, "ERROR: LavaLauncher has been compiled without decode helpers.\n");
+	return EXIT_FAILURE;
+}
+
+void decode_images_sandboxed (struct Lava_decode_job *jobs, size_t count)
+{
+	log_message(0, "ERROR: LavaLauncher has been compiled without decode helpers.\n");
+	for (size_t i = 0; i < count; i++)
+	{
+		jobs[i].surface       = NULL;
+		jobs[i].resolved_path = NULL;
+		jobs[i].raster_scale  = 0;
+	}
+}
+
+void stop_decode_helpers (void)
+{
+}
+
+#endif
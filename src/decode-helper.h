@@ -0,0 +1,52 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LAVALAUNCHER_DECODE_HELPER_H
+#define LAVALAUNCHER_DECODE_HELPER_H
+
+#include<stdint.h>
+#include<stdbool.h>
+#include<cairo/cairo.h>
+
+/* Argument with which LavaLauncher executes itself as a decode helper. */
+#define DECODE_HELPER_ARGUMENT "--decode-helper"
+
+struct Lava_decode_job
+{
+	/* Set by the caller. The scale is the largest one of all outputs. */
+	const char *path;
+	uint32_t size, scale;
+
+	/* Set on success. Vector images report the scale they have been
+	 * rasterized at, all others 0.
+	 */
+	cairo_surface_t *surface;
+	char *resolved_path;
+	uint32_t raster_scale;
+
+	/* Used internally. */
+	int state;
+};
+
+int decode_helper_main (void);
+void decode_images_sandboxed (struct Lava_decode_job *jobs, size_t count);
+void stop_decode_helpers (void);
+
+#endif
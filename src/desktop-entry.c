@@ -0,0 +1,651 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/* A small index of the desktop entries in $XDG_DATA_HOME/applications and
+ * $XDG_DATA_DIRS/applications. Scanning and parsing all desktop entries is
+ * comparatively slow, so the index is stored in the cache directory and only
+ * rebuilt when the modification time of one of the scanned directories or of
+ * one of the parsed desktop files has changed. Files edited in place do not
+ * change the modification time of their directory.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<string.h>
+#include<errno.h>
+#include<dirent.h>
+#include<sys/stat.h>
+
+#if WATCH_CONFIG
+#include<sys/inotify.h>
+#endif
+
+#include"lavalauncher.h"
+#include"str.h"
+#include"cache.h"
+#include"desktop-entry.h"
+
+#define INDEX_HEADER "LavaLauncher desktop entry index 2"
+
+/* A scanned directory or a parsed desktop file. */
+struct Lava_desktop_path
+{
+	struct wl_list link;
+	char *path;
+	struct timespec mtime;
+};
+
+static struct
+{
+	bool loaded;
+	char *search_path;
+	struct wl_list entries;
+	struct wl_list directories;
+	struct wl_list files;
+} index_data = { .loaded = false };
+
+/*************
+ *           *
+ *  Helpers  *
+ *           *
+ *************/
+static char *strdup_or_null (const char *str)
+{
+	if ( str == NULL || *str == '\0' )
+		return NULL;
+	return strdup(str);
+}
+
+/* Tabs and newlines separate the fields of the index, so they can not be
+ * part of a value. Nothing in the fields we use needs them anyway.
+ */
+static void sanitize (char *str)
+{
+	if ( str == NULL )
+		return;
+	for (; *str != '\0'; str++)
+		if ( *str == '\t' || *str == '\n' || *str == '\r' )
+			*str = ' ';
+}
+
+static struct Lava_desktop_entry *find_entry (const char *id)
+{
+	struct Lava_desktop_entry *entry;
+	wl_list_for_each(entry, &index_data.entries, link)
+		if (! strcmp(entry->id, id))
+			return entry;
+	return NULL;
+}
+
+static struct Lava_desktop_entry *add_entry (const char *id, const char *name,
+		const char *icon, const char *exec, bool hidden)
+{
+	TRY_NEW(struct Lava_desktop_entry, entry, NULL);
+	if ( NULL == (entry->id = strdup(id)) )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		free(entry);
+		return NULL;
+	}
+	entry->name   = strdup_or_null(name);
+	entry->icon   = strdup_or_null(icon);
+	entry->exec   = strdup_or_null(exec);
+	entry->hidden = hidden;
+	sanitize(entry->name);
+	sanitize(entry->icon);
+	sanitize(entry->exec);
+	wl_list_insert(index_data.entries.prev, &entry->link);
+	return entry;
+}
+
+static void destroy_entry (struct Lava_desktop_entry *entry)
+{
+	wl_list_remove(&entry->link);
+	free_if_set(entry->id);
+	free_if_set(entry->name);
+	free_if_set(entry->icon);
+	free_if_set(entry->exec);
+	free(entry);
+}
+
+static bool add_path (struct wl_list *list, const char *path, struct timespec mtime)
+{
+	TRY_NEW(struct Lava_desktop_path, dir, false);
+	if ( NULL == (dir->path = strdup(path)) )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		free(dir);
+		return false;
+	}
+	dir->mtime = mtime;
+	wl_list_insert(list->prev, &dir->link);
+	return true;
+}
+
+static void destroy_path (struct Lava_desktop_path *dir)
+{
+	wl_list_remove(&dir->link);
+	free_if_set(dir->path);
+	free(dir);
+}
+
+static void clear_index (void)
+{
+	struct Lava_desktop_entry *entry, *etmp;
+	wl_list_for_each_safe(entry, etmp, &index_data.entries, link)
+		destroy_entry(entry);
+	struct Lava_desktop_path *dir, *dtmp;
+	wl_list_for_each_safe(dir, dtmp, &index_data.directories, link)
+		destroy_path(dir);
+	wl_list_for_each_safe(dir, dtmp, &index_data.files, link)
+		destroy_path(dir);
+}
+
+static struct timespec get_mtime (const char *path)
+{
+	struct stat st;
+	if ( stat(path, &st) != 0 )
+		return (struct timespec){ .tv_sec = 0, .tv_nsec = 0 };
+	return st.st_mtim;
+}
+
+/* Returns the colon separated list of the application directories, in
+ * order of precedence.
+ */
+static char *get_search_path (void)
+{
+	const char *data_home = getenv("XDG_DATA_HOME");
+	const char *data_dirs = getenv("XDG_DATA_DIRS");
+	const char *home      = getenv("HOME");
+
+	char *home_dir;
+	if ( data_home != NULL && *data_home != '\0' )
+		home_dir = get_formatted_buffer("%s/applications", data_home);
+	else if ( home != NULL )
+		home_dir = get_formatted_buffer("%s/.local/share/applications", home);
+	else
+		home_dir = get_formatted_buffer("");
+	if ( home_dir == NULL )
+		return NULL;
+
+	if ( data_dirs == NULL || *data_dirs == '\0' )
+		data_dirs = "/usr/local/share:/usr/share";
+
+	/* Every directory of XDG_DATA_DIRS gets "/applications" appended. */
+	size_t len = strlen(home_dir) + 1;
+	for (const char *p = data_dirs; *p != '\0'; p++)
+		len += ( *p == ':' ) ? strlen("/applications:") : 1;
+	len += strlen("/applications") + 1;
+
+	char *path = calloc(1, len);
+	if ( path == NULL )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		free(home_dir);
+		return NULL;
+	}
+
+	strcat(path, home_dir);
+	free(home_dir);
+	for (const char *start = data_dirs, *end; *start != '\0'; start = end)
+	{
+		end = strchr(start, ':');
+		if ( end == NULL )
+			end = start + strlen(start);
+		if ( end != start )
+		{
+			strcat(path, ":");
+			strncat(path, start, (size_t)(end - start));
+			strcat(path, "/applications");
+		}
+		if ( *end == ':' )
+			end++;
+	}
+
+	return path;
+}
+
+/*********************
+ *                   *
+ *  Desktop entries  *
+ *                   *
+ *********************/
+/* Resolve the escape sequences of string values. */
+static void unescape_value (char *str)
+{
+	char *out = str;
+	for (char *in = str; *in != '\0'; in++)
+	{
+		if ( *in == '\\' && in[1] != '\0' )
+		{
+			in++;
+			switch (*in)
+			{
+				case 's':  *out++ = ' ';  break;
+				case 'n':  *out++ = ' ';  break;
+				case 't':  *out++ = ' ';  break;
+				case 'r':  *out++ = ' ';  break;
+				case '\\': *out++ = '\\'; break;
+				default:   *out++ = '\\'; *out++ = *in; break;
+			}
+		}
+		else
+			*out++ = *in;
+	}
+	*out = '\0';
+}
+
+/* Remove the field codes from the Exec key. LavaLauncher never passes files
+ * or URLs to the application, so they can all simply be dropped.
+ */
+static void remove_field_codes (char *str)
+{
+	char *out = str;
+	for (char *in = str; *in != '\0'; in++)
+	{
+		if ( *in != '%' )
+		{
+			*out++ = *in;
+			continue;
+		}
+
+		if ( in[1] == '\0' )
+			break;
+		in++;
+		if ( *in == '%' )
+			*out++ = '%';
+	}
+	*out = '\0';
+}
+
+static char *trim (char *str)
+{
+	while ( *str == ' ' || *str == '\t' )
+		str++;
+	char *end = str + strlen(str);
+	while ( end > str && ( end[-1] == ' ' || end[-1] == '\t'
+				|| end[-1] == '\n' || end[-1] == '\r' ) )
+		end--;
+	*end = '\0';
+	return str;
+}
+
+static void parse_desktop_file (const char *path, const char *id, struct timespec mtime)
+{
+	if (! add_path(&index_data.files, path, mtime))
+		return;
+
+	FILE *file;
+	if ( NULL == (file = fopen(path, "r")) )
+	{
+		log_message(2, "[desktop-entry] Can not open %s: %s\n", path, strerror(errno));
+		return;
+	}
+
+	char *name = NULL, *icon = NULL, *exec = NULL;
+	bool in_main_group = false, hidden = false, application = false;
+
+	char *line = NULL;
+	size_t size = 0;
+	while ( getline(&line, &size, file) != -1 )
+	{
+		char *str = trim(line);
+		if ( *str == '#' || *str == '\0' )
+			continue;
+
+		if ( *str == '[' )
+		{
+			/* Only the main group is of interest and it comes first. */
+			if (in_main_group)
+				break;
+			in_main_group = ! strcmp(str, "[Desktop Entry]");
+			continue;
+		}
+		if (! in_main_group)
+			continue;
+
+		char *equals = strchr(str, '=');
+		if ( equals == NULL )
+			continue;
+		*equals = '\0';
+		char *key   = trim(str);
+		char *value = trim(equals + 1);
+
+		if (! strcmp(key, "Name"))
+			set_string(&name, value);
+		else if (! strcmp(key, "Icon"))
+			set_string(&icon, value);
+		else if (! strcmp(key, "Exec"))
+			set_string(&exec, value);
+		else if (! strcmp(key, "Type"))
+			application = ! strcmp(value, "Application");
+		else if (! strcmp(key, "Hidden"))
+			hidden = ! strcmp(value, "true");
+	}
+	free_if_set(line);
+	fclose(file);
+
+	if ( name != NULL )
+		unescape_value(name);
+	if ( icon != NULL )
+		unescape_value(icon);
+	if ( exec != NULL )
+	{
+		unescape_value(exec);
+		remove_field_codes(exec);
+	}
+
+	/* Entries which are not applications can not be launched. */
+	if (! application)
+		hidden = true;
+
+	add_entry(id, name, icon, exec, hidden);
+
+	free_if_set(name);
+	free_if_set(icon);
+	free_if_set(exec);
+}
+
+/* Sub-directories are part of the desktop file ID, with "/" replaced by "-". */
+static void scan_directory (const char *path, const char *prefix)
+{
+	if (! add_path(&index_data.directories, path, get_mtime(path)))
+		return;
+
+	DIR *dir;
+	if ( NULL == (dir = opendir(path)) )
+		return;
+
+	log_message(2, "[desktop-entry] Scanning %s\n", path);
+
+	struct dirent *dirent;
+	while ( NULL != (dirent = readdir(dir)) )
+	{
+		const char *name = dirent->d_name;
+		if ( name[0] == '.' )
+			continue;
+
+		char *file_path = get_formatted_buffer("%s/%s", path, name);
+		if ( file_path == NULL )
+			continue;
+
+		struct stat st;
+		if ( stat(file_path, &st) != 0 )
+		{
+			free(file_path);
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode))
+		{
+			char *sub_prefix = get_formatted_buffer("%s%s-", prefix, name);
+			if ( sub_prefix != NULL )
+				scan_directory(file_path, sub_prefix);
+			free_if_set(sub_prefix);
+		}
+		else if ( S_ISREG(st.st_mode) && strlen(name) > strlen(".desktop")
+				&& ! strcmp(name + strlen(name) - strlen(".desktop"), ".desktop") )
+		{
+			char *id = get_formatted_buffer("%s%.*s", prefix,
+					(int)(strlen(name) - strlen(".desktop")), name);
+
+			/* Directories are scanned in order of precedence. */
+			if ( id != NULL && find_entry(id) == NULL )
+				parse_desktop_file(file_path, id, st.st_mtim);
+			free_if_set(id);
+		}
+
+		free(file_path);
+	}
+
+	closedir(dir);
+}
+
+static void scan_all_directories (void)
+{
+	char *search_path = strdup(index_data.search_path);
+	if ( search_path == NULL )
+		return;
+	for (char *start = search_path, *end; start != NULL; start = end)
+	{
+		end = strchr(start, ':');
+		if ( end != NULL )
+			*end++ = '\0';
+		if ( *start != '\0' )
+			scan_directory(start, "");
+	}
+	free(search_path);
+}
+
+/***********
+ *         *
+ *  Index  *
+ *         *
+ ***********/
+/* Split off the next tab separated field of the line. */
+static char *next_field (char **line)
+{
+	char *field = *line;
+	if ( field == NULL )
+		return NULL;
+	char *tab = strchr(field, '\t');
+	if ( tab != NULL )
+		*tab++ = '\0';
+	*line = tab;
+	return field;
+}
+
+static bool read_index (const char *path)
+{
+	FILE *file;
+	if ( NULL == (file = fopen(path, "r")) )
+		return false;
+
+	bool ret = false, header = false, search_path = false;
+	char *line = NULL;
+	size_t size = 0;
+	while ( getline(&line, &size, file) != -1 )
+	{
+		line[strcspn(line, "\n")] = '\0';
+
+		if (! header)
+		{
+			if (strcmp(line, INDEX_HEADER))
+				goto exit;
+			header = true;
+			continue;
+		}
+
+		char *rest = line;
+		char *type = next_field(&rest);
+		if (! strcmp(type, "P"))
+		{
+			/* The index is only valid for the same directories. */
+			if ( rest == NULL || strcmp(rest, index_data.search_path) )
+				goto exit;
+			search_path = true;
+		}
+		else if ( ! strcmp(type, "D") || ! strcmp(type, "F") )
+		{
+			char *sec  = next_field(&rest);
+			char *nsec = next_field(&rest);
+			if ( sec == NULL || nsec == NULL || rest == NULL )
+				goto exit;
+			struct timespec recorded = {
+				.tv_sec  = (time_t)strtoll(sec, NULL, 10),
+				.tv_nsec = strtol(nsec, NULL, 10)
+			};
+			struct timespec current = get_mtime(rest);
+			if ( recorded.tv_sec != current.tv_sec || recorded.tv_nsec != current.tv_nsec )
+			{
+				log_message(1, "[desktop-entry] Index is outdated: %s changed.\n", rest);
+				goto exit;
+			}
+			if (! add_path(type[0] == 'D' ? &index_data.directories : &index_data.files,
+						rest, recorded))
+				goto exit;
+		}
+		else if (! strcmp(type, "E"))
+		{
+			char *id     = next_field(&rest);
+			char *hidden = next_field(&rest);
+			char *name   = next_field(&rest);
+			char *icon   = next_field(&rest);
+			if ( id == NULL || hidden == NULL || name == NULL || icon == NULL || rest == NULL )
+				goto exit;
+			if ( NULL == add_entry(id, name, icon, rest, ! strcmp(hidden, "1")) )
+				goto exit;
+		}
+		else
+			goto exit;
+	}
+
+	ret = search_path;
+
+exit:
+	free_if_set(line);
+	fclose(file);
+	if (! ret)
+		clear_index();
+	return ret;
+}
+
+static void write_index (const char *path)
+{
+	char *tmp_path = get_formatted_buffer("%s.tmp", path);
+	if ( tmp_path == NULL )
+		return;
+
+	FILE *file;
+	if ( NULL == (file = fopen(tmp_path, "w")) )
+	{
+		log_message(1, "[desktop-entry] Can not open file: %s: %s\n", tmp_path, strerror(errno));
+		free(tmp_path);
+		return;
+	}
+
+	fprintf(file, "%s\nP\t%s\n", INDEX_HEADER, index_data.search_path);
+
+	struct Lava_desktop_path *dir;
+	wl_list_for_each(dir, &index_data.directories, link)
+		fprintf(file, "D\t%lld\t%ld\t%s\n", (long long)dir->mtime.tv_sec,
+				dir->mtime.tv_nsec, dir->path);
+	wl_list_for_each(dir, &index_data.files, link)
+		fprintf(file, "F\t%lld\t%ld\t%s\n", (long long)dir->mtime.tv_sec,
+				dir->mtime.tv_nsec, dir->path);
+
+	struct Lava_desktop_entry *entry;
+	wl_list_for_each(entry, &index_data.entries, link)
+		fprintf(file, "E\t%s\t%d\t%s\t%s\t%s\n", entry->id, entry->hidden,
+				str_orelse(entry->name, ""), str_orelse(entry->icon, ""),
+				str_orelse(entry->exec, ""));
+
+	if ( fclose(file) != 0 || rename(tmp_path, path) != 0 )
+	{
+		log_message(1, "[desktop-entry] Failed to write index: %s\n", path);
+		remove(tmp_path);
+	}
+
+	free(tmp_path);
+}
+
+static bool load_index (void)
+{
+	if (index_data.loaded)
+		return true;
+
+	wl_list_init(&index_data.entries);
+	wl_list_init(&index_data.directories);
+	wl_list_init(&index_data.files);
+	if ( NULL == (index_data.search_path = get_search_path()) )
+		return false;
+	index_data.loaded = true;
+
+	char *path = get_cache_file_path("desktop-entries");
+	if ( path != NULL && read_index(path) )
+	{
+		log_message(1, "[desktop-entry] Using cached index.\n");
+		free(path);
+		return true;
+	}
+
+	log_message(1, "[desktop-entry] Building index.\n");
+	scan_all_directories();
+	if ( path != NULL )
+		write_index(path);
+	free_if_set(path);
+	return true;
+}
+
+/* Returns the desktop entry with the given ID or NULL if it does not exist.
+ * The ID may be given with or without the ".desktop" suffix.
+ */
+const struct Lava_desktop_entry *desktop_entry_lookup (const char *id)
+{
+	if (! load_index())
+		return NULL;
+
+	size_t len = strlen(id);
+	if ( len > strlen(".desktop") && ! strcmp(id + len - strlen(".desktop"), ".desktop") )
+		len -= strlen(".desktop");
+
+	struct Lava_desktop_entry *entry;
+	wl_list_for_each(entry, &index_data.entries, link)
+		if ( strlen(entry->id) == len && ! strncmp(entry->id, id, len) )
+			return entry->hidden ? NULL : entry;
+	return NULL;
+}
+
+#if WATCH_CONFIG
+/* Watch all directories of the index, so that newly installed or removed
+ * applications trigger a reload.
+ */
+bool desktop_entry_watch_directories (int inotify_fd)
+{
+	if (! index_data.loaded)
+		return true;
+
+	struct Lava_desktop_path *dir;
+	wl_list_for_each(dir, &index_data.directories, link)
+	{
+		/* Non-existing directories have been recorded as well. */
+		if ( dir->mtime.tv_sec == 0 && dir->mtime.tv_nsec == 0 )
+			continue;
+		if ( -1 == inotify_add_watch(inotify_fd, dir->path,
+					IN_CREATE | IN_DELETE | IN_MOVE | IN_CLOSE_WRITE) )
+			log_message(1, "[desktop-entry] Can not watch %s: %s\n",
+					dir->path, strerror(errno));
+	}
+	return true;
+}
+#endif
+
+void destroy_desktop_entry_index (void)
+{
+	if (! index_data.loaded)
+		return;
+	clear_index();
+	free_if_set(index_data.search_path);
+	index_data.search_path = NULL;
+	index_data.loaded = false;
+}
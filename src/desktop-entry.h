@@ -0,0 +1,52 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LAVALAUNCHER_DESKTOP_ENTRY_H
+#define LAVALAUNCHER_DESKTOP_ENTRY_H
+
+#include<stdbool.h>
+#include<wayland-server.h>
+
+struct Lava_desktop_entry
+{
+	struct wl_list link;
+
+	/* Desktop file ID, without the ".desktop" suffix. */
+	char *id;
+
+	char *name;
+	char *icon;
+
+	/* The Exec key with all field codes removed. */
+	char *exec;
+
+	/* Hidden entries shadow entries with the same ID in directories of
+	 * lower precedence but are otherwise treated as if they do not exist.
+	 */
+	bool hidden;
+};
+
+const struct Lava_desktop_entry *desktop_entry_lookup (const char *id);
+void destroy_desktop_entry_index (void);
+#if WATCH_CONFIG
+bool desktop_entry_watch_directories (int inotify_fd);
+#endif
+
+#endif
@@ -17,6 +17,8 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include<stdbool.h>
 #include<stdlib.h>
 #include<stdint.h>
@@ -29,6 +31,102 @@
 #include"event-loop.h"
 #include"str.h"
 
+/************
+ *          *
+ *  Timers  *
+ *          *
+ ************/
+static struct wl_list armed_timers = { .prev = &armed_timers, .next = &armed_timers };
+
+void timer_init (struct Lava_timer *timer, void (*handle)(struct Lava_timer *), void *data)
+{
+	timer->armed  = false;
+	timer->handle = handle;
+	timer->data   = data;
+	wl_list_init(&timer->link);
+}
+
+/* Arm the timer to expire in the given amount of milliseconds. Re-arming an
+ * already armed timer moves its expiry.
+ */
+void timer_arm (struct Lava_timer *timer, uint32_t ms)
+{
+	clock_gettime(CLOCK_MONOTONIC, &timer->expiry);
+	timer->expiry.tv_sec  += ms / 1000;
+	timer->expiry.tv_nsec += (long)(ms % 1000) * 1000000;
+	if ( timer->expiry.tv_nsec >= 1000000000 )
+	{
+		timer->expiry.tv_sec++;
+		timer->expiry.tv_nsec -= 1000000000;
+	}
+
+	if (! timer->armed)
+	{
+		wl_list_insert(&armed_timers, &timer->link);
+		timer->armed = true;
+	}
+}
+
+void timer_disarm (struct Lava_timer *timer)
+{
+	if (! timer->armed)
+		return;
+	wl_list_remove(&timer->link);
+	wl_list_init(&timer->link);
+	timer->armed = false;
+}
+
+static int64_t timespec_diff_ms (struct timespec *a, struct timespec *b)
+{
+	return (int64_t)(a->tv_sec - b->tv_sec) * 1000
+		+ (a->tv_nsec - b->tv_nsec) / 1000000;
+}
+
+/* Returns the poll timeout until the next timer expires, or -1 if no timer is armed. */
+static int get_poll_timeout (void)
+{
+	if (wl_list_empty(&armed_timers))
+		return -1;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	int64_t timeout = INT32_MAX;
+	struct Lava_timer *timer;
+	wl_list_for_each(timer, &armed_timers, link)
+	{
+		int64_t diff = timespec_diff_ms(&timer->expiry, &now);
+		if ( diff < timeout )
+			timeout = diff;
+	}
+
+	/* Round up, so that we do not wake up just before the expiry. */
+	return timeout < 0 ? 0 : (int)timeout + 1;
+}
+
+static void run_expired_timers (void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	struct Lava_timer *timer, *tmp;
+	wl_list_for_each_safe(timer, tmp, &armed_timers, link)
+	{
+		if ( timespec_diff_ms(&timer->expiry, &now) > 0 )
+			continue;
+
+		/* The handler may re-arm the timer or even disarm others. */
+		timer_disarm(timer);
+		timer->handle(timer);
+		return;
+	}
+}
+
+/****************
+ *              *
+ *  Event loop  *
+ *              *
+ ****************/
 void event_loop_init (struct Lava_event_loop *loop)
 {
 	loop->fd_count = 0;
@@ -67,6 +165,8 @@ bool event_loop_run (struct  Lava_event_loop *loop)
 	{
 		errno = 0;
 
+		run_expired_timers();
+
 		/* Call flush functions */
 		wl_list_for_each(source, &loop->sources, link)
 			if (! (source->flush(&fds[source->index])))
@@ -75,7 +175,7 @@ bool event_loop_run (struct  Lava_event_loop *loop)
 				goto exit;
 			}
 
-		if ( poll(fds, loop->fd_count, -1) < 0 )
+		if ( poll(fds, loop->fd_count, get_poll_timeout()) < 0 )
 		{
 			if ( errno == EINTR )
 				continue;
@@ -23,6 +23,7 @@
 #include<stdbool.h>
 #include<stdint.h>
 #include<poll.h>
+#include<time.h>
 #include<wayland-client.h>
 
 struct Lava_event_loop
@@ -43,6 +44,20 @@ struct Lava_event_source
 	nfds_t index;
 };
 
+/* One-shot timer, run by the event loop once it expires. */
+struct Lava_timer
+{
+	struct wl_list link;
+	struct timespec expiry;
+	bool armed;
+	void (*handle)(struct Lava_timer *timer);
+	void *data;
+};
+
+void timer_init (struct Lava_timer *timer, void (*handle)(struct Lava_timer *), void *data);
+void timer_arm (struct Lava_timer *timer, uint32_t ms);
+void timer_disarm (struct Lava_timer *timer);
+
 void event_loop_init (struct Lava_event_loop *loop);
 void event_loop_add_event_source (struct Lava_event_loop *loop, struct Lava_event_source *source);
 bool event_loop_run (struct  Lava_event_loop *loop);
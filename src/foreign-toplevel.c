@@ -0,0 +1,243 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+
+#include<wayland-client.h>
+
+#include"wlr-foreign-toplevel-management-unstable-v1-protocol.h"
+
+#include"lavalauncher.h"
+#include"str.h"
+#include"seat.h"
+#include"hash.h"
+#include"foreign-toplevel.h"
+
+/* The open toplevels, hashed by their app-id, so a button can find the
+ * application it launches without walking all windows of the session.
+ * Within a bucket, the most recently activated toplevels come first.
+ */
+#define TOPLEVEL_BUCKETS 64
+
+struct Lava_toplevel
+{
+	struct wl_list link;
+	struct zwlr_foreign_toplevel_handle_v1 *handle;
+
+	char *app_id, *pending_app_id;
+	bool activated, pending_activated;
+};
+
+static struct zwlr_foreign_toplevel_manager_v1 *toplevel_manager = NULL;
+static struct wl_list toplevel_buckets[TOPLEVEL_BUCKETS];
+
+/* Toplevels which did not announce an app-id yet. */
+static struct wl_list anonymous_toplevels;
+
+static bool toplevels_initialised = false;
+
+static struct wl_list *toplevel_bucket (const char *app_id)
+{
+	return &toplevel_buckets[hash_string(HASH_INIT, app_id) % TOPLEVEL_BUCKETS];
+}
+
+static void destroy_toplevel (struct Lava_toplevel *toplevel)
+{
+	wl_list_remove(&toplevel->link);
+	zwlr_foreign_toplevel_handle_v1_destroy(toplevel->handle);
+	free_if_set(toplevel->app_id);
+	free_if_set(toplevel->pending_app_id);
+	free(toplevel);
+}
+
+/*********************
+ *                   *
+ *  Toplevel handle  *
+ *                   *
+ *********************/
+static void noop (void) {}
+
+static void toplevel_handle_app_id (void *data, struct zwlr_foreign_toplevel_handle_v1 *handle,
+		const char *app_id)
+{
+	struct Lava_toplevel *toplevel = (struct Lava_toplevel *)data;
+	set_string(&toplevel->pending_app_id, (char *)app_id);
+}
+
+static void toplevel_handle_state (void *data, struct zwlr_foreign_toplevel_handle_v1 *handle,
+		struct wl_array *states)
+{
+	struct Lava_toplevel *toplevel = (struct Lava_toplevel *)data;
+	toplevel->pending_activated = false;
+
+	uint32_t *state;
+	wl_array_for_each(state, states)
+		if ( *state == ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED )
+			toplevel->pending_activated = true;
+}
+
+static void toplevel_handle_done (void *data, struct zwlr_foreign_toplevel_handle_v1 *handle)
+{
+	struct Lava_toplevel *toplevel = (struct Lava_toplevel *)data;
+
+	const bool newly_activated = toplevel->pending_activated && ! toplevel->activated;
+	toplevel->activated = toplevel->pending_activated;
+
+	if ( toplevel->pending_app_id != NULL )
+	{
+		free_if_set(toplevel->app_id);
+		toplevel->app_id         = toplevel->pending_app_id;
+		toplevel->pending_app_id = NULL;
+
+		log_message(2, "[toplevel] Toplevel app-id: %s\n", toplevel->app_id);
+	}
+	else if (! newly_activated)
+		return;
+
+	if ( toplevel->app_id == NULL )
+		return;
+
+	/* (Re-)inserting at the head keeps the bucket ordered by activation. */
+	wl_list_remove(&toplevel->link);
+	wl_list_insert(toplevel_bucket(toplevel->app_id), &toplevel->link);
+}
+
+static void toplevel_handle_closed (void *data, struct zwlr_foreign_toplevel_handle_v1 *handle)
+{
+	struct Lava_toplevel *toplevel = (struct Lava_toplevel *)data;
+	log_message(2, "[toplevel] Toplevel closed: %s\n", str_orelse(toplevel->app_id, "(none)"));
+	destroy_toplevel(toplevel);
+}
+
+static const struct zwlr_foreign_toplevel_handle_v1_listener toplevel_handle_listener = {
+	.title        = (void (*) (void *, struct zwlr_foreign_toplevel_handle_v1 *, const char *)) noop,
+	.app_id       = toplevel_handle_app_id,
+	.output_enter = (void (*) (void *, struct zwlr_foreign_toplevel_handle_v1 *, struct wl_output *)) noop,
+	.output_leave = (void (*) (void *, struct zwlr_foreign_toplevel_handle_v1 *, struct wl_output *)) noop,
+	.state        = toplevel_handle_state,
+	.done         = toplevel_handle_done,
+	.closed       = toplevel_handle_closed,
+	.parent       = (void (*) (void *, struct zwlr_foreign_toplevel_handle_v1 *,
+				struct zwlr_foreign_toplevel_handle_v1 *)) noop,
+};
+
+/**********************
+ *                    *
+ *  Toplevel manager  *
+ *                    *
+ **********************/
+static void toplevel_manager_handle_toplevel (void *data,
+		struct zwlr_foreign_toplevel_manager_v1 *manager,
+		struct zwlr_foreign_toplevel_handle_v1 *handle)
+{
+	struct Lava_toplevel *toplevel = calloc(1, sizeof(struct Lava_toplevel));
+	if ( toplevel == NULL )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		zwlr_foreign_toplevel_handle_v1_destroy(handle);
+		return;
+	}
+
+	/* Toplevels are only put into a bucket once they have an app-id. */
+	wl_list_insert(&anonymous_toplevels, &toplevel->link);
+	toplevel->handle = handle;
+	zwlr_foreign_toplevel_handle_v1_add_listener(handle, &toplevel_handle_listener, toplevel);
+}
+
+static void toplevel_manager_handle_finished (void *data,
+		struct zwlr_foreign_toplevel_manager_v1 *manager)
+{
+	log_message(1, "[toplevel] Toplevel manager finished.\n");
+	zwlr_foreign_toplevel_manager_v1_destroy(manager);
+	toplevel_manager = NULL;
+}
+
+static const struct zwlr_foreign_toplevel_manager_v1_listener toplevel_manager_listener = {
+	.toplevel = toplevel_manager_handle_toplevel,
+	.finished = toplevel_manager_handle_finished,
+};
+
+bool init_foreign_toplevels (struct wl_registry *registry, uint32_t name)
+{
+	log_message(2, "[registry] Get zwlr_foreign_toplevel_manager_v1.\n");
+
+	for (int i = 0; i < TOPLEVEL_BUCKETS; i++)
+		wl_list_init(&toplevel_buckets[i]);
+	wl_list_init(&anonymous_toplevels);
+	toplevels_initialised = true;
+
+	if ( NULL == (toplevel_manager = wl_registry_bind(registry, name,
+					&zwlr_foreign_toplevel_manager_v1_interface, 1)) )
+	{
+		log_message(0, "ERROR: Can not bind zwlr_foreign_toplevel_manager_v1.\n");
+		return false;
+	}
+	zwlr_foreign_toplevel_manager_v1_add_listener(toplevel_manager,
+			&toplevel_manager_listener, NULL);
+	return true;
+}
+
+/* Activate the most recently used toplevel with the given app-id. Returns
+ * false if there is none, in which case the caller should launch the
+ * application instead.
+ */
+bool activate_toplevel (const char *app_id, struct Lava_seat *seat)
+{
+	if ( toplevel_manager == NULL || seat == NULL )
+		return false;
+
+	struct Lava_toplevel *toplevel;
+	wl_list_for_each(toplevel, toplevel_bucket(app_id), link)
+	{
+		if (strcmp(toplevel->app_id, app_id))
+			continue;
+
+		log_message(1, "[toplevel] Activating toplevel: %s\n", app_id);
+		zwlr_foreign_toplevel_handle_v1_activate(toplevel->handle, seat->wl_seat);
+		return true;
+	}
+	return false;
+}
+
+void finish_foreign_toplevels (void)
+{
+	if (! toplevels_initialised)
+		return;
+	toplevels_initialised = false;
+
+	struct Lava_toplevel *toplevel, *tmp;
+	for (int i = 0; i < TOPLEVEL_BUCKETS; i++)
+		wl_list_for_each_safe(toplevel, tmp, &toplevel_buckets[i], link)
+			destroy_toplevel(toplevel);
+	wl_list_for_each_safe(toplevel, tmp, &anonymous_toplevels, link)
+		destroy_toplevel(toplevel);
+
+	if ( toplevel_manager != NULL )
+	{
+		zwlr_foreign_toplevel_manager_v1_stop(toplevel_manager);
+		zwlr_foreign_toplevel_manager_v1_destroy(toplevel_manager);
+		toplevel_manager = NULL;
+	}
+}
@@ -0,0 +1,34 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LAVALAUNCHER_FOREIGN_TOPLEVEL_H
+#define LAVALAUNCHER_FOREIGN_TOPLEVEL_H
+
+#include<stdbool.h>
+#include<stdint.h>
+#include<wayland-client.h>
+
+struct Lava_seat;
+
+bool init_foreign_toplevels (struct wl_registry *registry, uint32_t name);
+bool activate_toplevel (const char *app_id, struct Lava_seat *seat);
+void finish_foreign_toplevels (void);
+
+#endif
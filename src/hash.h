@@ -0,0 +1,33 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LAVALAUNCHER_HASH_H
+#define LAVALAUNCHER_HASH_H
+
+#include<stdint.h>
+#include<stddef.h>
+
+/* 64 bit FNV-1a. Not cryptographic, only used to detect changes. */
+#define HASH_INIT UINT64_C(0xcbf29ce484222325)
+
+uint64_t hash_update (uint64_t hash, const void *data, size_t len);
+uint64_t hash_string (uint64_t hash, const char *str);
+
+#endif
@@ -31,11 +31,18 @@
 
 #include"lavalauncher.h"
 #include"item.h"
+#include"config.h"
+#include"reload.h"
 #include"seat.h"
 #include"str.h"
 #include"bar.h"
 #include"output.h"
+#include"desktop-entry.h"
 #include"types/image_t.h"
+#include"decode-helper.h"
+#include"foreign-toplevel.h"
+#include"dbus.h"
+#include"xdg-activation-v1-protocol.h"
 
 /*******************
  *                 *
@@ -43,15 +50,20 @@
  *                 *
  *******************/
 /* We need to fork two times for UNIXy resons. */
-static void item_command_exec_second_fork (struct Lava_bar_instance *instance, const char *cmd)
+static void item_command_exec_second_fork (const char *output_name, uint32_t output_scale,
+		const char *token, const char *cmd)
 {
 	errno = 0;
 	int ret = fork();
 	if ( ret == 0 )
 	{
 		/* Prepare environment variables. */
-		setenvf("LAVALAUNCHER_OUTPUT_NAME",  "%s", instance->output->name);
-		setenvf("LAVALAUNCHER_OUTPUT_SCALE", "%d", instance->output->scale);
+		setenvf("LAVALAUNCHER_OUTPUT_NAME",  "%s", output_name);
+		setenvf("LAVALAUNCHER_OUTPUT_SCALE", "%d", output_scale);
+		if ( token != NULL )
+			setenv("XDG_ACTIVATION_TOKEN", token, true);
+		else
+			unsetenv("XDG_ACTIVATION_TOKEN");
 
 		/* execl() only returns on error; On success it replaces this process. */
 		execl("/bin/sh", "/bin/sh", "-c", cmd, NULL);
@@ -66,7 +78,8 @@ static void item_command_exec_second_fork (struct Lava_bar_instance *instance, c
 }
 
 /* We need to fork two times for UNIXy resons. */
-static void item_command_exec_first_fork (struct Lava_bar_instance *instance, const char *cmd)
+static void item_command_exec_first_fork (const char *output_name, uint32_t output_scale,
+		const char *token, const char *cmd)
 {
 	errno = 0;
 	int ret = fork();
@@ -79,7 +92,7 @@ static void item_command_exec_first_fork (struct Lava_bar_instance *instance, co
 		sigemptyset(&mask);
 		sigprocmask(SIG_SETMASK, &mask, NULL);
 
-		item_command_exec_second_fork(instance, cmd);
+		item_command_exec_second_fork(output_name, output_scale, token, cmd);
 		_exit(EXIT_SUCCESS);
 	}
 	else if ( ret < 0 ) /* Yes, fork can fail. */
@@ -88,7 +101,96 @@ static void item_command_exec_first_fork (struct Lava_bar_instance *instance, co
 		waitpid(ret, NULL, 0);
 }
 
-static void execute_item_command (struct Lava_item_command *cmd, struct Lava_bar_instance *instance)
+/* A command waiting for its xdg-activation token. Compositors preventing
+ * focus stealing only focus the window of the launched application if it
+ * presents a token tied to the input event that launched it.
+ */
+struct Lava_pending_launch
+{
+	struct wl_list link;
+	struct xdg_activation_token_v1 *token;
+
+	/* The shell command or, if dbus is set, the ID of the application. */
+	char *command;
+	bool dbus;
+
+	char *output_name;
+	uint32_t output_scale;
+};
+static struct wl_list pending_launches = { .prev = &pending_launches, .next = &pending_launches };
+
+static void destroy_pending_launch (struct Lava_pending_launch *launch)
+{
+	wl_list_remove(&launch->link);
+	DESTROY(launch->token, xdg_activation_token_v1_destroy);
+	free_if_set(launch->output_name);
+	free(launch->command);
+	free(launch);
+}
+
+static void run_pending_launch (struct Lava_pending_launch *launch, const char *token)
+{
+	if (launch->dbus)
+		dbus_activate(launch->command, token);
+	else
+		item_command_exec_first_fork(launch->output_name, launch->output_scale,
+				token, launch->command);
+	destroy_pending_launch(launch);
+}
+
+static void activation_token_handle_done (void *data, struct xdg_activation_token_v1 *token,
+		const char *token_string)
+{
+	struct Lava_pending_launch *launch = (struct Lava_pending_launch *)data;
+	log_message(2, "[item] Received activation token: %s\n", token_string);
+	run_pending_launch(launch, token_string);
+}
+
+static const struct xdg_activation_token_v1_listener activation_token_listener = {
+	.done = activation_token_handle_done,
+};
+
+/* Request an activation token and launch the command or activate the D-Bus
+ * application once it arrives.
+ */
+static bool launch_with_activation_token (struct Lava_bar_instance *instance,
+		struct Lava_seat *seat, uint32_t serial, const char *cmd, bool dbus)
+{
+	TRY_NEW(struct Lava_pending_launch, launch, false);
+	launch->dbus         = dbus;
+	launch->output_name  = NULL;
+	launch->output_scale = instance->output->scale;
+	if ( NULL == (launch->command = strdup(cmd))
+			|| ( instance->output->name != NULL
+				&& NULL == (launch->output_name = strdup(instance->output->name)) ) )
+	{
+		log_message(0, "ERROR: strdup: %s\n", strerror(errno));
+		free_if_set(launch->command);
+		free(launch);
+		return false;
+	}
+
+	launch->token = xdg_activation_v1_get_activation_token(context.xdg_activation);
+	xdg_activation_token_v1_add_listener(launch->token, &activation_token_listener, launch);
+	if ( seat != NULL )
+		xdg_activation_token_v1_set_serial(launch->token, serial, seat->wl_seat);
+	xdg_activation_token_v1_set_surface(launch->token, instance->bar_surface);
+	xdg_activation_token_v1_commit(launch->token);
+
+	wl_list_insert(&pending_launches, &launch->link);
+	return true;
+}
+
+/* Launch everything still waiting for its token without one. */
+void finish_pending_launches (void)
+{
+	struct Lava_pending_launch *launch, *tmp;
+	wl_list_for_each_safe(launch, tmp, &pending_launches, link)
+		run_pending_launch(launch, NULL);
+}
+
+static void execute_item_command (struct Lava_item_command *cmd, struct Lava_bar_instance *instance,
+		struct Lava_seat *seat, uint32_t serial)
 {
 	const char *command = cmd->command;
 
@@ -107,12 +209,16 @@ static void execute_item_command (struct Lava_item_command *cmd, struct Lava_bar
 	{
 		log_message(1, "[item] Triggering reload. "
 			"This is a developer option not intended for actual usage.\n");
-		context.loop   = false;
-		context.reload = true;
+		request_reload();
 		return;
 	}
 
-	item_command_exec_first_fork(instance, command);
+	if ( context.xdg_activation != NULL
+			&& launch_with_activation_token(instance, seat, serial, command, false) )
+		return;
+
+	item_command_exec_first_fork(instance->output->name, instance->output->scale,
+			NULL, command);
 }
 
 static struct Lava_item_command *find_item_command (struct Lava_item *item,
@@ -161,11 +267,53 @@ static void destroy_all_item_commands (struct Lava_item *item)
  *  Button configuration  *
  *                        *
  **************************/
-static bool button_set_image_path (struct Lava_item *button, const char *path)
+static bool button_set_image_path (struct Lava_item *button, const char *path, int line)
+{
+	set_string(&button->img_path, (char *)path);
+	button->img_line = line;
+	return true;
+}
+
+static bool button_set_label (struct Lava_item *button, const char *label)
+{
+	set_string(&button->label, (char *)label);
+	return true;
+}
+
+static bool button_set_tooltip (struct Lava_item *button, const char *tooltip)
+{
+	set_string(&button->tooltip, (char *)tooltip);
+	return true;
+}
+
+static bool button_set_app_id (struct Lava_item *button, const char *app_id)
 {
-	DESTROY(button->img, image_t_destroy);
-	if ( NULL == (button->img = image_t_create_from_file(path)) )
+	set_string(&button->app_id, (char *)app_id);
+	return true;
+}
+
+static bool button_set_prefer_activate (struct Lava_item *button, const char *prefer_activate)
+{
+	if (! set_boolean(&button->prefer_activate, prefer_activate))
 		return false;
+	if (button->prefer_activate)
+		parse_generation->need_foreign_toplevel = true;
+	return true;
+}
+
+static bool button_set_dbus_activate (struct Lava_item *button, const char *app_id)
+{
+	if (! dbus_is_valid_name(app_id))
+	{
+		log_message(0, "ERROR: Not a valid D-Bus application ID: %s\n", app_id);
+		return false;
+	}
+
+	/* Like the universal command, activation works with pointer and touch. */
+	parse_generation->need_pointer = true;
+	parse_generation->need_touch   = true;
+	parse_generation->need_dbus    = true;
+	set_string(&button->dbus_activate, (char *)app_id);
 	return true;
 }
 
@@ -223,7 +371,7 @@ static bool parse_bind_token_buffer (char *buffer, int *index,enum Interaction_t
 		if (tokens[i].modifier)
 		{
 			*modifiers |= tokens[i].value;
-			context.need_keyboard = true;
+			parse_generation->need_keyboard = true;
 		}
 		else
 		{
@@ -240,11 +388,11 @@ static bool parse_bind_token_buffer (char *buffer, int *index,enum Interaction_t
 			{
 				case INTERACTION_MOUSE_BUTTON:
 				case INTERACTION_MOUSE_SCROLL:
-					context.need_pointer = true;
+					parse_generation->need_pointer = true;
 					break;
 
 				case INTERACTION_TOUCH:
-					context.need_touch = true;
+					parse_generation->need_touch = true;
 					break;
 
 				default:
@@ -350,8 +498,8 @@ static bool button_item_universal_command (struct Lava_item *button, const char
 	/* Interaction type is universal, meaning the button can be activated
 	 * by both the pointer and touch.
 	 */
-	context.need_pointer = true;
-	context.need_touch = true;
+	parse_generation->need_pointer = true;
+	parse_generation->need_touch = true;
 
 	/* Try to find a universal command and overwrite it. If none has been
 	 * found, create a new one.
@@ -367,11 +515,52 @@ static bool button_item_universal_command (struct Lava_item *button, const char
 	return item_add_command(button, command, INTERACTION_UNIVERSAL, 0, 0);
 }
 
+/* Fill in everything of the button the desktop entry provides which has not
+ * already been set explicitly. Settings which follow in the configuration
+ * still override it.
+ */
+static bool button_set_desktop_entry (struct Lava_item *button, const char *id, int line)
+{
+	const struct Lava_desktop_entry *entry = desktop_entry_lookup(id);
+	if ( entry == NULL )
+	{
+		log_message(0, "ERROR: Desktop entry \"%s\" not found.\n", id);
+		return false;
+	}
+
+	if ( button->img_path == NULL && button->label == NULL && entry->icon != NULL )
+		button_set_image_path(button, entry->icon, line);
+
+	if ( button->tooltip == NULL && entry->name != NULL )
+		button_set_tooltip(button, entry->name);
+
+	/* Applications should use their desktop file ID as app-id. */
+	if ( button->app_id == NULL )
+		button_set_app_id(button, entry->id);
+
+	if ( entry->exec != NULL && find_item_command(button, INTERACTION_UNIVERSAL, 0, 0, false) == NULL )
+		return button_item_universal_command(button, entry->exec);
+
+	return true;
+}
+
 static bool button_set_variable (struct Lava_item *button, const char *variable,
 		const char *value, int line)
 {
 	if (! strcmp("image-path", variable))
-		TRY(button_set_image_path(button, value))
+		TRY(button_set_image_path(button, value, line))
+	else if (! strcmp("desktop-entry", variable))
+		TRY(button_set_desktop_entry(button, value, line))
+	else if (! strcmp("label", variable))
+		TRY(button_set_label(button, value))
+	else if (! strcmp("tooltip", variable))
+		TRY(button_set_tooltip(button, value))
+	else if (! strcmp("app-id", variable))
+		TRY(button_set_app_id(button, value))
+	else if (! strcmp("prefer-activate", variable))
+		TRY(button_set_prefer_activate(button, value))
+	else if (! strcmp("dbus-activate", variable))
+		TRY(button_set_dbus_activate(button, value))
 	else if (! strcmp("command", variable)) /* Generic/universal command */
 		TRY(button_item_universal_command(button, value))
 	else if (string_starts_with(variable, "command"))  /* Command with special bind */
@@ -380,7 +569,7 @@ static bool button_set_variable (struct Lava_item *button, const char *variable,
 	log_message(0, "ERROR: Unrecognized button setting \"%s\".\n", variable);
 error:
 	log_message(0, "INFO: The error is on line %d in \"%s\".\n",
-			line, context.config_path);
+			line, fragment_path(parse_fragment));
 	return false;
 }
 
@@ -410,7 +599,7 @@ static bool spacer_set_variable (struct Lava_item *spacer,
 	log_message(0, "ERROR: Unrecognized spacer setting \"%s\".\n", variable);
 error:
 	log_message(0, "INFO: The error is on line %d in \"%s\".\n",
-			line, context.config_path);
+			line, fragment_path(parse_fragment));
 	return false;
 }
 
@@ -435,7 +624,27 @@ bool item_set_variable (struct Lava_item *item, const char *variable,
  *  Item  *
  *        *
  **********/
+/* Launch the application of the button, unless it is already running. */
+static void item_launch (struct Lava_item *item, struct Lava_item_command *cmd,
+		struct Lava_bar_instance *instance, struct Lava_seat *seat, uint32_t serial)
+{
+	if ( item->prefer_activate && item->app_id != NULL && activate_toplevel(item->app_id, seat) )
+		return;
+
+	if ( item->dbus_activate != NULL )
+	{
+		if ( context.xdg_activation == NULL
+				|| ! launch_with_activation_token(instance, seat, serial, item->dbus_activate, true) )
+			dbus_activate(item->dbus_activate, NULL);
+		return;
+	}
+
+	if ( cmd != NULL )
+		execute_item_command(cmd, instance, seat, serial);
+}
+
 void item_interaction (struct Lava_item *item, struct Lava_bar_instance *instance,
+		struct Lava_seat *seat, uint32_t serial,
 		enum Interaction_type type, uint32_t modifiers, uint32_t special)
 {
 	if ( item->type != TYPE_BUTTON )
@@ -444,9 +653,14 @@ void item_interaction (struct Lava_item *item, struct Lava_bar_instance *instanc
 	log_message(1, "[item] Interaction: type=%d mod=%d spec=%d\n",
 			type, modifiers, special);
 
-	struct Lava_item_command *cmd;
-	if ( NULL != (cmd = find_item_command(item, type, modifiers, special, true)) )
-		execute_item_command(cmd, instance);
+	/* Only the universal action launches the application, commands bound
+	 * to specific interactions may do something else entirely.
+	 */
+	struct Lava_item_command *cmd = find_item_command(item, type, modifiers, special, true);
+	if ( cmd != NULL && cmd->type != INTERACTION_UNIVERSAL )
+		execute_item_command(cmd, instance, seat, serial);
+	else if ( type != INTERACTION_MOUSE_SCROLL )
+		item_launch(item, cmd, instance, seat, serial);
 }
 
 bool create_item (struct Lava_bar *bar, enum Item_type type)
@@ -459,6 +673,13 @@ bool create_item (struct Lava_bar *bar, enum Item_type type)
 	item->ordinate = 0;
 	item->length   = 0;
 	item->img      = NULL;
+	item->img_path = NULL;
+	item->img_line = 0;
+	item->label    = NULL;
+	item->tooltip  = NULL;
+	item->app_id   = NULL;
+	item->dbus_activate = NULL;
+	item->prefer_activate = false;
 	item->type     = type;
 	bar->last_item = item;
 	wl_list_init(&item->commands);
@@ -469,24 +690,31 @@ bool create_item (struct Lava_bar *bar, enum Item_type type)
 /* Return pointer to Lava_item struct from item list which includes the
  * given surface-local coordinates on the surface of the given output.
  */
+#define DEFINE_ITEM_FROM_COORDS(NAME, MAIN) \
+	struct Lava_item *NAME (struct Lava_bar_instance *instance, uint32_t x, uint32_t y) \
+	{ \
+		const uint32_t ordinate = MAIN - instance->item_area_dim.MAIN; \
+		\
+		/* Items are sorted by ordinate, in reverse order. */ \
+		struct Lava_item *item; \
+		wl_list_for_each_reverse(item, &instance->bar->items, link) \
+		{ \
+			if ( ordinate < item->ordinate ) \
+				return NULL; \
+			if ( ordinate < item->ordinate + item->length ) \
+				return item; \
+		} \
+		return NULL; \
+	}
+
+DEFINE_ITEM_FROM_COORDS(item_from_coords_horizontal, x)
+DEFINE_ITEM_FROM_COORDS(item_from_coords_vertical, y)
+
+#undef DEFINE_ITEM_FROM_COORDS
+
 struct Lava_item *item_from_coords (struct Lava_bar_instance *instance, uint32_t x, uint32_t y)
 {
-	struct Lava_bar               *bar    = instance->bar;
-	struct Lava_bar_configuration *config = instance->config;
-	uint32_t ordinate;
-	if ( config->orientation == ORIENTATION_HORIZONTAL )
-		ordinate = x - instance->item_area_dim.x;
-	else
-		ordinate = y - instance->item_area_dim.y;
-
-	struct Lava_item *item, *temp;
-	wl_list_for_each_reverse_safe(item, temp, &bar->items, link)
-	{
-		if ( ordinate >= item->ordinate
-				&& ordinate < item->ordinate + item->length )
-			return item;
-	}
-	return NULL;
+	return instance->ops.item_from_coords(instance, x, y);
 }
 
 unsigned int get_item_length_sum (struct Lava_bar *bar)
@@ -529,11 +757,97 @@ bool finalize_items (struct Lava_bar *bar)
 	return true;
 }
 
+/* Decode the images of all buttons of the bar. */
+bool load_item_images (struct Lava_bar *bar)
+{
+	struct Lava_item *item;
+	wl_list_for_each(item, &bar->items, link)
+	{
+		if ( item->type != TYPE_BUTTON || item->img_path == NULL )
+			continue;
+
+		DESTROY(item->img, image_t_destroy);
+		if ( NULL == (item->img = image_t_create_from_file(item->img_path,
+						bar->default_config->size)) )
+		{
+			log_message(0, "INFO: The error is on line %d in \"%s\".\n",
+					item->img_line, fragment_path(bar->fragment));
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Decode the images of all buttons of all bars with the decode helpers. The
+ * scale is the largest one of all outputs.
+ */
+bool load_item_images_sandboxed (struct wl_list *bars, uint32_t scale)
+{
+	size_t count = 0;
+	struct Lava_bar *bar;
+	struct Lava_item *item;
+	wl_list_for_each(bar, bars, link)
+		wl_list_for_each(item, &bar->items, link)
+			if ( item->type == TYPE_BUTTON && item->img_path != NULL )
+				count++;
+	if ( count == 0 )
+		return true;
+
+	struct Lava_decode_job *jobs = calloc(count, sizeof(struct Lava_decode_job));
+	if ( jobs == NULL )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		return false;
+	}
+
+	size_t i = 0;
+	wl_list_for_each(bar, bars, link)
+		wl_list_for_each(item, &bar->items, link)
+			if ( item->type == TYPE_BUTTON && item->img_path != NULL )
+			{
+				jobs[i].path  = item->img_path;
+				jobs[i].size  = bar->default_config->size;
+				jobs[i].scale = scale;
+				i++;
+			}
+
+	decode_images_sandboxed(jobs, count);
+
+	/* Hand every surface to its item, even after an error, so none leak. */
+	bool ret = true;
+	i = 0;
+	wl_list_for_each(bar, bars, link)
+		wl_list_for_each(item, &bar->items, link)
+			if ( item->type == TYPE_BUTTON && item->img_path != NULL )
+			{
+				DESTROY_NULL(item->img, image_t_destroy);
+				if ( jobs[i].surface != NULL )
+					item->img = image_t_create_from_surface(jobs[i].surface,
+							jobs[i].resolved_path, jobs[i].size,
+							jobs[i].raster_scale);
+				if ( item->img == NULL && ret )
+				{
+					log_message(0, "INFO: The error is on line %d in \"%s\".\n",
+							item->img_line, fragment_path(bar->fragment));
+					ret = false;
+				}
+				i++;
+			}
+
+	free(jobs);
+	return ret;
+}
+
 static void destroy_item (struct Lava_item *item)
 {
 	wl_list_remove(&item->link);
 	destroy_all_item_commands(item);
 	DESTROY(item->img, image_t_destroy);
+	free_if_set(item->img_path);
+	free_if_set(item->label);
+	free_if_set(item->tooltip);
+	free_if_set(item->app_id);
+	free_if_set(item->dbus_activate);
 	free(item);
 }
 
@@ -28,6 +28,7 @@
 
 struct Lava_bar;
 struct Lava_bar_instance;
+struct Lava_seat;
 
 enum Item_type
 {
@@ -63,6 +64,30 @@ struct Lava_item
 	image_t *img;
 	struct wl_list commands;
 
+	/* Images are only loaded after the Wayland globals have been
+	 * requested, so the compositor can work on our requests meanwhile.
+	 */
+	char *img_path;
+	int img_line;
+
+	/* Text shown instead of an image. */
+	char *label;
+
+	/* Text shown when the pointer lingers over the item. */
+	char *tooltip;
+
+	/* App-id of the windows of the application the button launches. If
+	 * prefer_activate is set, an open window is activated instead of
+	 * running the command again.
+	 */
+	char *app_id;
+	bool prefer_activate;
+
+	/* ID of the application to activate via D-Bus instead of running the
+	 * universal command.
+	 */
+	char *dbus_activate;
+
 	unsigned int index, ordinate, length;
 };
 
@@ -70,10 +95,16 @@ bool create_item (struct Lava_bar *bar, enum Item_type type);
 bool item_set_variable (struct Lava_item *item, const char *variable,
 		const char *value, int line);
 void item_interaction (struct Lava_item *item, struct Lava_bar_instance *instance,
+		struct Lava_seat *seat, uint32_t serial,
 		enum Interaction_type type, uint32_t modifiers, uint32_t special);
+void finish_pending_launches (void);
 struct Lava_item *item_from_coords (struct Lava_bar_instance *instance, uint32_t x, uint32_t y);
+struct Lava_item *item_from_coords_horizontal (struct Lava_bar_instance *instance, uint32_t x, uint32_t y);
+struct Lava_item *item_from_coords_vertical (struct Lava_bar_instance *instance, uint32_t x, uint32_t y);
 unsigned int get_item_length_sum (struct Lava_bar *bar);
 bool finalize_items (struct Lava_bar *bar);
+bool load_item_images (struct Lava_bar *bar);
+bool load_item_images_sandboxed (struct wl_list *bars, uint32_t scale);
 void destroy_all_items (struct Lava_bar *bar);
 
 #endif
@@ -0,0 +1,378 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+#include<cairo/cairo.h>
+
+#include<wayland-client.h>
+
+#include"lavalauncher.h"
+#include"str.h"
+#include"label.h"
+#include"types/box_t.h"
+#include"types/colour_t.h"
+
+/* Labels are not drawn with cairo_show_text() directly. Instead every glyph is
+ * rendered once into an A8 atlas per font and pixel size, which already
+ * includes the output scale, and labels are composed by masking the colour
+ * of the label with the cells of their glyphs. Drawing a label hence only
+ * costs a few blits, the font machinery is only involved for new glyphs.
+ *
+ * The atlas is a single row of cells which grows to the right as needed. Each
+ * cell holds one glyph drawn on the baseline, with a pixel of margin on each
+ * side for anti-aliasing.
+ */
+
+#define ATLAS_INITIAL_WIDTH 256
+#define CELL_MARGIN         1
+
+/* The text of a label is half as high as an icon. */
+#define LABEL_FONT_SCALE    0.5
+
+struct Lava_glyph
+{
+	uint32_t codepoint;
+
+	/* Horizontal position and width of the cell in the atlas. */
+	int32_t cell_x, cell_w;
+
+	/* Offset of the cell from the pen position. */
+	int32_t offset;
+
+	double advance;
+};
+
+struct Lava_glyph_atlas
+{
+	struct wl_list link;
+
+	char *font;
+	uint32_t pixel_size;
+
+	cairo_surface_t *surface;
+	int32_t width, height, used;
+	double ascent;
+
+	struct Lava_glyph *glyphs;
+	size_t glyph_count, glyph_capacity;
+};
+
+static struct wl_list atlases = { &atlases, &atlases };
+
+static void set_font (cairo_t *cairo, struct Lava_glyph_atlas *atlas)
+{
+	cairo_select_font_face(cairo, atlas->font, CAIRO_FONT_SLANT_NORMAL,
+			CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size(cairo, atlas->pixel_size);
+}
+
+static void destroy_atlas (struct Lava_glyph_atlas *atlas)
+{
+	wl_list_remove(&atlas->link);
+	DESTROY(atlas->surface, cairo_surface_destroy);
+	free_if_set(atlas->glyphs);
+	free(atlas->font);
+	free(atlas);
+}
+
+static struct Lava_glyph_atlas *create_atlas (const char *font, uint32_t pixel_size)
+{
+	log_message(2, "[label] Creating glyph atlas: font=%s pixel_size=%d\n",
+			font, pixel_size);
+
+	TRY_NEW(struct Lava_glyph_atlas, atlas, NULL);
+	atlas->pixel_size     = pixel_size;
+	atlas->surface        = NULL;
+	atlas->glyphs         = NULL;
+	atlas->glyph_count    = 0;
+	atlas->glyph_capacity = 0;
+	atlas->used           = 0;
+	if ( NULL == (atlas->font = strdup(font)) )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		free(atlas);
+		return NULL;
+	}
+	wl_list_insert(&atlases, &atlas->link);
+
+	/* All cells share the height of the font. */
+	cairo_surface_t *scratch = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+	cairo_t *scratch_cairo = cairo_create(scratch);
+	set_font(scratch_cairo, atlas);
+	cairo_font_extents_t font_extents;
+	cairo_font_extents(scratch_cairo, &font_extents);
+	cairo_destroy(scratch_cairo);
+	cairo_surface_destroy(scratch);
+
+	atlas->ascent = ceil(font_extents.ascent) + CELL_MARGIN;
+	atlas->height = (int32_t)(atlas->ascent + ceil(font_extents.descent)) + CELL_MARGIN;
+	atlas->width  = ATLAS_INITIAL_WIDTH;
+	atlas->surface = cairo_image_surface_create(CAIRO_FORMAT_A8, atlas->width, atlas->height);
+	if ( cairo_surface_status(atlas->surface) != CAIRO_STATUS_SUCCESS )
+	{
+		log_message(0, "ERROR: Can not create glyph atlas.\n");
+		destroy_atlas(atlas);
+		return NULL;
+	}
+
+	return atlas;
+}
+
+static struct Lava_glyph_atlas *get_atlas (const char *font, uint32_t pixel_size)
+{
+	struct Lava_glyph_atlas *atlas;
+	wl_list_for_each(atlas, &atlases, link)
+		if ( atlas->pixel_size == pixel_size && ! strcmp(atlas->font, font) )
+			return atlas;
+	return create_atlas(font, pixel_size);
+}
+
+/* Make room for a cell of the given width at the end of the atlas. */
+static bool grow_atlas (struct Lava_glyph_atlas *atlas, int32_t cell_w)
+{
+	if ( atlas->used + cell_w <= atlas->width )
+		return true;
+
+	int32_t width = atlas->width * 2;
+	if ( width < atlas->used + cell_w )
+		width = atlas->used + cell_w;
+
+	cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_A8, width, atlas->height);
+	if ( cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS )
+	{
+		log_message(0, "ERROR: Can not grow glyph atlas.\n");
+		cairo_surface_destroy(surface);
+		return false;
+	}
+
+	cairo_t *cairo = cairo_create(surface);
+	cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cairo, atlas->surface, 0, 0);
+	cairo_paint(cairo);
+	cairo_destroy(cairo);
+
+	cairo_surface_destroy(atlas->surface);
+	atlas->surface = surface;
+	atlas->width   = width;
+	return true;
+}
+
+/* Render the glyph of the UTF-8 sequence into a new cell. */
+static struct Lava_glyph *add_glyph (struct Lava_glyph_atlas *atlas, uint32_t codepoint,
+		const char *sequence, size_t length)
+{
+	if ( atlas->glyph_count == atlas->glyph_capacity )
+	{
+		const size_t capacity = atlas->glyph_capacity == 0 ? 32 : atlas->glyph_capacity * 2;
+		struct Lava_glyph *glyphs = realloc(atlas->glyphs, capacity * sizeof(struct Lava_glyph));
+		if ( glyphs == NULL )
+		{
+			log_message(0, "ERROR: Can not allocate.\n");
+			return NULL;
+		}
+		atlas->glyphs         = glyphs;
+		atlas->glyph_capacity = capacity;
+	}
+
+	char text[5] = { 0 };
+	memcpy(text, sequence, length);
+
+	cairo_t *cairo = cairo_create(atlas->surface);
+	set_font(cairo, atlas);
+	cairo_text_extents_t extents;
+	cairo_text_extents(cairo, text, &extents);
+
+	const int32_t left  = (int32_t)floor(extents.x_bearing) - CELL_MARGIN;
+	const int32_t right = (int32_t)ceil(extents.x_bearing + extents.width) + CELL_MARGIN;
+	const int32_t cell_w = extents.width > 0 ? right - left : 0;
+
+	if (! grow_atlas(atlas, cell_w))
+	{
+		cairo_destroy(cairo);
+		return NULL;
+	}
+	if ( cell_w > 0 )
+	{
+		/* The surface may have been replaced while growing. */
+		cairo_destroy(cairo);
+		cairo = cairo_create(atlas->surface);
+		set_font(cairo, atlas);
+		cairo_rectangle(cairo, atlas->used, 0, cell_w, atlas->height);
+		cairo_clip(cairo);
+		cairo_move_to(cairo, atlas->used - left, atlas->ascent);
+		cairo_show_text(cairo, text);
+		cairo_surface_flush(atlas->surface);
+	}
+	cairo_destroy(cairo);
+
+	struct Lava_glyph *glyph = &atlas->glyphs[atlas->glyph_count++];
+	glyph->codepoint = codepoint;
+	glyph->cell_x    = atlas->used;
+	glyph->cell_w    = cell_w;
+	glyph->offset    = left;
+	glyph->advance   = extents.x_advance;
+	atlas->used += cell_w;
+	return glyph;
+}
+
+static struct Lava_glyph *get_glyph (struct Lava_glyph_atlas *atlas, uint32_t codepoint,
+		const char *sequence, size_t length)
+{
+	for (size_t i = 0; i < atlas->glyph_count; i++)
+		if ( atlas->glyphs[i].codepoint == codepoint )
+			return &atlas->glyphs[i];
+	return add_glyph(atlas, codepoint, sequence, length);
+}
+
+/* Decode the UTF-8 sequence at the start of the string. Returns its length,
+ * or 0 if it is invalid.
+ */
+static size_t decode_utf8 (const char *str, uint32_t *codepoint)
+{
+	const unsigned char *s = (const unsigned char *)str;
+	size_t length;
+	if ( s[0] < 0x80 )
+	{
+		*codepoint = s[0];
+		return 1;
+	}
+	else if ( (s[0] & 0xE0) == 0xC0 )
+	{
+		*codepoint = s[0] & 0x1F;
+		length = 2;
+	}
+	else if ( (s[0] & 0xF0) == 0xE0 )
+	{
+		*codepoint = s[0] & 0x0F;
+		length = 3;
+	}
+	else if ( (s[0] & 0xF8) == 0xF0 )
+	{
+		*codepoint = s[0] & 0x07;
+		length = 4;
+	}
+	else
+		return 0;
+
+	for (size_t i = 1; i < length; i++)
+	{
+		if ( (s[i] & 0xC0) != 0x80 )
+			return 0;
+		*codepoint = (*codepoint << 6) | (s[i] & 0x3F);
+	}
+	return length;
+}
+
+/* Draw the label centered into the given area, shrunk if it is too wide. The
+ * area is in buffer pixels.
+ */
+void label_draw_to_cairo (cairo_t *cairo, const char *text, const char *font,
+		colour_t *colour, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+	const uint32_t pixel_size = (uint32_t)(height * LABEL_FONT_SCALE);
+	if ( pixel_size == 0 )
+		return;
+
+	struct Lava_glyph_atlas *atlas = get_atlas(font, pixel_size);
+	if ( atlas == NULL )
+		return;
+
+	/* Look up all glyphs first, as adding one may replace the atlas surface. */
+	double text_width = 0;
+	for (const char *i = text; *i != '\0';)
+	{
+		uint32_t codepoint;
+		size_t length = decode_utf8(i, &codepoint);
+		if ( length == 0 )
+		{
+			i++;
+			continue;
+		}
+		struct Lava_glyph *glyph = get_glyph(atlas, codepoint, i, length);
+		if ( glyph != NULL )
+			text_width += round(glyph->advance);
+		i += length;
+	}
+	if ( text_width <= 0 )
+		return;
+
+	const double factor = text_width > width ? width / text_width : 1.0;
+
+	cairo_save(cairo);
+	ubox_t area = { .x = x, .y = y, .w = width, .h = height };
+	colour_t_set_cairo_source(cairo, colour, &area);
+	cairo_translate(cairo, round(x + (width - (text_width * factor)) / 2),
+			round(y + (height - (atlas->height * factor)) / 2));
+	cairo_scale(cairo, factor, factor);
+
+	double pen = 0;
+	for (const char *i = text; *i != '\0';)
+	{
+		uint32_t codepoint;
+		size_t length = decode_utf8(i, &codepoint);
+		if ( length == 0 )
+		{
+			i++;
+			continue;
+		}
+		struct Lava_glyph *glyph = get_glyph(atlas, codepoint, i, length);
+		i += length;
+		if ( glyph == NULL )
+			continue;
+
+		if ( glyph->cell_w > 0 )
+		{
+			cairo_save(cairo);
+			cairo_rectangle(cairo, pen + glyph->offset, 0, glyph->cell_w, atlas->height);
+			cairo_clip(cairo);
+			cairo_mask_surface(cairo, atlas->surface, pen + glyph->offset - glyph->cell_x, 0);
+			cairo_restore(cairo);
+		}
+		pen += round(glyph->advance);
+	}
+
+	cairo_restore(cairo);
+}
+
+size_t glyph_atlas_memory (void)
+{
+	size_t bytes = 0;
+	struct Lava_glyph_atlas *atlas;
+	wl_list_for_each(atlas, &atlases, link)
+		bytes += sizeof(struct Lava_glyph_atlas) + strlen(atlas->font) + 1
+			+ atlas->glyph_capacity * sizeof(struct Lava_glyph)
+			+ (size_t)cairo_image_surface_get_stride(atlas->surface)
+			* (size_t)atlas->height;
+	return bytes;
+}
+
+void destroy_glyph_atlases (void)
+{
+	struct Lava_glyph_atlas *atlas, *tmp;
+	wl_list_for_each_safe(atlas, tmp, &atlases, link)
+		destroy_atlas(atlas);
+}
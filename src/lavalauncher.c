@@ -27,12 +27,19 @@
 #include<getopt.h>
 
 #include"bar.h"
+#include"output.h"
 #include"config.h"
 #include"event-loop.h"
 #include"lavalauncher.h"
 #include"str.h"
 #include"wayland-connection.h"
 #include"misc-event-sources.h"
+#include"dbus.h"
+#include"desktop-entry.h"
+#include"reload.h"
+#include"decode-helper.h"
+#include"label.h"
+#include"memory-report.h"
 
 /* The context is used basically everywhere. So instead of passing pointers
  * around, just have it global.
@@ -127,8 +134,10 @@ static void init_context (void)
 	context.config_path = NULL;
 
 #if WATCH_CONFIG
-	context.watch = false;
+	context.watch        = false;
+	context.watch_images = false;
 #endif
+	context.sandbox_decode = false;
 
 	context.display            = NULL;
 	context.registry           = NULL;
@@ -138,9 +147,13 @@ static void init_context (void)
 	context.shm                = NULL;
 	context.layer_shell        = NULL;
 	context.xdg_output_manager = NULL;
+	context.empty_region       = NULL;
 
 	context.river_status_manager = NULL;
 	context.need_river_status    = false;
+	context.need_foreign_toplevel = false;
+	context.need_dbus            = false;
+	context.xdg_activation       = NULL;
 
 	context.need_keyboard = false;
 	context.need_pointer  = false;
@@ -148,6 +161,7 @@ static void init_context (void)
 
 	wl_list_init(&context.bars);
 	context.last_bar = NULL;
+	wl_list_init(&context.includes);
 
 	wl_list_init(&context.outputs);
 	wl_list_init(&context.seats);
@@ -155,6 +169,9 @@ static void init_context (void)
 
 int main (int argc, char *argv[])
 {
+	if ( argc == 2 && ! strcmp(argv[1], DECODE_HELPER_ARGUMENT) )
+		return decode_helper_main();
+
 reload:
 	init_context();
 
@@ -170,10 +187,29 @@ reload:
 		if (! get_default_config_path())
 			return EXIT_FAILURE;
 
+	/* Connect to the Wayland server first, so the compositor can send us
+	 * its globals while we are busy parsing the configuration file.
+	 */
+	if (! connect_wayland())
+		goto exit;
+
 	/* Try to parse the configuration file. If this fails, there might
 	 * already be heap objects, so some cleanup is needed.
 	 */
-	if (! parse_config_file())
+	struct Lava_generation generation;
+	generation_init(&generation);
+	const bool parsed = parse_config_file(&generation);
+	install_generation(&generation);
+	if (! parsed)
+		goto exit;
+
+	/* Bind the globals the configuration needs and request the output
+	 * information. The compositor answers those requests while the images
+	 * are decoded, instead of us idling in a blocking roundtrip.
+	 */
+	if (! init_wayland())
+		goto exit;
+	if (! load_all_bar_images(&context.bars, context.sandbox_decode, get_max_output_scale()))
 		goto exit;
 
 	context.ret = EXIT_SUCCESS;
@@ -182,9 +218,14 @@ reload:
 	struct Lava_event_loop loop;
 	event_loop_init(&loop);
 	event_loop_add_event_source(&loop, &wayland_source);
+	event_loop_add_event_source(&loop, &reload_source);
+	if (context.need_dbus)
+		event_loop_add_event_source(&loop, &dbus_source);
 #if WATCH_CONFIG
 	if (context.watch)
 		event_loop_add_event_source(&loop, &inotify_source);
+	if (context.watch_images)
+		event_loop_add_event_source(&loop, &image_watch_source);
 #endif
 #if HANDLE_SIGNALS
 	event_loop_add_event_source(&loop, &signal_source);
@@ -193,12 +234,18 @@ reload:
 	/* Run the event loop. */
 	if (! event_loop_run(&loop))
 		context.ret = EXIT_FAILURE;
+	log_memory_report(1);
 
 exit:
+	finish_wayland();
 	free(context.config_path);
 
 	/* Clean up objects created when parsing the configuration file. */
-	destroy_all_bars();
+	destroy_all_bars(&context.bars);
+	destroy_all_includes(&context.includes);
+	destroy_desktop_entry_index();
+	stop_decode_helpers();
+	destroy_glyph_atlases();
 
 	if (context.reload)
 		goto reload;
@@ -67,6 +67,9 @@ struct Lava_context
 	struct wl_display             *display;
 	struct wl_registry            *registry;
 
+	/* Events of seats and their input devices, dispatched before all others. */
+	struct wl_event_queue         *input_queue;
+
 	/* Wayland interfaces */
 	struct wl_compositor          *compositor;
 	struct wl_subcompositor       *subcompositor;
@@ -74,9 +77,17 @@ struct Lava_context
 	struct zwlr_layer_shell_v1    *layer_shell;
 	struct zxdg_output_manager_v1 *xdg_output_manager;
 
+	/* Shared by all surfaces which do not take any input. */
+	struct wl_region              *empty_region;
+
 	/* Optional Wayland interfaces */
 	struct zriver_status_manager_v1 *river_status_manager;
 	bool need_river_status;
+	bool need_foreign_toplevel;
+
+	/* Does any button use D-Bus activation? */
+	bool need_dbus;
+	struct xdg_activation_v1        *xdg_activation;
 
 	/* Which input devices do we need? */
 	bool need_keyboard;
@@ -85,8 +96,15 @@ struct Lava_context
 
 	char *config_path;
 
+	/* Hash of the content of the configuration file and all fragments. */
+	uint64_t config_hash;
+
+	/* Decode images in sandboxed helper processes? */
+	bool sandbox_decode;
+
 	struct wl_list bars;
 	struct Lava_bar *last_bar;
+	struct wl_list includes;
 
 	struct wl_list outputs;
 	struct wl_list seats;
@@ -98,6 +116,7 @@ struct Lava_context
 
 #ifdef WATCH_CONFIG
 	bool watch;
+	bool watch_images;
 #endif
 };
 
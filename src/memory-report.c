@@ -0,0 +1,223 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<cairo/cairo.h>
+
+#include<wayland-client.h>
+#include<wayland-cursor.h>
+
+#include"lavalauncher.h"
+#include"str.h"
+#include"bar.h"
+#include"item.h"
+#include"seat.h"
+#include"output.h"
+#include"label.h"
+#include"tooltip.h"
+#include"memory-report.h"
+#include"types/buffer.h"
+#include"types/colour_t.h"
+#include"types/image_t.h"
+
+/* Breaks down the memory used by LavaLauncher. Only memory LavaLauncher
+ * explicitly allocates for its objects is counted, not the overhead of the
+ * allocator or of the libraries, so the numbers are lower bounds.
+ *
+ * The memory of the images, configuration sets and items belongs to a bar
+ * and is shared by all its instances, so it is reported once per bar.
+ */
+
+static size_t buffers_memory (struct Lava_buffer buffers[static 2])
+{
+	size_t bytes = 0;
+	for (int i = 0; i < 2; i++)
+		if ( buffers[i].memory_object != NULL )
+			bytes += buffers[i].size;
+	return bytes;
+}
+
+static size_t image_surface_memory (cairo_surface_t *surface)
+{
+	if ( surface == NULL || cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE )
+		return 0;
+	return (size_t)cairo_image_surface_get_stride(surface)
+		* (size_t)cairo_image_surface_get_height(surface);
+}
+
+static size_t string_memory (const char *str)
+{
+	return str == NULL ? 0 : strlen(str) + 1;
+}
+
+static size_t colour_memory (colour_t *colour)
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < COLOUR_T_STRIP_CACHE_SIZE; i++)
+		bytes += image_surface_memory(colour->strips[i].surface);
+	return bytes;
+}
+
+static void log_instance_memory (int level, struct Lava_bar_instance *instance)
+{
+	const size_t bar   = buffers_memory(instance->bar_buffers);
+	const size_t icons = buffers_memory(instance->icon_buffers);
+
+	size_t item_surfaces = 0;
+	struct Lava_item_surface *item_surface;
+	if (instance->separate_icon_surfaces)
+		wl_list_for_each(item_surface, &instance->item_surfaces, link)
+			item_surfaces += buffers_memory(item_surface->buffers);
+
+	size_t indicators = 0;
+	struct Lava_item_indicator *indicator;
+	wl_list_for_each(indicator, &instance->indicators, link)
+		indicators += buffers_memory(indicator->indicator_buffers);
+
+	size_t tooltips = 0;
+	struct Lava_tooltip_raster *raster;
+	wl_list_for_each(raster, &instance->tooltip.rasters, link)
+		tooltips += buffers_memory(raster->buffers);
+
+	log_message(level, "[memory] Bar instance on output %s (global_name=%d scale=%d): %zu bytes\n"
+			"[memory]     bar buffers:          %zu\n"
+			"[memory]     icon buffers:         %zu\n"
+			"[memory]     item surface buffers: %zu\n"
+			"[memory]     indicator buffers:    %zu\n"
+			"[memory]     tooltip buffers:      %zu\n",
+			instance->output->name != NULL ? instance->output->name : "(unnamed)",
+			instance->output->global_name, instance->output->scale,
+			bar + icons + item_surfaces + indicators + tooltips,
+			bar, icons, item_surfaces, indicators, tooltips);
+}
+
+static bool image_counted (struct Lava_bar *bar, struct Lava_item *until, image_t *image)
+{
+	struct Lava_item *item;
+	wl_list_for_each(item, &bar->items, link)
+	{
+		if ( item == until )
+			return false;
+		if ( item->img == image )
+			return true;
+	}
+	return false;
+}
+
+static void log_bar_memory (int level, struct Lava_bar *bar, int index)
+{
+	size_t images = 0, svg_images = 0;
+	size_t items = 0;
+	struct Lava_item *item;
+	wl_list_for_each(item, &bar->items, link)
+	{
+		items += sizeof(struct Lava_item) + string_memory(item->img_path)
+			+ string_memory(item->label) + string_memory(item->tooltip);
+
+		struct Lava_item_command *cmd;
+		wl_list_for_each(cmd, &item->commands, link)
+			items += sizeof(struct Lava_item_command) + string_memory(cmd->command);
+
+		if ( item->img == NULL || image_counted(bar, item, item->img) )
+			continue;
+		images += sizeof(image_t) + string_memory(item->img->path)
+			+ image_surface_memory(item->img->cairo_surface);
+#if SVG_SUPPORT
+		if ( item->img->rsvg_handle != NULL )
+			svg_images++;
+#endif
+	}
+
+	size_t configs = 0;
+	struct Lava_bar_configuration *config;
+	wl_list_for_each(config, &bar->configs, link)
+		configs += sizeof(struct Lava_bar_configuration)
+			+ string_memory(config->only_output)
+			+ string_memory(config->namespace)
+			+ string_memory(config->cursor_name)
+			+ string_memory(config->label_font)
+			+ colour_memory(&config->bar_colour)
+			+ colour_memory(&config->border_colour)
+			+ colour_memory(&config->indicator_hover_colour)
+			+ colour_memory(&config->indicator_active_colour)
+			+ colour_memory(&config->tooltip_colour)
+			+ colour_memory(&config->label_colour);
+
+	log_message(level, "[memory] Bar %d, shared by its instances: %zu bytes\n"
+			"[memory]     images:               %zu\n"
+			"[memory]     items:                %zu\n"
+			"[memory]     configuration sets:   %zu\n",
+			index, images + items + configs, images, items, configs);
+
+	/* librsvg does not tell how much memory a handle uses. */
+	if ( svg_images > 0 )
+		log_message(level, "[memory]     not counted: %zu SVG image(s) held by librsvg\n",
+				svg_images);
+}
+
+/* The cursor theme does not expose its buffer, so only the images of the
+ * current cursor are counted.
+ */
+static size_t cursor_memory (void)
+{
+	size_t bytes = 0;
+	struct Lava_seat *seat;
+	wl_list_for_each(seat, &context.seats, link)
+	{
+		struct wl_cursor *cursor = seat->pointer.cursor;
+		if ( cursor == NULL )
+			continue;
+		for (unsigned int i = 0; i < cursor->image_count; i++)
+			bytes += (size_t)cursor->images[i]->width * cursor->images[i]->height * 4;
+	}
+	return bytes;
+}
+
+void log_memory_report (int level)
+{
+	if ( context.verbosity < level )
+		return;
+
+	log_message(level, "[memory] Memory report:\n");
+
+	struct Lava_output *output;
+	wl_list_for_each(output, &context.outputs, link)
+	{
+		struct Lava_bar_instance *instance;
+		wl_list_for_each(instance, &output->bar_instances, link)
+			log_instance_memory(level, instance);
+	}
+
+	int index = 0;
+	struct Lava_bar *bar;
+	wl_list_for_each(bar, &context.bars, link)
+		log_bar_memory(level, bar, index++);
+
+	log_message(level, "[memory] Shared by all bars:\n"
+			"[memory]     glyph atlases:        %zu\n"
+			"[memory]     cursor images:        %zu\n",
+			glyph_atlas_memory(), cursor_memory());
+}
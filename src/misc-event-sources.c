@@ -39,6 +39,14 @@
 #include"lavalauncher.h"
 #include"event-loop.h"
 #include"str.h"
+#include"bar.h"
+#include"item.h"
+#include"output.h"
+#include"desktop-entry.h"
+#include"reload.h"
+#include"memory-report.h"
+#include"config.h"
+#include"types/image_t.h"
 
 /**************************
  *                        *
@@ -46,6 +54,25 @@
  *                        *
  **************************/
 #if WATCH_CONFIG
+#define INCLUDE_WATCH_MASK (IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+static int config_watch_fd = -1;
+
+/* Included files and directories can change with every reload. Watches of
+ * includes which are gone are left in place, they only cause a reload which
+ * does not parse anything but the configuration file.
+ */
+void config_watch_add_includes (void)
+{
+	if ( config_watch_fd == -1 )
+		return;
+
+	struct Lava_include *include;
+	wl_list_for_each(include, &context.includes, link)
+		if ( -1 == inotify_add_watch(config_watch_fd, include->path, INCLUDE_WATCH_MASK) )
+			log_message(1, "[loop] Can not watch include %s: %s\n", include->path, strerror(errno));
+}
+
 static bool inotify_source_init (struct pollfd *fd)
 {
 	log_message(1, "[loop] Setting up inotify event source.\n");
@@ -57,6 +84,7 @@ static bool inotify_source_init (struct pollfd *fd)
 				"ERROR: inotify_init1: %s\n", strerror(errno));
 		return false;
 	}
+	config_watch_fd = fd->fd;
 
 	/* Add config file to inotify watch list. */
 	if ( -1 == inotify_add_watch(fd->fd, context.config_path, IN_MODIFY) )
@@ -64,6 +92,11 @@ static bool inotify_source_init (struct pollfd *fd)
 		log_message(0, "ERROR: Unable to add config path to inotify watchlist.\n");
 		return false;
 	}
+	config_watch_add_includes();
+
+	/* Desktop entries are resolved when the configuration is parsed. */
+	if (! desktop_entry_watch_directories(fd->fd))
+		return false;
 
 	return true;
 }
@@ -72,6 +105,7 @@ static bool inotify_source_finish (struct pollfd *fd)
 {
 	if ( fd->fd != -1 )
 		close(fd->fd);
+	config_watch_fd = -1;
 	return true;
 }
 
@@ -83,8 +117,12 @@ static bool inotify_source_flush (struct pollfd *fd)
 static bool inotify_source_handle_in (struct pollfd *fd)
 {
 	log_message(1, "[main] Config file modified; Triggering reload.\n");
-	context.loop = false;
-	context.reload = true;
+
+	/* Drain the events, a single reload covers all of them. */
+	_Alignas(struct inotify_event) char buffer[4096];
+	while ( read(fd->fd, buffer, sizeof(buffer)) > 0 );
+
+	request_reload();
 	return true;
 }
 
@@ -102,6 +140,166 @@ struct Lava_event_source inotify_source = {
 };
 #endif
 
+/******************************
+ *                            *
+ *  Image watch event source  *
+ *                            *
+ ******************************/
+#if WATCH_CONFIG
+/* Files are often written in multiple steps, so changes are collected for a
+ * short while before the images are re-loaded.
+ */
+#define IMAGE_WATCH_DEBOUNCE_MS 100
+#define IMAGE_WATCH_MASK (IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+
+static int image_watch_fd = -1;
+static struct Lava_timer image_watch_timer;
+
+/* Changed images are only re-loaded once a bar instance is visible. */
+static struct wl_listener image_watch_visibility_listener;
+static bool image_watch_deferred = false;
+
+static void image_watch_add (image_t *image)
+{
+	if ( image->path == NULL )
+		return;
+	if ( -1 == (image->watch = inotify_add_watch(image_watch_fd, image->path, IMAGE_WATCH_MASK)) )
+		log_message(1, "[loop] Can not watch image %s: %s\n", image->path, strerror(errno));
+}
+
+static void image_watch_handle_timer (struct Lava_timer *timer)
+{
+	if (! any_bar_instance_visible())
+	{
+		log_message(2, "[loop] No bar visible, deferring image re-load.\n");
+		image_watch_deferred = true;
+		return;
+	}
+	image_watch_deferred = false;
+
+	/* Files replaced by renaming a new file over them need a new watch. */
+	struct Lava_bar *bar;
+	struct Lava_item *item;
+	wl_list_for_each(bar, &context.bars, link)
+		wl_list_for_each(item, &bar->items, link)
+			if ( item->img != NULL && item->img->changed )
+				image_watch_add(item->img);
+
+	reload_changed_images();
+}
+
+static void image_watch_handle_visibility (struct wl_listener *listener, void *data)
+{
+	if ( image_watch_deferred && any_bar_instance_visible() )
+		timer_arm(&image_watch_timer, 0);
+}
+
+void image_watch_add_all (void)
+{
+	struct Lava_bar *bar;
+	struct Lava_item *item;
+	wl_list_for_each(bar, &context.bars, link)
+		wl_list_for_each(item, &bar->items, link)
+			if ( item->img != NULL )
+				image_watch_add(item->img);
+}
+
+/* Stop watching the images of the current bars, which are about to be replaced. */
+void image_watch_remove_all (void)
+{
+	if ( image_watch_fd == -1 )
+		return;
+
+	struct Lava_bar *bar;
+	struct Lava_item *item;
+	wl_list_for_each(bar, &context.bars, link)
+		wl_list_for_each(item, &bar->items, link)
+	{
+		if ( item->img == NULL || item->img->watch == -1 )
+			continue;
+		inotify_rm_watch(image_watch_fd, item->img->watch);
+		item->img->watch = -1;
+	}
+}
+
+static bool image_watch_source_init (struct pollfd *fd)
+{
+	log_message(1, "[loop] Setting up image watch event source.\n");
+
+	fd->events = POLLIN;
+	if ( -1 == (fd->fd = image_watch_fd = inotify_init1(IN_NONBLOCK)) )
+	{
+		log_message(0, "ERROR: Unable to open inotify fd.\n"
+				"ERROR: inotify_init1: %s\n", strerror(errno));
+		return false;
+	}
+
+	timer_init(&image_watch_timer, image_watch_handle_timer, NULL);
+	image_watch_add_all();
+
+	image_watch_visibility_listener.notify = image_watch_handle_visibility;
+	add_bar_instance_visibility_listener(&image_watch_visibility_listener);
+
+	return true;
+}
+
+static bool image_watch_source_finish (struct pollfd *fd)
+{
+	timer_disarm(&image_watch_timer);
+	wl_list_remove(&image_watch_visibility_listener.link);
+	image_watch_deferred = false;
+	if ( fd->fd != -1 )
+		close(fd->fd);
+	image_watch_fd = -1;
+	return true;
+}
+
+static bool image_watch_source_flush (struct pollfd *fd)
+{
+	return true;
+}
+
+static bool image_watch_source_handle_in (struct pollfd *fd)
+{
+	_Alignas(struct inotify_event) char buffer[4096];
+	for (;;)
+	{
+		ssize_t len = read(fd->fd, buffer, sizeof(buffer));
+		if ( len <= 0 )
+			break;
+
+		for (char *ptr = buffer; ptr < buffer + len; )
+		{
+			const struct inotify_event *event = (const struct inotify_event *)ptr;
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			struct Lava_bar *bar;
+			struct Lava_item *item;
+			wl_list_for_each(bar, &context.bars, link)
+				wl_list_for_each(item, &bar->items, link)
+					if ( item->img != NULL && item->img->watch == event->wd )
+						item->img->changed = true;
+		}
+	}
+
+	timer_arm(&image_watch_timer, IMAGE_WATCH_DEBOUNCE_MS);
+	return true;
+}
+
+static bool image_watch_source_handle_out (struct pollfd *fd)
+{
+	return true;
+}
+
+struct Lava_event_source image_watch_source = {
+	.init       = image_watch_source_init,
+	.finish     = image_watch_source_finish,
+	.flush      = image_watch_source_flush,
+	.handle_in  = image_watch_source_handle_in,
+	.handle_out = image_watch_source_handle_out
+};
+#endif
+
 /*************************
  *                       *
  *  Signal event source  *
@@ -119,6 +317,7 @@ static bool signal_source_init (struct pollfd *fd)
 	sigaddset(&mask, SIGQUIT);
 	sigaddset(&mask, SIGUSR1);
 	sigaddset(&mask, SIGUSR2);
+	sigaddset(&mask, SIGRTMIN);
 
 	if ( sigprocmask(SIG_BLOCK, &mask, NULL) == -1 )
 	{
@@ -166,10 +365,15 @@ static bool signal_source_handle_in (struct pollfd *fd)
 	}
 	else if ( fdsi.ssi_signo == SIGUSR1 || fdsi.ssi_signo == SIGUSR2 )
 	{
-		log_message(1, "[loop] Received SIGUSR; Triggering reload.\n");
-		context.loop = false;
-		context.reload = true;
-		return false;
+		log_message(1, "[loop] Received SIGUSR1 or SIGUSR2; Triggering reload.\n");
+		request_reload();
+		return true;
+	}
+	else if ( fdsi.ssi_signo == (uint32_t)SIGRTMIN )
+	{
+		log_message(1, "[loop] Received SIGRTMIN; Reporting memory usage.\n");
+		log_memory_report(0);
+		return true;
 	}
 
 	return true;
@@ -23,7 +23,14 @@
 struct Lava_ecent_source;
 
 extern struct Lava_event_source inotify_source;
+extern struct Lava_event_source image_watch_source;
 extern struct Lava_event_source signal_source;
 
+#if WATCH_CONFIG
+void config_watch_add_includes (void);
+void image_watch_add_all (void);
+void image_watch_remove_all (void);
+#endif
+
 #endif
 
@@ -38,12 +38,13 @@
 #include"str.h"
 #include"output.h"
 #include"bar.h"
+#include"reload.h"
 
 /* No-Op function. */
 static void noop (void) {}
 
 /* Loop through all bar patterns and create / destroy / update their instances on this output. */
-static bool update_bar_instances_on_output (struct Lava_output *output)
+bool update_bar_instances_on_output (struct Lava_output *output)
 {
 	/* No xdg_output events have been received yet, so there is nothing todo. */
 	if ( output->status == OUTPUT_STATUS_UNCONFIGURED || output->name == NULL )
@@ -79,7 +80,7 @@ static bool update_bar_instances_on_output (struct Lava_output *output)
 			 * If we do not have a configuration set, then config == NULL, which
 			 * will cause the destruction of the instance.
 			 */
-			instance->config = config;
+			bar_instance_set_config(instance, config);
 			update_bar_instance(instance, true, false);
 		}
 		else if ( config != NULL )
@@ -135,6 +136,7 @@ static void output_handle_done (void *data, struct wl_output *wl_output)
 				output->global_name);
 
 	update_bar_instances_on_output(output);
+	rescale_images();
 }
 
 static const struct wl_output_listener output_listener = {
@@ -298,6 +300,16 @@ struct Lava_output *get_output_from_global_name (uint32_t name)
 	return NULL;
 }
 
+uint32_t get_max_output_scale (void)
+{
+	uint32_t scale = 1;
+	struct Lava_output *output;
+	wl_list_for_each(output, &context.outputs, link)
+		if ( output->scale > scale )
+			scale = output->scale;
+	return scale;
+}
+
 void destroy_output (struct Lava_output *output)
 {
 	if ( output == NULL )
@@ -60,7 +60,9 @@ struct Lava_output
 bool create_output (struct wl_registry *registry, uint32_t name,
 		const char *interface, uint32_t version);
 bool configure_output (struct Lava_output *output);
+bool update_bar_instances_on_output (struct Lava_output *output);
 struct Lava_output *get_output_from_global_name (uint32_t name);
+uint32_t get_max_output_scale (void);
 void destroy_output (struct Lava_output *output);
 void destroy_all_outputs (void);
 
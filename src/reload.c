@@ -0,0 +1,582 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<unistd.h>
+#include<string.h>
+#include<poll.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<pthread.h>
+
+#include"lavalauncher.h"
+#include"str.h"
+#include"config.h"
+#include"event-loop.h"
+#include"bar.h"
+#include"item.h"
+#include"seat.h"
+#include"output.h"
+#include"reload.h"
+#include"desktop-entry.h"
+#include"misc-event-sources.h"
+#include"decode-helper.h"
+#include"types/image_t.h"
+
+/* A reload parses the configuration file and decodes all images on a worker
+ * thread, while the current bars keep handling input. The worker then wakes
+ * up the main thread through a pipe and the main thread swaps in the new
+ * generation. If the new configuration is broken, the current one is kept.
+ * Unchanged fragments are not parsed again and their bars keep their instances.
+ *
+ * Besides the generation it builds, the worker only touches the desktop entry
+ * index, which the main thread does not use while the loop runs, and the image
+ * libraries, which guard their loading themselves. It also reads the installed
+ * fragments, which only change when a generation is swapped in.
+ *
+ * With sandboxed decoding, the worker also re-decodes changed images, so the
+ * main thread never waits for a decode helper. The new surfaces are applied
+ * once the worker wakes up the main thread.
+ */
+static pthread_t worker;
+static bool worker_running = false;
+static bool reload_pending = false;
+static bool images_pending = false;
+static int wake_pipe[2] = { -1, -1 };
+
+/* Only accessed by the main thread while the worker is not running. */
+static struct Lava_generation *building = NULL;
+static uint32_t building_scale = 1;
+static bool building_success = false;
+
+/* Bars replaced by a reload. Their instances stay on screen until all new
+ * instances on the same output have drawn their first frame, so that the
+ * bars do not blink and exclusive zones do not collapse in between. If the
+ * compositor does not configure the new instances in time, the old ones are
+ * removed anyway.
+ */
+#define RETIRE_TIMEOUT_MS 1000
+static struct wl_list retired_bars = { .prev = &retired_bars, .next = &retired_bars };
+static struct Lava_timer retire_timer, retire_timeout;
+
+/* Images re-decoded by the worker, which holds a reference to each of them.
+ * Only accessed by the main thread while the worker is not running.
+ */
+static struct Lava_decode_job *image_jobs = NULL;
+static image_t **image_targets = NULL;
+static size_t image_job_count = 0;
+
+static void destroy_generation (struct Lava_generation *generation)
+{
+	destroy_all_bars(&generation->bars);
+	destroy_all_includes(&generation->includes);
+	free(generation);
+}
+
+static void wake_main_thread (void)
+{
+	const char byte = 0;
+	if ( write(wake_pipe[1], &byte, 1) != 1 )
+		log_message(0, "ERROR: Can not wake up main thread: %s\n", strerror(errno));
+}
+
+static void *reload_worker (void *data)
+{
+	struct Lava_generation *generation = (struct Lava_generation *)data;
+
+	/* The desktop entries may have changed as well. */
+	destroy_desktop_entry_index();
+
+	building_success = parse_config_file(generation)
+		&& load_all_bar_images(&generation->bars, generation->sandbox_decode, building_scale);
+
+	wake_main_thread();
+	return NULL;
+}
+
+static void *image_worker (void *data)
+{
+	decode_images_sandboxed(image_jobs, image_job_count);
+	wake_main_thread();
+	return NULL;
+}
+
+static void full_reload (void)
+{
+	context.loop   = false;
+	context.reload = true;
+}
+
+void request_reload (void)
+{
+	if (worker_running)
+	{
+		reload_pending = true;
+		return;
+	}
+
+	if ( wake_pipe[0] == -1 )
+	{
+		full_reload();
+		return;
+	}
+
+	log_message(1, "[reload] Reloading configuration in the background.\n");
+
+	if ( NULL == (building = calloc(1, sizeof(struct Lava_generation))) )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		return;
+	}
+	generation_init(building);
+	building_scale = get_max_output_scale();
+
+	if ( pthread_create(&worker, NULL, reload_worker, building) != 0 )
+	{
+		log_message(0, "ERROR: Can not start reload thread; Restarting instead.\n");
+		DESTROY_NULL(building, free);
+		full_reload();
+		return;
+	}
+	worker_running = true;
+}
+
+/* Changes to the input devices and Wayland interfaces a configuration needs
+ * can not be applied to the running instance.
+ */
+static bool generation_fits_context (struct Lava_generation *generation)
+{
+	return generation->need_keyboard == context.need_keyboard
+		&& generation->need_pointer == context.need_pointer
+		&& generation->need_touch == context.need_touch
+		&& generation->need_river_status == context.need_river_status
+		&& generation->need_foreign_toplevel == context.need_foreign_toplevel
+		&& generation->need_dbus == context.need_dbus
+#if WATCH_CONFIG
+		&& generation->watch == context.watch
+		&& generation->watch_images == context.watch_images
+#endif
+		;
+}
+
+static bool bar_is_retired (struct Lava_bar *bar)
+{
+	struct Lava_bar *retired;
+	wl_list_for_each(retired, &retired_bars, link)
+		if ( retired == bar )
+			return true;
+	return false;
+}
+
+/* Whether all instances of current bars on the output have been drawn. */
+static bool output_has_new_frames (struct Lava_output *output)
+{
+	struct Lava_bar_instance *instance;
+	wl_list_for_each(instance, &output->bar_instances, link)
+		if ( ! instance->drawn && ! bar_is_retired(instance->bar) )
+			return false;
+	return true;
+}
+
+/* Destroy the instances of replaced bars on all outputs where the new
+ * instances are ready, or everywhere if forced. The replaced bars are freed
+ * once none of their instances are left.
+ */
+static void destroy_retired_instances (bool force)
+{
+	bool remaining = false;
+	struct Lava_output *output;
+	struct Lava_bar_instance *instance, *temp;
+	wl_list_for_each(output, &context.outputs, link)
+	{
+		const bool ready = force || output_has_new_frames(output);
+		wl_list_for_each_safe(instance, temp, &output->bar_instances, link)
+		{
+			if (! bar_is_retired(instance->bar))
+				continue;
+			if (! ready)
+			{
+				remaining = true;
+				continue;
+			}
+			seat_forget_bar_instance(instance);
+			destroy_bar_instance(instance);
+		}
+	}
+
+	if (remaining)
+		return;
+
+	log_message(1, "[reload] Removed replaced bars.\n");
+	timer_disarm(&retire_timer);
+	timer_disarm(&retire_timeout);
+	destroy_all_bars(&retired_bars);
+}
+
+static void handle_retire_timer (struct Lava_timer *timer)
+{
+	destroy_retired_instances(false);
+}
+
+static void handle_retire_timeout (struct Lava_timer *timer)
+{
+	log_message(1, "[reload] New bars not drawn in time, removing replaced bars anyway.\n");
+	destroy_retired_instances(true);
+}
+
+/* Called when an instance drew its first frame. The check is deferred to the
+ * event loop, as the caller may be iterating over the instances.
+ */
+void retire_replaced_bars (void)
+{
+	if (! wl_list_empty(&retired_bars))
+		timer_arm(&retire_timer, 0);
+}
+
+static void swap_generation (struct Lava_generation *generation)
+{
+	log_message(1, "[reload] Installing new configuration.\n");
+
+#if WATCH_CONFIG
+	if (context.watch_images)
+		image_watch_remove_all();
+#endif
+
+	/* Bars of unchanged fragments keep their instances. The remaining bars
+	 * keep theirs until the new instances have been drawn.
+	 */
+	generation_take_over_fragments(generation);
+
+	struct Lava_bar *bar, *temp;
+	wl_list_for_each_safe(bar, temp, &context.bars, link)
+	{
+		/* Their fragments are destroyed below. */
+		bar->fragment = NULL;
+		wl_list_remove(&bar->link);
+		wl_list_insert(retired_bars.prev, &bar->link);
+	}
+	destroy_all_includes(&context.includes);
+
+	install_generation(generation);
+	free(generation);
+
+#if WATCH_CONFIG
+	if (context.watch)
+		config_watch_add_includes();
+	if (context.watch_images)
+		image_watch_add_all();
+#endif
+
+	struct Lava_output *output;
+	wl_list_for_each(output, &context.outputs, link)
+		if (! update_bar_instances_on_output(output))
+			log_message(0, "ERROR: Can not update bars on output: global_name=%d\n",
+					output->global_name);
+
+	/* Outputs without new instances can drop the replaced ones right away. */
+	if (! wl_list_empty(&retired_bars))
+	{
+		timer_arm(&retire_timer, 0);
+		timer_arm(&retire_timeout, RETIRE_TIMEOUT_MS);
+	}
+
+	/* Outputs may have appeared while the worker decoded the images. */
+	rescale_images();
+}
+
+static bool bar_shows_image (struct Lava_bar *bar, image_t *image)
+{
+	struct Lava_item *item;
+	wl_list_for_each(item, &bar->items, link)
+		if ( item->img == image )
+			return true;
+	return false;
+}
+
+static void redraw_image (image_t *image)
+{
+	struct Lava_output *output;
+	struct Lava_bar_instance *instance;
+	wl_list_for_each(output, &context.outputs, link)
+		wl_list_for_each(instance, &output->bar_instances, link)
+			if (bar_shows_image(instance->bar, image))
+				bar_instance_redraw_image(instance, image);
+}
+
+static void free_image_jobs (void)
+{
+	for (size_t i = 0; i < image_job_count; i++)
+	{
+		if ( image_jobs[i].surface != NULL )
+			cairo_surface_destroy(image_jobs[i].surface);
+		free_if_set(image_jobs[i].resolved_path);
+		image_t_destroy(image_targets[i]);
+	}
+	DESTROY_NULL(image_jobs, free);
+	DESTROY_NULL(image_targets, free);
+	image_job_count = 0;
+}
+
+/* Called once the worker has decoded the images. Images which failed keep
+ * their old content.
+ */
+static void apply_image_jobs (void)
+{
+	for (size_t i = 0; i < image_job_count; i++)
+	{
+		if ( image_jobs[i].surface == NULL )
+			continue;
+		image_t_replace_surface(image_targets[i], image_jobs[i].surface,
+				image_jobs[i].raster_scale);
+		image_jobs[i].surface = NULL;
+		redraw_image(image_targets[i]);
+	}
+	free_image_jobs();
+}
+
+/* Hand all images flagged as changed to the worker. */
+static void reload_changed_images_sandboxed (void)
+{
+	if (worker_running)
+	{
+		images_pending = true;
+		return;
+	}
+
+	size_t count = 0;
+	struct Lava_bar *bar;
+	struct Lava_item *item;
+	wl_list_for_each(bar, &context.bars, link)
+		wl_list_for_each(item, &bar->items, link)
+			if ( item->img != NULL && item->img->changed )
+				count++;
+	if ( count == 0 )
+		return;
+
+	image_jobs    = calloc(count, sizeof(struct Lava_decode_job));
+	image_targets = calloc(count, sizeof(image_t *));
+	if ( image_jobs == NULL || image_targets == NULL )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		DESTROY_NULL(image_jobs, free);
+		DESTROY_NULL(image_targets, free);
+		return;
+	}
+
+	/* Images shared by several items are only decoded once. */
+	const uint32_t scale = get_max_output_scale();
+	wl_list_for_each(bar, &context.bars, link)
+		wl_list_for_each(item, &bar->items, link)
+	{
+		image_t *image = item->img;
+		if ( image == NULL || ! image->changed )
+			continue;
+		image->changed = false;
+
+		log_message(1, "[reload] Re-loading image in the background: %s\n", image->path);
+		image_targets[image_job_count] = image_t_reference(image);
+		image_jobs[image_job_count].path  = image->path;
+		image_jobs[image_job_count].size  = image->size;
+		image_jobs[image_job_count].scale = scale;
+		image_job_count++;
+	}
+
+	if ( pthread_create(&worker, NULL, image_worker, NULL) != 0 )
+	{
+		log_message(0, "ERROR: Can not start thread to re-load images.\n");
+		free_image_jobs();
+		return;
+	}
+	worker_running = true;
+}
+
+/* Decode all images flagged as changed again and redraw the items showing them. */
+void reload_changed_images (void)
+{
+	/* Without the event loop, there is nothing to wait on the worker. */
+	if ( context.sandbox_decode && wake_pipe[0] != -1 )
+	{
+		reload_changed_images_sandboxed();
+		return;
+	}
+
+	const uint32_t scale = get_max_output_scale();
+	struct Lava_bar *bar;
+	struct Lava_item *item;
+	wl_list_for_each(bar, &context.bars, link)
+		wl_list_for_each(item, &bar->items, link)
+	{
+		image_t *image = item->img;
+		if ( image == NULL || ! image->changed )
+			continue;
+		image->changed = false;
+
+		log_message(1, "[reload] Re-loading image: %s\n", image->path);
+		if (image_t_reload(image, scale))
+			redraw_image(image);
+	}
+}
+
+/* Vector images decoded by the helpers are rasters made for a specific scale,
+ * so they are decoded again once an output with a larger scale appears.
+ */
+void rescale_images (void)
+{
+	if (! context.sandbox_decode)
+		return;
+
+	const uint32_t scale = get_max_output_scale();
+	bool changed = false;
+	struct Lava_bar *bar;
+	struct Lava_item *item;
+	wl_list_for_each(bar, &context.bars, link)
+		wl_list_for_each(item, &bar->items, link)
+			if ( item->img != NULL && item->img->raster_scale != 0
+					&& item->img->raster_scale < scale )
+			{
+				item->img->changed = true;
+				changed = true;
+			}
+
+	if (changed)
+	{
+		log_message(1, "[reload] Output scale increased to %d, re-loading vector images.\n", scale);
+		reload_changed_images();
+	}
+}
+
+static bool reload_source_init (struct pollfd *fd)
+{
+	log_message(1, "[loop] Setting up reload event source.\n");
+
+	if ( pipe(wake_pipe) == -1 )
+	{
+		log_message(0, "ERROR: Unable to create pipe.\n"
+				"ERROR: pipe: %s\n", strerror(errno));
+		return false;
+	}
+	fcntl(wake_pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(wake_pipe[1], F_SETFD, FD_CLOEXEC);
+
+	timer_init(&retire_timer, handle_retire_timer, NULL);
+	timer_init(&retire_timeout, handle_retire_timeout, NULL);
+
+	fd->events = POLLIN;
+	fd->fd     = wake_pipe[0];
+	return true;
+}
+
+static bool reload_source_finish (struct pollfd *fd)
+{
+	/* A running worker must finish before its results can be freed. */
+	if (worker_running)
+	{
+		pthread_join(worker, NULL);
+		worker_running = false;
+		DESTROY_NULL(building, destroy_generation);
+		free_image_jobs();
+	}
+	reload_pending = false;
+	images_pending = false;
+
+	if (! wl_list_empty(&retired_bars))
+		destroy_retired_instances(true);
+
+	for (int i = 0; i < 2; i++) if ( wake_pipe[i] != -1 )
+	{
+		close(wake_pipe[i]);
+		wake_pipe[i] = -1;
+	}
+	return true;
+}
+
+static bool reload_source_flush (struct pollfd *fd)
+{
+	return true;
+}
+
+/* Returns false if the launcher has to restart instead. */
+static bool apply_generation (void)
+{
+	struct Lava_generation *generation = building;
+	building = NULL;
+
+	if (! building_success)
+	{
+		log_message(0, "ERROR: Reloading the configuration failed; Keeping the current one.\n");
+		destroy_generation(generation);
+	}
+	else if (! generation_fits_context(generation))
+	{
+		log_message(1, "[reload] Configuration needs different interfaces; Restarting.\n");
+		destroy_generation(generation);
+		full_reload();
+		return false;
+	}
+	else
+		swap_generation(generation);
+	return true;
+}
+
+static bool reload_source_handle_in (struct pollfd *fd)
+{
+	char byte;
+	if ( read(fd->fd, &byte, 1) != 1 )
+		return true;
+
+	pthread_join(worker, NULL);
+	worker_running = false;
+
+	/* The worker either built a generation or re-decoded images. */
+	if ( building == NULL )
+		apply_image_jobs();
+	else if (! apply_generation())
+		return true;
+
+	if (reload_pending)
+	{
+		reload_pending = false;
+		request_reload();
+	}
+	else if (images_pending)
+	{
+		images_pending = false;
+		reload_changed_images();
+	}
+
+	return true;
+}
+
+static bool reload_source_handle_out (struct pollfd *fd)
+{
+	return true;
+}
+
+struct Lava_event_source reload_source = {
+	.init       = reload_source_init,
+	.finish     = reload_source_finish,
+	.flush      = reload_source_flush,
+	.handle_in  = reload_source_handle_in,
+	.handle_out = reload_source_handle_out
+};
@@ -242,7 +242,7 @@ static void touch_handle_up (void *data, struct wl_touch *wl_touch,
 
 	log_message(1, "[input] Touch up.\n");
 
-	item_interaction(touchpoint->item, touchpoint->instance,
+	item_interaction(touchpoint->item, touchpoint->instance, seat, serial,
 			INTERACTION_TOUCH,
 			seat->keyboard.modifiers, 0);
 	destroy_touchpoint(touchpoint);
@@ -340,6 +340,7 @@ static void seat_pointer_unset_cursor (struct Lava_seat *seat)
 {
 	DESTROY_NULL(seat->pointer.cursor_theme, wl_cursor_theme_destroy);
 	DESTROY_NULL(seat->pointer.cursor_surface, wl_surface_destroy);
+	DESTROY_NULL(seat->pointer.cursor_name, free);
 
 	 /* These just points back to the theme. */
 	seat->pointer.cursor       = NULL;
@@ -353,6 +354,13 @@ static void seat_pointer_set_cursor (struct Lava_seat *seat, uint32_t serial, co
 	int32_t scale       = (int32_t)seat->pointer.instance->output->scale;
 	int32_t cursor_size = 24; // TODO ?
 
+	/* The cursor surface of the last enter can be used again, unless the
+	 * cursor or the scale of the output changed.
+	 */
+	if ( seat->pointer.cursor_surface != NULL && seat->pointer.cursor_scale == scale
+			&& ! strcmp(seat->pointer.cursor_name, name) )
+		goto set_cursor;
+
 	/* Cleanup any leftover cursor stuff. */
 	seat_pointer_unset_cursor(seat);
 
@@ -382,10 +390,17 @@ static void seat_pointer_set_cursor (struct Lava_seat *seat, uint32_t serial, co
 		return;
 	}
 
+	if ( NULL == (seat->pointer.cursor_name = strdup(name)) )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		seat_pointer_unset_cursor(seat);
+		return;
+	}
+	seat->pointer.cursor_scale = scale;
+
 	/* The entire dance of getting cursor image and surface and damaging
-	 * the latter is indeed necessary every time a seats pointer enters the
-	 * surface and we want to change its cursor image, because we need to
-	 * apply the scale of the current output to the cursor.
+	 * the latter is only necessary when the scale of the output the pointer
+	 * entered or the cursor changed.
 	 */
 
 	wl_surface_set_buffer_scale(seat->pointer.cursor_surface, scale);
@@ -395,6 +410,7 @@ static void seat_pointer_set_cursor (struct Lava_seat *seat, uint32_t serial, co
 	wl_surface_damage_buffer(seat->pointer.cursor_surface, 0, 0, INT32_MAX, INT32_MAX);
 	wl_surface_commit(seat->pointer.cursor_surface);
 
+set_cursor:
 	wl_pointer_set_cursor(pointer, serial, seat->pointer.cursor_surface,
 			(int32_t)seat->pointer.cursor_image->hotspot_x / scale,
 			(int32_t)seat->pointer.cursor_image->hotspot_y / scale);
@@ -422,6 +438,11 @@ static void pointer_handle_leave (void *data, struct wl_pointer *wl_pointer,
 	seat->pointer.instance = NULL;
 	seat->pointer.item     = NULL;
 
+	/* The instance may already be gone, for example after a reload. */
+	if ( instance == NULL )
+		return;
+
+	tooltip_hide(instance);
 	bar_instance_pointer_leave(instance);
 
 	log_message(1, "[input] Pointer left surface.\n");
@@ -432,6 +453,7 @@ static void pointer_handle_enter (void *data, struct wl_pointer *wl_pointer,
 		wl_fixed_t x, wl_fixed_t y)
 {
 	struct Lava_seat *seat = (struct Lava_seat *)data;
+	seat->pointer.serial = serial;
 
 	if ( NULL == (seat->pointer.instance = bar_instance_from_surface(surface)) )
 		return;
@@ -451,6 +473,8 @@ static void pointer_handle_motion(void *data, struct wl_pointer *wl_pointer,
 		uint32_t time, wl_fixed_t x, wl_fixed_t y)
 {
 	struct Lava_seat *seat = (struct Lava_seat *)data;
+	if ( seat->pointer.instance == NULL )
+		return;
 
 	seat->pointer.x = (uint32_t)wl_fixed_to_int(x);
 	seat->pointer.y = (uint32_t)wl_fixed_to_int(y);
@@ -471,9 +495,12 @@ static void pointer_handle_motion(void *data, struct wl_pointer *wl_pointer,
 	if ( item == NULL || item->type != TYPE_BUTTON )
 	{
 		DESTROY(seat->pointer.indicator, destroy_indicator);
+		tooltip_schedule(seat->pointer.instance, NULL);
 		return;
 	}
 
+	tooltip_schedule(seat->pointer.instance, item);
+
 	if ( seat->pointer.indicator == NULL )
 	{
 		seat->pointer.indicator = create_indicator(seat->pointer.instance);
@@ -496,6 +523,7 @@ static void pointer_handle_button (void *data, struct wl_pointer *wl_pointer,
 		uint32_t serial, uint32_t time, uint32_t button, uint32_t button_state)
 {
 	struct Lava_seat *seat = data;
+	seat->pointer.serial = serial;
 	if ( seat->pointer.instance == NULL )
 	{
 		log_message(0, "ERROR: Button press could not be handled: "
@@ -508,6 +536,8 @@ static void pointer_handle_button (void *data, struct wl_pointer *wl_pointer,
 	 */
 	if ( button_state == WL_POINTER_BUTTON_STATE_PRESSED )
 	{
+		tooltip_dismiss(seat->pointer.instance);
+
 		if ( seat->pointer.indicator != NULL )
 		{
 			indicator_set_colour(seat->pointer.indicator,
@@ -543,7 +573,7 @@ static void pointer_handle_button (void *data, struct wl_pointer *wl_pointer,
 
 		seat->pointer.item = NULL;
 
-		item_interaction(item, seat->pointer.instance,
+		item_interaction(item, seat->pointer.instance, seat, serial,
 				INTERACTION_MOUSE_BUTTON,
 				seat->keyboard.modifiers, button);
 	}
@@ -611,6 +641,7 @@ static void pointer_handle_frame (void *data, struct wl_pointer *wl_pointer)
 	{
 		for (uint32_t i = 0; i < seat->pointer.discrete_steps; i++)
 			item_interaction(item, seat->pointer.instance,
+					seat, seat->pointer.serial,
 					INTERACTION_MOUSE_SCROLL,
 					seat->keyboard.modifiers, direction);
 
@@ -620,6 +651,7 @@ static void pointer_handle_frame (void *data, struct wl_pointer *wl_pointer)
 	else while ( abs(seat->pointer.value) > CONTINUOUS_SCROLL_THRESHHOLD )
 	{
 		item_interaction(item, seat->pointer.instance,
+					seat, seat->pointer.serial,
 				INTERACTION_MOUSE_SCROLL,
 				seat->keyboard.modifiers, direction);
 		seat->pointer.value += value_change;
@@ -679,12 +711,15 @@ static void seat_init_pointer (struct Lava_seat *seat)
 	seat->pointer.y                = 0;
 	seat->pointer.instance         = NULL;
 	seat->pointer.item             = NULL;
+	seat->pointer.serial           = 0;
 	seat->pointer.discrete_steps   = 0;
 	seat->pointer.last_update_time = 0;
 	seat->pointer.value            = wl_fixed_from_int(0);
 	seat->pointer.indicator        = NULL;
 	seat->pointer.cursor_surface   = NULL;
 	seat->pointer.cursor_theme     = NULL;
+	seat->pointer.cursor_name      = NULL;
+	seat->pointer.cursor_scale     = 0;
 	seat->pointer.cursor_image     = NULL;
 	seat->pointer.cursor           = NULL;
 }
@@ -729,6 +764,9 @@ bool create_seat (struct wl_registry *registry, uint32_t name,
 
 	struct wl_seat *wl_seat = wl_registry_bind(registry, name, &wl_seat_interface, 5);
 
+	/* The pointer, keyboard and touch objects inherit this queue. */
+	wl_proxy_set_queue((struct wl_proxy *)wl_seat, context.input_queue);
+
 	TRY_NEW(struct Lava_seat, seat, false);
 
 	wl_seat_add_listener(wl_seat, &seat_listener, seat);
@@ -754,6 +792,25 @@ static void destroy_seat (struct Lava_seat *seat)
 	free(seat);
 }
 
+/* Drop all references to the bar instance, which is about to be destroyed. */
+void seat_forget_bar_instance (struct Lava_bar_instance *instance)
+{
+	struct Lava_seat *seat;
+	wl_list_for_each(seat, &context.seats, link)
+	{
+		struct Lava_touchpoint *tp, *temp;
+		wl_list_for_each_safe(tp, temp, &seat->touch.touchpoints, link)
+			if ( tp->instance == instance )
+				destroy_touchpoint(tp);
+
+		if ( seat->pointer.instance != instance )
+			continue;
+		DESTROY_NULL(seat->pointer.indicator, destroy_indicator);
+		seat->pointer.instance = NULL;
+		seat->pointer.item     = NULL;
+	}
+}
+
 void destroy_all_seats (void)
 {
 	log_message(1, "[seat] Destroying all seats.\n");
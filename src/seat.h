@@ -28,6 +28,7 @@
 #include"types/buffer.h"
 
 struct Lava_bar;
+struct Lava_bar_instance;
 struct Lava_item_indicator;
 
 enum Modifiers
@@ -76,6 +77,9 @@ struct Lava_seat
 		struct Lava_bar_instance *instance;
 		struct Lava_item *item;
 
+		/* Serial of the last enter or button event, scroll events have none. */
+		uint32_t serial;
+
 		/* Stuff needed to gracefully handle scroll events. */
 		uint32_t   discrete_steps, last_update_time;
 		wl_fixed_t value;
@@ -88,6 +92,10 @@ struct Lava_seat
 		struct wl_cursor_theme *cursor_theme;
 		struct wl_cursor_image *cursor_image;
 		struct wl_cursor       *cursor;
+
+		/* What the cursor surface currently shows. */
+		char    *cursor_name;
+		int32_t  cursor_scale;
 	} pointer;
 
 	struct
@@ -99,6 +107,7 @@ struct Lava_seat
 
 bool create_seat (struct wl_registry *registry, uint32_t name,
 		const char *interface, uint32_t version);
+void seat_forget_bar_instance (struct Lava_bar_instance *instance);
 void destroy_all_seats (void);
 
 #endif
@@ -0,0 +1,254 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<stddef.h>
+#include<string.h>
+#include<errno.h>
+
+#include"lavalauncher.h"
+#include"str.h"
+#include"bar.h"
+#include"output.h"
+#include"cache.h"
+#include"snapshot.h"
+#include"hash.h"
+#include"types/buffer.h"
+
+#define SNAPSHOT_VERSION 2
+
+/* Everything up to content_hash identifies the frames a snapshot can be used
+ * for. The content hash tells whether saving new frames changes anything.
+ */
+struct Lava_snapshot_header
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t scale;
+	uint32_t bar_w, bar_h;
+	uint32_t icon_w, icon_h;
+	uint64_t config_hash;
+	uint64_t content_hash;
+};
+
+static void snapshot_header (struct Lava_snapshot_header *header,
+		struct Lava_bar_instance *instance,
+		struct Lava_buffer *bar_buffer, struct Lava_buffer *icon_buffer)
+{
+	memset(header, 0, sizeof(struct Lava_snapshot_header));
+	memcpy(header->magic, "lavasnap", 8);
+	header->version     = SNAPSHOT_VERSION;
+	header->scale       = instance->output->scale;
+	header->bar_w       = bar_buffer->w;
+	header->bar_h       = bar_buffer->h;
+	header->icon_w      = icon_buffer->w;
+	header->icon_h      = icon_buffer->h;
+	header->config_hash = context.config_hash;
+}
+
+static uint64_t buffer_hash (uint64_t hash, struct Lava_buffer *buffer)
+{
+	if ( buffer->size == 0 )
+		return hash;
+	cairo_surface_flush(buffer->surface);
+	return hash_update(hash, buffer->memory_object, buffer->size);
+}
+
+static uint64_t content_hash (struct Lava_buffer *bar_buffer, struct Lava_buffer *icon_buffer)
+{
+	return buffer_hash(buffer_hash(HASH_INIT, bar_buffer), icon_buffer);
+}
+
+/* The snapshot is identified by the bar, the output and the hidden state.
+ * Scale and dimensions are checked against the header.
+ */
+static char *snapshot_path (struct Lava_bar_instance *instance)
+{
+	if ( instance->output->name == NULL )
+		return NULL;
+
+	/* Bars replaced by a reload are no longer in the list. */
+	int index = 0;
+	bool found = false;
+	struct Lava_bar *bar;
+	wl_list_for_each(bar, &context.bars, link)
+	{
+		if ( bar == instance->bar )
+		{
+			found = true;
+			break;
+		}
+		index++;
+	}
+	if (! found)
+		return NULL;
+
+	char *name = get_formatted_buffer("snapshot-%d-%s-%s", index,
+			instance->output->name, instance->hidden ? "hidden" : "shown");
+	if ( name == NULL )
+		return NULL;
+
+	/* Output names are chosen by the compositor, make sure they are usable as file name. */
+	for (char *ch = name; *ch != '\0'; ch++)
+		if ( *ch == '/' )
+			*ch = '_';
+
+	char *path = get_cache_file_path(name);
+	free(name);
+	return path;
+}
+
+static bool read_buffer (FILE *file, struct Lava_buffer *buffer)
+{
+	if ( buffer->size == 0 )
+		return true;
+	return fread(buffer->memory_object, 1, buffer->size, file) == buffer->size;
+}
+
+static bool write_buffer (FILE *file, struct Lava_buffer *buffer)
+{
+	if ( buffer->size == 0 )
+		return true;
+	cairo_surface_flush(buffer->surface);
+	return fwrite(buffer->memory_object, 1, buffer->size, file) == buffer->size;
+}
+
+/* Open the snapshot of the instance, positioned after its header, if the
+ * header matches frames of the given buffers. The header is stored in HEADER.
+ */
+static FILE *open_snapshot (struct Lava_bar_instance *instance,
+		struct Lava_buffer *bar_buffer, struct Lava_buffer *icon_buffer,
+		struct Lava_snapshot_header *header)
+{
+	char *path = snapshot_path(instance);
+	if ( path == NULL )
+		return NULL;
+
+	FILE *file = fopen(path, "r");
+	free(path);
+	if ( file == NULL )
+		return NULL;
+
+	struct Lava_snapshot_header expected;
+	snapshot_header(&expected, instance, bar_buffer, icon_buffer);
+	if ( fread(header, sizeof(struct Lava_snapshot_header), 1, file) != 1
+			|| memcmp(&expected, header, offsetof(struct Lava_snapshot_header, content_hash)) != 0 )
+	{
+		log_message(2, "[snapshot] Snapshot is outdated: global_name=%d\n",
+				instance->output->global_name);
+		fclose(file);
+		return NULL;
+	}
+	return file;
+}
+
+/* Whether the stored snapshot already holds exactly the given frames, in
+ * which case saving them again is pointless.
+ */
+bool snapshot_is_current (struct Lava_bar_instance *instance,
+		struct Lava_buffer *bar_buffer, struct Lava_buffer *icon_buffer)
+{
+	struct Lava_snapshot_header header;
+	FILE *file = open_snapshot(instance, bar_buffer, icon_buffer, &header);
+	if ( file == NULL )
+		return false;
+	fclose(file);
+	return header.content_hash == content_hash(bar_buffer, icon_buffer);
+}
+
+/* Try to fill the given buffers with the snapshot of the instance. The
+ * buffers must already have the size of the frames that are to be rendered.
+ */
+bool snapshot_load (struct Lava_bar_instance *instance,
+		struct Lava_buffer *bar_buffer, struct Lava_buffer *icon_buffer)
+{
+	struct Lava_snapshot_header header;
+	FILE *file = open_snapshot(instance, bar_buffer, icon_buffer, &header);
+	if ( file == NULL )
+		return false;
+
+	bool ret = false;
+	if ( ! read_buffer(file, bar_buffer) || ! read_buffer(file, icon_buffer) )
+		goto exit;
+
+	if ( bar_buffer->surface != NULL )
+		cairo_surface_mark_dirty(bar_buffer->surface);
+	if ( icon_buffer->surface != NULL )
+		cairo_surface_mark_dirty(icon_buffer->surface);
+
+	log_message(1, "[snapshot] Using snapshot: global_name=%d\n",
+			instance->output->global_name);
+	ret = true;
+
+exit:
+	fclose(file);
+	return ret;
+}
+
+void snapshot_save (struct Lava_bar_instance *instance,
+		struct Lava_buffer *bar_buffer, struct Lava_buffer *icon_buffer)
+{
+	char *path = snapshot_path(instance);
+	if ( path == NULL )
+		return;
+
+	/* Write to a temporary file first, so that a concurrently starting
+	 * instance never sees a half-written snapshot.
+	 */
+	char *tmp_path = get_formatted_buffer("%s.tmp", path);
+	if ( tmp_path == NULL )
+	{
+		free(path);
+		return;
+	}
+
+	FILE *file;
+	errno = 0;
+	if ( NULL == (file = fopen(tmp_path, "w")) )
+	{
+		log_message(1, "[snapshot] Can not open file: %s: %s\n", tmp_path, strerror(errno));
+		goto exit;
+	}
+
+	struct Lava_snapshot_header header;
+	snapshot_header(&header, instance, bar_buffer, icon_buffer);
+	header.content_hash = content_hash(bar_buffer, icon_buffer);
+	bool ok = fwrite(&header, sizeof(struct Lava_snapshot_header), 1, file) == 1
+		&& write_buffer(file, bar_buffer) && write_buffer(file, icon_buffer);
+	if ( fclose(file) != 0 )
+		ok = false;
+
+	if ( ! ok || rename(tmp_path, path) != 0 )
+	{
+		log_message(1, "[snapshot] Failed to write snapshot: %s\n", path);
+		remove(tmp_path);
+	}
+	else
+		log_message(2, "[snapshot] Saved snapshot: %s\n", path);
+
+exit:
+	free(tmp_path);
+	free(path);
+}
@@ -0,0 +1,43 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/* Snapshots of the last rendered frames of a bar instance, stored in the
+ * cache directory. When nothing changed since the last run, they can be
+ * copied straight into the first buffers, so the bar appears immediately
+ * after the first configure. The real render happens afterwards and only
+ * replaces the snapshot if it differs.
+ */
+
+#ifndef LAVALAUNCHER_SNAPSHOT_H
+#define LAVALAUNCHER_SNAPSHOT_H
+
+#include<stdbool.h>
+
+struct Lava_bar_instance;
+struct Lava_buffer;
+
+bool snapshot_load (struct Lava_bar_instance *instance,
+		struct Lava_buffer *bar_buffer, struct Lava_buffer *icon_buffer);
+bool snapshot_is_current (struct Lava_bar_instance *instance,
+		struct Lava_buffer *bar_buffer, struct Lava_buffer *icon_buffer);
+void snapshot_save (struct Lava_bar_instance *instance,
+		struct Lava_buffer *bar_buffer, struct Lava_buffer *icon_buffer);
+
+#endif
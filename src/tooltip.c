@@ -0,0 +1,313 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<cairo/cairo.h>
+
+#include<wayland-client.h>
+
+#include"lavalauncher.h"
+#include"str.h"
+#include"bar.h"
+#include"item.h"
+#include"output.h"
+#include"tooltip.h"
+#include"types/box_t.h"
+#include"types/colour_t.h"
+
+#define TOOLTIP_DELAY_MS   500
+#define TOOLTIP_FONT_SIZE  13
+#define TOOLTIP_PADDING    6
+#define TOOLTIP_GAP        4
+
+/*************
+ *           *
+ *  Rasters  *
+ *           *
+ *************/
+static void destroy_tooltip_raster (struct Lava_tooltip_raster *raster)
+{
+	wl_list_remove(&raster->link);
+	finish_buffer(&raster->buffers[0]);
+	finish_buffer(&raster->buffers[1]);
+	free(raster);
+}
+
+static void set_font (cairo_t *cairo, uint32_t scale)
+{
+	cairo_select_font_face(cairo, "sans-serif", CAIRO_FONT_SLANT_NORMAL,
+			CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size(cairo, TOOLTIP_FONT_SIZE * scale);
+}
+
+static struct Lava_tooltip_raster *render_tooltip_raster (struct Lava_tooltip *tooltip,
+		struct Lava_item *item, struct Lava_bar_configuration *config, uint32_t scale)
+{
+	log_message(2, "[tooltip] Rendering tooltip: %s\n", item->tooltip);
+
+	/* Measure the text. */
+	cairo_surface_t *scratch = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+	cairo_t *scratch_cairo = cairo_create(scratch);
+	set_font(scratch_cairo, scale);
+	cairo_font_extents_t font_extents;
+	cairo_text_extents_t text_extents;
+	cairo_font_extents(scratch_cairo, &font_extents);
+	cairo_text_extents(scratch_cairo, item->tooltip, &text_extents);
+	cairo_destroy(scratch_cairo);
+	cairo_surface_destroy(scratch);
+
+	TRY_NEW(struct Lava_tooltip_raster, raster, NULL);
+	raster->item   = item;
+	raster->config = config;
+	raster->scale  = scale;
+	raster->w = (uint32_t)(text_extents.x_advance / scale) + (2 * TOOLTIP_PADDING)
+		+ config->border.left + config->border.right;
+	raster->h = (uint32_t)(font_extents.height / scale) + (2 * TOOLTIP_PADDING)
+		+ config->border.top + config->border.bottom;
+
+	if (! next_buffer(&raster->buffer, context.shm, raster->buffers,
+				raster->w * scale, raster->h * scale))
+	{
+		free(raster);
+		return NULL;
+	}
+
+	cairo_t *cairo = raster->buffer->cairo;
+	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
+
+	ubox_t dim = { .x = 0, .y = 0, .w = raster->w, .h = raster->h };
+	draw_bar_background(cairo, &dim, &config->border, &config->radii, scale,
+			&config->bar_colour, &config->border_colour);
+
+	ubox_t text_area = {
+		.x = (config->border.left + TOOLTIP_PADDING) * scale,
+		.y = (config->border.top  + TOOLTIP_PADDING) * scale,
+		.w = (uint32_t)text_extents.x_advance,
+		.h = (uint32_t)font_extents.height
+	};
+	set_font(cairo, scale);
+	colour_t_set_cairo_source(cairo, &config->tooltip_colour, &text_area);
+	cairo_move_to(cairo, text_area.x, text_area.y + font_extents.ascent);
+	cairo_show_text(cairo, item->tooltip);
+	cairo_surface_flush(raster->buffer->surface);
+
+	wl_list_insert(&tooltip->rasters, &raster->link);
+	return raster;
+}
+
+static struct Lava_tooltip_raster *get_tooltip_raster (struct Lava_tooltip *tooltip,
+		struct Lava_item *item, struct Lava_bar_configuration *config, uint32_t scale)
+{
+	struct Lava_tooltip_raster *raster;
+	wl_list_for_each(raster, &tooltip->rasters, link)
+		if ( raster->item == item && raster->config == config && raster->scale == scale )
+			return raster;
+	return render_tooltip_raster(tooltip, item, config, scale);
+}
+
+/*************
+ *           *
+ *  Tooltip  *
+ *           *
+ *************/
+static bool tooltip_create_surface (struct Lava_bar_instance *instance)
+{
+	struct Lava_tooltip *tooltip = &instance->tooltip;
+	if ( tooltip->surface != NULL )
+		return true;
+
+	if ( NULL == (tooltip->surface = wl_compositor_create_surface(context.compositor)) )
+	{
+		log_message(0, "ERROR: Compositor did not create wl_surface.\n");
+		return false;
+	}
+	if ( NULL == (tooltip->subsurface = wl_subcompositor_get_subsurface(
+					context.subcompositor, tooltip->surface,
+					instance->bar_surface)) )
+	{
+		log_message(0, "ERROR: Compositor did not create wl_subsurface.\n");
+		DESTROY_NULL(tooltip->surface, wl_surface_destroy);
+		return false;
+	}
+	wl_subsurface_place_above(tooltip->subsurface, instance->icon_surface);
+	wl_surface_set_input_region(tooltip->surface, context.empty_region);
+	tooltip->scale = 0;
+	tooltip->x     = INT32_MIN;
+	tooltip->y     = INT32_MIN;
+
+	return true;
+}
+
+/* Place the tooltip centered next to the item, on the side of the bar
+ * facing away from the screen edge.
+ */
+static void tooltip_set_position (struct Lava_bar_instance *instance,
+		struct Lava_item *item, struct Lava_tooltip_raster *raster)
+{
+	struct Lava_bar_configuration *config = instance->config;
+	const int32_t center = (int32_t)(item->ordinate + (item->length / 2));
+	const int32_t w = (int32_t)raster->w, h = (int32_t)raster->h;
+	const int32_t bar_x = (int32_t)instance->bar_dim.x, bar_y = (int32_t)instance->bar_dim.y;
+	const int32_t bar_w = (int32_t)instance->bar_dim.w, bar_h = (int32_t)instance->bar_dim.h;
+	int32_t x = 0, y = 0;
+
+	switch (config->position)
+	{
+		case POSITION_TOP:
+		case POSITION_BOTTOM:
+			x = (int32_t)instance->item_area_dim.x + center - (w / 2);
+			y = config->position == POSITION_TOP ? bar_y + bar_h + TOOLTIP_GAP
+				: bar_y - h - TOOLTIP_GAP;
+			break;
+
+		case POSITION_LEFT:
+		case POSITION_RIGHT:
+			x = config->position == POSITION_LEFT ? bar_x + bar_w + TOOLTIP_GAP
+				: bar_x - w - TOOLTIP_GAP;
+			y = (int32_t)instance->item_area_dim.y + center - (h / 2);
+			break;
+	}
+
+	subsurface_set_position(instance->tooltip.subsurface,
+			&instance->tooltip.x, &instance->tooltip.y, x, y);
+}
+
+static void tooltip_show (struct Lava_bar_instance *instance)
+{
+	struct Lava_tooltip *tooltip = &instance->tooltip;
+	struct Lava_item    *item    = tooltip->item;
+	if ( item == NULL || item->tooltip == NULL || instance->hidden )
+		return;
+
+	const uint32_t scale = instance->output->scale;
+	struct Lava_tooltip_raster *raster = get_tooltip_raster(tooltip, item,
+			instance->config, scale);
+	if ( raster == NULL || ! tooltip_create_surface(instance) )
+		return;
+
+	log_message(2, "[tooltip] Showing tooltip: %s\n", item->tooltip);
+
+	tooltip_set_position(instance, item, raster);
+	surface_set_buffer_scale(tooltip->surface, &tooltip->scale, scale);
+	wl_surface_attach(tooltip->surface, raster->buffer->buffer, 0, 0);
+	wl_surface_damage_buffer(tooltip->surface, 0, 0, INT32_MAX, INT32_MAX);
+	wl_surface_commit(tooltip->surface);
+	wl_surface_commit(instance->bar_surface);
+	tooltip->shown = true;
+}
+
+static void tooltip_handle_timer (struct Lava_timer *timer)
+{
+	struct Lava_bar_instance *instance = (struct Lava_bar_instance *)timer->data;
+	if (! bar_instance_is_visible(instance))
+	{
+		instance->tooltip.deferred = true;
+		return;
+	}
+	tooltip_show(instance);
+}
+
+static void tooltip_handle_visibility (struct wl_listener *listener, void *data)
+{
+	struct Lava_tooltip *tooltip = wl_container_of(listener, tooltip, visibility_listener);
+	struct Lava_bar_instance *instance = (struct Lava_bar_instance *)data;
+	if ( tooltip != &instance->tooltip || ! tooltip->deferred
+			|| ! bar_instance_is_visible(instance) )
+		return;
+	tooltip->deferred = false;
+	timer_arm(&tooltip->timer, 0);
+}
+
+static void tooltip_unmap (struct Lava_bar_instance *instance)
+{
+	struct Lava_tooltip *tooltip = &instance->tooltip;
+	timer_disarm(&tooltip->timer);
+	tooltip->deferred = false;
+	if (! tooltip->shown)
+		return;
+
+	wl_surface_attach(tooltip->surface, NULL, 0, 0);
+	wl_surface_commit(tooltip->surface);
+	wl_surface_commit(instance->bar_surface);
+	tooltip->shown = false;
+}
+
+void tooltip_hide (struct Lava_bar_instance *instance)
+{
+	tooltip_unmap(instance);
+	instance->tooltip.item = NULL;
+}
+
+/* Hide the tooltip until the pointer moves on to another item. */
+void tooltip_dismiss (struct Lava_bar_instance *instance)
+{
+	tooltip_unmap(instance);
+}
+
+/* Show the tooltip of the item after a short delay. Passing an item without
+ * tooltip or NULL hides the tooltip.
+ */
+void tooltip_schedule (struct Lava_bar_instance *instance, struct Lava_item *item)
+{
+	struct Lava_tooltip *tooltip = &instance->tooltip;
+	if ( item == tooltip->item )
+		return;
+
+	tooltip_hide(instance);
+	if ( item == NULL || item->tooltip == NULL )
+		return;
+
+	tooltip->item = item;
+	timer_arm(&tooltip->timer, TOOLTIP_DELAY_MS);
+}
+
+void tooltip_init (struct Lava_bar_instance *instance)
+{
+	struct Lava_tooltip *tooltip = &instance->tooltip;
+	tooltip->surface    = NULL;
+	tooltip->subsurface = NULL;
+	tooltip->item       = NULL;
+	tooltip->shown      = false;
+	tooltip->deferred   = false;
+	wl_list_init(&tooltip->rasters);
+	timer_init(&tooltip->timer, tooltip_handle_timer, instance);
+	tooltip->visibility_listener.notify = tooltip_handle_visibility;
+	add_bar_instance_visibility_listener(&tooltip->visibility_listener);
+}
+
+void tooltip_finish (struct Lava_bar_instance *instance)
+{
+	struct Lava_tooltip *tooltip = &instance->tooltip;
+	timer_disarm(&tooltip->timer);
+	wl_list_remove(&tooltip->visibility_listener.link);
+
+	struct Lava_tooltip_raster *raster, *tmp;
+	wl_list_for_each_safe(raster, tmp, &tooltip->rasters, link)
+		destroy_tooltip_raster(raster);
+
+	DESTROY_NULL(tooltip->subsurface, wl_subsurface_destroy);
+	DESTROY_NULL(tooltip->surface, wl_surface_destroy);
+}
@@ -0,0 +1,78 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LAVALAUNCHER_TOOLTIP_H
+#define LAVALAUNCHER_TOOLTIP_H
+
+#include<stdbool.h>
+#include<stdint.h>
+#include<wayland-server.h>
+
+#include"event-loop.h"
+#include"types/buffer.h"
+
+struct Lava_bar_instance;
+struct Lava_bar_configuration;
+struct Lava_item;
+
+/* Rasterized tooltip of an item. Tooltips are only rendered once per item,
+ * configuration set and scale and then re-used for every hover.
+ */
+struct Lava_tooltip_raster
+{
+	struct wl_list link;
+
+	struct Lava_item              *item;
+	struct Lava_bar_configuration *config;
+	uint32_t scale;
+
+	/* Surface-local size. */
+	uint32_t w, h;
+
+	struct Lava_buffer  buffers[2];
+	struct Lava_buffer *buffer;
+};
+
+/* The tooltip of a bar instance. */
+struct Lava_tooltip
+{
+	struct wl_surface    *surface;
+	struct wl_subsurface *subsurface;
+	uint32_t              scale;
+	int32_t               x, y;
+
+	/* The item the tooltip is shown or scheduled for. A tooltip whose delay
+	 * expired while the bar was not visible is deferred until it is again.
+	 */
+	struct Lava_item *item;
+	bool shown, deferred;
+
+	struct Lava_timer timer;
+	struct wl_listener visibility_listener;
+	struct wl_list rasters;
+};
+
+void tooltip_init (struct Lava_bar_instance *instance);
+void tooltip_finish (struct Lava_bar_instance *instance);
+void tooltip_schedule (struct Lava_bar_instance *instance, struct Lava_item *item);
+void tooltip_hide (struct Lava_bar_instance *instance);
+void tooltip_dismiss (struct Lava_bar_instance *instance);
+
+#endif
@@ -174,6 +174,26 @@ void finish_buffer (struct Lava_buffer *buffer)
 	memset(buffer, 0, sizeof(struct Lava_buffer));
 }
 
+/* Attach the buffer to the surface. It stays busy until the compositor
+ * releases it, so next_buffer() does not hand it out for drawing meanwhile.
+ */
+void buffer_attach (struct Lava_buffer *buffer, struct wl_surface *surface)
+{
+	wl_surface_attach(surface, buffer->buffer, 0, 0);
+	buffer->busy = true;
+}
+
+bool buffer_content_equal (struct Lava_buffer *a, struct Lava_buffer *b)
+{
+	if ( a->w != b->w || a->h != b->h || a->size != b->size )
+		return false;
+	if ( a->size == 0 )
+		return true;
+	cairo_surface_flush(a->surface);
+	cairo_surface_flush(b->surface);
+	return memcmp(a->memory_object, b->memory_object, a->size) == 0;
+}
+
 bool next_buffer (struct Lava_buffer **buffer, struct wl_shm *shm,
 		struct Lava_buffer buffers[static 2], uint32_t w, uint32_t h)
 {
@@ -40,5 +40,7 @@ struct Lava_buffer
 bool next_buffer (struct Lava_buffer **buffer, struct wl_shm *shm,
 		struct Lava_buffer buffers[static 2], uint32_t w, uint32_t h);
 void finish_buffer (struct Lava_buffer *buffer);
+void buffer_attach (struct Lava_buffer *buffer, struct wl_surface *surface);
+bool buffer_content_equal (struct Lava_buffer *a, struct Lava_buffer *b);
 
 #endif
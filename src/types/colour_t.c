@@ -66,27 +66,50 @@ static bool colour_t_from_rgb_string (colour_t *colour, const char *str)
 	return true;
 }
 
+static bool colour_t_from_single_string (colour_t *colour, const char *str)
+{
+	if ( *str == '#' || strstr(str, "0x") == str )
+		return colour_t_from_hex_string(colour, str);
+	else if ( strstr(str, "rgb") == str )
+		return colour_t_from_rgb_string(colour, str);
+	return false;
+}
+
+/* Besides single colours, this accepts gradients between two colours:
+ * "#rrggbbaa-#rrggbbaa" for a horizontal and "#rrggbbaa|#rrggbbaa" for a
+ * vertical gradient.
+ */
 bool colour_t_from_string (colour_t *colour, const char *str)
 {
 	if ( colour == NULL || str == NULL || *str == '\0' )
 		goto error;
 
-	// TODO maybe parse multiple hex codes per Lava_colour for gradients?
-	//      -> "#rrggbbaa-#rrggbbaa" horizontal gradient
-	//      -> "#rrggbbaa|#rrggbbaa" vertical   gradient
+	colour_t_finish(colour);
+	colour->gradient = GRADIENT_NONE;
 
-	if ( *str == '#' || strstr(str, "0x") == str )
+	const char *separator = strpbrk(str, "-|");
+	if ( separator == NULL )
 	{
-		if (! colour_t_from_hex_string(colour, str))
+		if (! colour_t_from_single_string(colour, str))
 			goto error;
+		return true;
 	}
-	else if ( strstr(str, "rgb") == str )
-	{
-		if (! colour_t_from_rgb_string(colour, str))
-			goto error;
-	}
-	else
+
+	char *start = strndup(str, (size_t)(separator - str));
+	if ( start == NULL )
 		goto error;
+	colour_t end;
+	const bool ret = colour_t_from_single_string(colour, start)
+		&& colour_t_from_single_string(&end, separator + 1);
+	free(start);
+	if (! ret)
+		goto error;
+
+	colour->gradient = *separator == '-' ? GRADIENT_HORIZONTAL : GRADIENT_VERTICAL;
+	colour->end.r = end.r;
+	colour->end.g = end.g;
+	colour->end.b = end.b;
+	colour->end.a = end.a;
 
 	return true;
 
@@ -96,8 +119,78 @@ error:
 	return false;
 }
 
-void colour_t_set_cairo_source (cairo_t *cairo, colour_t *colour)
+static cairo_surface_t *colour_t_get_strip (colour_t *colour, uint32_t length)
 {
-	cairo_set_source_rgba(cairo, colour->r, colour->g, colour->b, colour->a);
+	for (unsigned int i = 0; i < COLOUR_T_STRIP_CACHE_SIZE; i++)
+		if ( colour->strips[i].surface != NULL && colour->strips[i].length == length )
+			return colour->strips[i].surface;
+
+	const bool horizontal = colour->gradient == GRADIENT_HORIZONTAL;
+	cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+			horizontal ? (int)length : 1, horizontal ? 1 : (int)length);
+	if ( cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS )
+	{
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+
+	cairo_pattern_t *pattern = horizontal
+		? cairo_pattern_create_linear(0, 0, length, 0)
+		: cairo_pattern_create_linear(0, 0, 0, length);
+	cairo_pattern_add_color_stop_rgba(pattern, 0, colour->r, colour->g, colour->b, colour->a);
+	cairo_pattern_add_color_stop_rgba(pattern, 1, colour->end.r, colour->end.g,
+			colour->end.b, colour->end.a);
+
+	cairo_t *cairo = cairo_create(surface);
+	cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source(cairo, pattern);
+	cairo_paint(cairo);
+	cairo_destroy(cairo);
+	cairo_pattern_destroy(pattern);
+
+	/* Replace the oldest strip. */
+	unsigned int i = colour->next_strip;
+	colour->next_strip = (i + 1) % COLOUR_T_STRIP_CACHE_SIZE;
+	if ( colour->strips[i].surface != NULL )
+		cairo_surface_destroy(colour->strips[i].surface);
+	colour->strips[i].surface = surface;
+	colour->strips[i].length  = length;
+
+	return surface;
+}
+
+/* Set the colour as the source of the cairo context. Gradients span the given
+ * area, which is in device coordinates.
+ */
+void colour_t_set_cairo_source (cairo_t *cairo, colour_t *colour, ubox_t *area)
+{
+	if ( colour->gradient == GRADIENT_NONE )
+	{
+		cairo_set_source_rgba(cairo, colour->r, colour->g, colour->b, colour->a);
+		return;
+	}
+
+	const uint32_t length = colour->gradient == GRADIENT_HORIZONTAL ? area->w : area->h;
+	cairo_surface_t *strip;
+	if ( length == 0 || NULL == (strip = colour_t_get_strip(colour, length)) )
+	{
+		cairo_set_source_rgba(cairo, colour->r, colour->g, colour->b, colour->a);
+		return;
+	}
+
+	cairo_set_source_surface(cairo, strip, area->x, area->y);
+	cairo_pattern_set_extend(cairo_get_source(cairo), CAIRO_EXTEND_REPEAT);
+}
+
+void colour_t_finish (colour_t *colour)
+{
+	for (unsigned int i = 0; i < COLOUR_T_STRIP_CACHE_SIZE; i++)
+	{
+		if ( colour->strips[i].surface != NULL )
+			cairo_surface_destroy(colour->strips[i].surface);
+		colour->strips[i].surface = NULL;
+		colour->strips[i].length  = 0;
+	}
+	colour->next_strip = 0;
 }
 
@@ -17,21 +17,50 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-/* A simple RGB colour type. */
+/* A simple RGB colour type, optionally with a gradient to a second colour. */
 
 #ifndef LAVALAUNCHER_TYPES_COLOUR_T_H
 #define LAVALAUNCHER_TYPES_COLOUR_T_H
 
 #include<stdbool.h>
+#include<stdint.h>
 #include<cairo/cairo.h>
 
+#include"types/box_t.h"
+
+#define COLOUR_T_STRIP_CACHE_SIZE 4
+
+enum Colour_gradient
+{
+	GRADIENT_NONE,
+	GRADIENT_HORIZONTAL,
+	GRADIENT_VERTICAL
+};
+
 typedef struct
 {
 	double r, g, b, a;
+
+	enum Colour_gradient gradient;
+	struct
+	{
+		double r, g, b, a;
+	} end;
+
+	/* A gradient only changes along one axis, so it is rendered once per
+	 * length into a one pixel wide strip, which is then repeated.
+	 */
+	struct
+	{
+		cairo_surface_t *surface;
+		uint32_t length;
+	} strips[COLOUR_T_STRIP_CACHE_SIZE];
+	unsigned int next_strip;
 } colour_t;
 
 bool colour_t_from_string (colour_t *colour, const char *str);
-void colour_t_set_cairo_source (cairo_t *cairo, colour_t *colour);
+void colour_t_set_cairo_source (cairo_t *cairo, colour_t *colour, ubox_t *area);
+void colour_t_finish (colour_t *colour);
 
 #endif
 
@@ -0,0 +1,421 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<unistd.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<cairo/cairo.h>
+
+#include"lavalauncher.h"
+#include"str.h"
+#include"types/image-formats.h"
+
+/* Larger images are rejected before any memory is allocated for them. Icons
+ * never come close to this.
+ */
+#define MAX_IMAGE_SIDE 8192
+
+/* Size of the "lavaargb" header: Magic, width and height. The pixel data
+ * directly follows and is therefore 16 byte aligned in the mapped file.
+ */
+#define LAVAARGB_HEADER_SIZE 16
+
+/******************
+ *                *
+ *  File helpers  *
+ *                *
+ ******************/
+struct Mapped_file
+{
+	uint8_t *data;
+	size_t   size;
+};
+
+static bool map_file (struct Mapped_file *file, const char *path)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if ( fd == -1 )
+	{
+		log_message(0, "ERROR: Can not open file: %s\n"
+				"ERROR: open: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	struct stat stat;
+	if ( fstat(fd, &stat) == -1 || stat.st_size <= 0 )
+	{
+		log_message(0, "ERROR: Can not read file: %s\n", path);
+		close(fd);
+		return false;
+	}
+
+	file->size = (size_t)stat.st_size;
+	file->data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if ( file->data == MAP_FAILED )
+	{
+		log_message(0, "ERROR: Can not map file: %s\n"
+				"ERROR: mmap: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+static void unmap_file (struct Mapped_file *file)
+{
+	munmap(file->data, file->size);
+}
+
+static uint32_t read_be32 (const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint32_t read_le32 (const uint8_t *p)
+{
+	return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[0];
+}
+
+static bool host_is_little_endian (void)
+{
+	const uint16_t test = 1;
+	return *(const uint8_t *)&test == 1;
+}
+
+static bool check_dimensions (const char *path, uint32_t w, uint32_t h)
+{
+	if ( w == 0 || h == 0 || w > MAX_IMAGE_SIDE || h > MAX_IMAGE_SIDE )
+	{
+		log_message(0, "ERROR: Invalid image dimensions %ux%u: %s\n", w, h, path);
+		return false;
+	}
+	return true;
+}
+
+/* Cairo expects premultiplied ARGB in native byte order. */
+static uint32_t premultiplied_pixel (uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+	if ( a != 255 )
+	{
+		r = (uint8_t)(((uint32_t)r * a + 127) / 255);
+		g = (uint8_t)(((uint32_t)g * a + 127) / 255);
+		b = (uint8_t)(((uint32_t)b * a + 127) / 255);
+	}
+	return ((uint32_t)a << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+}
+
+static cairo_surface_t *create_surface (const char *path, uint32_t w, uint32_t h,
+		uint32_t **pixels)
+{
+	cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+			(int)w, (int)h);
+	if ( cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS )
+	{
+		log_message(0, "ERROR: Failed to create image surface: %s\n", path);
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+
+	/* The decoders write whole rows, which requires a packed surface. */
+	if ( cairo_image_surface_get_stride(surface) != (int)(w * 4) )
+	{
+		log_message(0, "ERROR: Unexpected image surface stride: %s\n", path);
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+
+	cairo_surface_flush(surface);
+	*pixels = (uint32_t *)(void *)cairo_image_surface_get_data(surface);
+	return surface;
+}
+
+/******************
+ *                *
+ *  Magic sniffer *
+ *                *
+ ******************/
+/* Returns: -1 On error
+ *          The Image_format of the file otherwise
+ */
+int get_image_format (const char *path)
+{
+	const size_t buffer_size = 8;
+
+	FILE *file;
+	if ( NULL == (file = fopen(path, "r")) )
+	{
+		log_message(0, "ERROR: Can not open file: %s\n"
+				"ERROR: fopen: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	unsigned char buffer[buffer_size];
+	size_t ret = fread(buffer, sizeof(unsigned char), buffer_size, file);
+	fclose(file);
+
+	if ( ret == 0 )
+	{
+		log_message(0, "ERROR: fread() failed when trying to fetch file magic.\n");
+		return -1;
+	}
+
+	struct
+	{
+		const char       *magic;
+		size_t            length;
+		enum Image_format format;
+	} magics[] = {
+		{ .magic = "\x89PNG\r\n\x1A\n", .length = 8, .format = IMAGE_FORMAT_PNG      },
+		{ .magic = "qoif",              .length = 4, .format = IMAGE_FORMAT_QOI      },
+		{ .magic = "farbfeld",          .length = 8, .format = IMAGE_FORMAT_FARBFELD },
+		{ .magic = "lavaargb",          .length = 8, .format = IMAGE_FORMAT_LAVAARGB }
+	};
+
+	FOR_ARRAY(magics, i)
+		if ( ret >= magics[i].length && ! memcmp(buffer, magics[i].magic, magics[i].length) )
+			return (int)magics[i].format;
+
+	return (int)IMAGE_FORMAT_UNKNOWN;
+}
+
+/*********
+ *       *
+ *  QOI  *
+ *       *
+ *********/
+#define QOI_HEADER_SIZE 14
+#define QOI_OP_INDEX    0x00
+#define QOI_OP_DIFF     0x40
+#define QOI_OP_LUMA     0x80
+#define QOI_OP_RUN      0xc0
+#define QOI_OP_RGB      0xfe
+#define QOI_OP_RGBA     0xff
+#define QOI_MASK        0xc0
+
+struct Qoi_pixel
+{
+	uint8_t r, g, b, a;
+};
+
+static bool decode_qoi (const uint8_t *data, size_t size, uint32_t *pixels, size_t count)
+{
+	struct Qoi_pixel index[64];
+	memset(index, 0, sizeof(index));
+	struct Qoi_pixel px = { .r = 0, .g = 0, .b = 0, .a = 255 };
+
+	size_t p = QOI_HEADER_SIZE;
+	uint32_t run = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if ( run > 0 )
+			run--;
+		else
+		{
+			if ( p >= size )
+				return false;
+			const uint8_t b1 = data[p++];
+
+			if ( b1 == QOI_OP_RGB )
+			{
+				if ( p + 3 > size )
+					return false;
+				px.r = data[p++], px.g = data[p++], px.b = data[p++];
+			}
+			else if ( b1 == QOI_OP_RGBA )
+			{
+				if ( p + 4 > size )
+					return false;
+				px.r = data[p++], px.g = data[p++], px.b = data[p++], px.a = data[p++];
+			}
+			else if ( (b1 & QOI_MASK) == QOI_OP_INDEX )
+				px = index[b1];
+			else if ( (b1 & QOI_MASK) == QOI_OP_DIFF )
+			{
+				px.r = (uint8_t)(px.r + ((b1 >> 4) & 0x03) - 2);
+				px.g = (uint8_t)(px.g + ((b1 >> 2) & 0x03) - 2);
+				px.b = (uint8_t)(px.b + ( b1       & 0x03) - 2);
+			}
+			else if ( (b1 & QOI_MASK) == QOI_OP_LUMA )
+			{
+				if ( p >= size )
+					return false;
+				const uint8_t b2 = data[p++];
+				const int vg = (b1 & 0x3f) - 32;
+				px.r = (uint8_t)(px.r + vg - 8 + ((b2 >> 4) & 0x0f));
+				px.g = (uint8_t)(px.g + vg);
+				px.b = (uint8_t)(px.b + vg - 8 + (b2 & 0x0f));
+			}
+			else /* QOI_OP_RUN */
+				run = b1 & 0x3f;
+
+			index[(px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64] = px;
+		}
+
+		pixels[i] = premultiplied_pixel(px.r, px.g, px.b, px.a);
+	}
+
+	return true;
+}
+
+cairo_surface_t *image_surface_from_qoi (const char *path)
+{
+	struct Mapped_file file;
+	if (! map_file(&file, path))
+		return NULL;
+
+	cairo_surface_t *surface = NULL;
+	if ( file.size < QOI_HEADER_SIZE )
+	{
+		log_message(0, "ERROR: Truncated QOI image: %s\n", path);
+		goto exit;
+	}
+
+	const uint32_t w = read_be32(file.data + 4);
+	const uint32_t h = read_be32(file.data + 8);
+	if (! check_dimensions(path, w, h))
+		goto exit;
+
+	uint32_t *pixels;
+	if ( NULL == (surface = create_surface(path, w, h, &pixels)) )
+		goto exit;
+
+	if (! decode_qoi(file.data, file.size, pixels, (size_t)w * h))
+	{
+		log_message(0, "ERROR: Truncated QOI image: %s\n", path);
+		DESTROY_NULL(surface, cairo_surface_destroy);
+		goto exit;
+	}
+	cairo_surface_mark_dirty(surface);
+
+exit:
+	unmap_file(&file);
+	return surface;
+}
+
+/**************
+ *            *
+ *  Farbfeld  *
+ *            *
+ **************/
+#define FARBFELD_HEADER_SIZE 16
+
+cairo_surface_t *image_surface_from_farbfeld (const char *path)
+{
+	struct Mapped_file file;
+	if (! map_file(&file, path))
+		return NULL;
+
+	cairo_surface_t *surface = NULL;
+	if ( file.size < FARBFELD_HEADER_SIZE )
+	{
+		log_message(0, "ERROR: Truncated farbfeld image: %s\n", path);
+		goto exit;
+	}
+
+	const uint32_t w = read_be32(file.data + 8);
+	const uint32_t h = read_be32(file.data + 12);
+	if (! check_dimensions(path, w, h))
+		goto exit;
+
+	const size_t count = (size_t)w * h;
+	if ( file.size < FARBFELD_HEADER_SIZE + (count * 8) )
+	{
+		log_message(0, "ERROR: Truncated farbfeld image: %s\n", path);
+		goto exit;
+	}
+
+	uint32_t *pixels;
+	if ( NULL == (surface = create_surface(path, w, h, &pixels)) )
+		goto exit;
+
+	/* Channels are 16 bit big endian, of which the high byte is enough. */
+	const uint8_t *p = file.data + FARBFELD_HEADER_SIZE;
+	for (size_t i = 0; i < count; i++, p += 8)
+		pixels[i] = premultiplied_pixel(p[0], p[2], p[4], p[6]);
+	cairo_surface_mark_dirty(surface);
+
+exit:
+	unmap_file(&file);
+	return surface;
+}
+
+/**************
+ *            *
+ *  lavaargb  *
+ *            *
+ **************/
+/* The "lavaargb" format is a 16 byte header ("lavaargb" followed by width and
+ * height as 32 bit little endian integers) followed by rows of premultiplied
+ * ARGB pixels, each a 32 bit little endian integer, without padding. This is
+ * exactly the memory layout of a cairo ARGB32 surface on little endian hosts,
+ * so the pixels are copied without any decoding. The surface does not keep
+ * the mapping, as the file may be rewritten or truncated while it is in use.
+ */
+cairo_surface_t *image_surface_from_lavaargb (const char *path)
+{
+	struct Mapped_file file;
+	if (! map_file(&file, path))
+		return NULL;
+
+	cairo_surface_t *surface = NULL;
+	if ( file.size < LAVAARGB_HEADER_SIZE )
+	{
+		log_message(0, "ERROR: Truncated lavaargb image: %s\n", path);
+		goto exit;
+	}
+
+	const uint32_t w = read_le32(file.data + 8);
+	const uint32_t h = read_le32(file.data + 12);
+	if (! check_dimensions(path, w, h))
+		goto exit;
+
+	const size_t count = (size_t)w * h;
+	if ( file.size < LAVAARGB_HEADER_SIZE + (count * 4) )
+	{
+		log_message(0, "ERROR: Truncated lavaargb image: %s\n", path);
+		goto exit;
+	}
+
+	uint32_t *pixels;
+	if ( NULL == (surface = create_surface(path, w, h, &pixels)) )
+		goto exit;
+
+	/* On big endian hosts the pixels have to be converted after all. */
+	if (host_is_little_endian())
+		memcpy(pixels, file.data + LAVAARGB_HEADER_SIZE, count * 4);
+	else
+		for (size_t i = 0; i < count; i++)
+			pixels[i] = read_le32(file.data + LAVAARGB_HEADER_SIZE + (i * 4));
+	cairo_surface_mark_dirty(surface);
+
+exit:
+	unmap_file(&file);
+	return surface;
+}
@@ -0,0 +1,41 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LAVALAUNCHER_TYPES_IMAGE_FORMATS_H
+#define LAVALAUNCHER_TYPES_IMAGE_FORMATS_H
+
+#include<cairo/cairo.h>
+
+/* Raster formats which are decoded without any external library. */
+enum Image_format
+{
+	IMAGE_FORMAT_UNKNOWN,
+	IMAGE_FORMAT_PNG,
+	IMAGE_FORMAT_QOI,
+	IMAGE_FORMAT_FARBFELD,
+	IMAGE_FORMAT_LAVAARGB
+};
+
+int get_image_format (const char *path);
+cairo_surface_t *image_surface_from_qoi (const char *path);
+cairo_surface_t *image_surface_from_farbfeld (const char *path);
+cairo_surface_t *image_surface_from_lavaargb (const char *path);
+
+#endif
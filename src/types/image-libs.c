@@ -0,0 +1,217 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<string.h>
+
+#if SVG_SUPPORT || HAS_LIBSFDO
+#include<dlfcn.h>
+#include<pthread.h>
+#endif
+
+#include"str.h"
+#include"lavalauncher.h"
+#include"types/image-libs.h"
+
+/* Packagers may override the sonames at compile time. */
+#ifndef LIBRSVG_SONAME
+#define LIBRSVG_SONAME "librsvg-2.so.2"
+#endif
+#ifndef LIBGIO_SONAME
+#define LIBGIO_SONAME "libgio-2.0.so.0"
+#endif
+#ifndef LIBSFDO_BASEDIR_SONAME
+#define LIBSFDO_BASEDIR_SONAME "libsfdo-basedir.so.0"
+#endif
+#ifndef LIBSFDO_ICON_SONAME
+#define LIBSFDO_ICON_SONAME "libsfdo-icon.so.0"
+#endif
+
+#if SVG_SUPPORT || HAS_LIBSFDO
+/* Images may be loaded by the reload thread and the main thread at once. */
+static pthread_mutex_t library_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+enum Library_state
+{
+	LIBRARY_NOT_LOADED,
+	LIBRARY_LOADED,
+	LIBRARY_FAILED
+};
+
+static void *open_library (const char *soname)
+{
+	log_message(1, "[image] Loading library: %s\n", soname);
+	void *handle = dlopen(soname, RTLD_NOW | RTLD_LOCAL);
+	if ( handle == NULL )
+		log_message(0, "ERROR: Failed to load library: %s\n", dlerror());
+	return handle;
+}
+
+/* ISO C does not allow converting an object pointer to a function pointer,
+ * so the result of dlsym() is copied into the function pointer instead.
+ */
+static bool resolve_symbol (void *handle, const char *name, void *function_pointer,
+		size_t size)
+{
+	void *symbol = dlsym(handle, name);
+	if ( symbol == NULL )
+	{
+		log_message(0, "ERROR: Failed to resolve symbol: %s\n", name);
+		return false;
+	}
+	memcpy(function_pointer, &symbol, size);
+	return true;
+}
+
+#define RESOLVE(HANDLE, TABLE, FIELD, NAME) \
+	resolve_symbol(HANDLE, NAME, &(TABLE).FIELD, sizeof((TABLE).FIELD))
+#endif
+
+#if SVG_SUPPORT
+static struct Lava_librsvg librsvg;
+static enum Library_state librsvg_state = LIBRARY_NOT_LOADED;
+
+/* The GLib functions needed to handle the results of librsvg are resolved
+ * through its dependencies.
+ */
+static const struct Lava_librsvg *load_librsvg (void)
+{
+	if ( librsvg_state != LIBRARY_NOT_LOADED )
+		return librsvg_state == LIBRARY_LOADED ? &librsvg : NULL;
+
+	librsvg_state = LIBRARY_FAILED;
+	void *handle;
+	if ( NULL == (handle = open_library(LIBRSVG_SONAME)) )
+		return NULL;
+
+	if ( ! RESOLVE(handle, librsvg, handle_new_from_file, "rsvg_handle_new_from_file")
+			|| ! RESOLVE(handle, librsvg, handle_get_intrinsic_dimensions, "rsvg_handle_get_intrinsic_dimensions")
+			|| ! RESOLVE(handle, librsvg, handle_get_intrinsic_size_in_pixels, "rsvg_handle_get_intrinsic_size_in_pixels")
+			|| ! RESOLVE(handle, librsvg, handle_get_base_uri, "rsvg_handle_get_base_uri")
+			|| ! RESOLVE(handle, librsvg, handle_render_document, "rsvg_handle_render_document")
+			|| ! RESOLVE(handle, librsvg, filename_from_uri, "g_filename_from_uri")
+			|| ! RESOLVE(handle, librsvg, object_unref, "g_object_unref")
+			|| ! RESOLVE(handle, librsvg, error_free, "g_error_free")
+			|| ! RESOLVE(handle, librsvg, free, "g_free") )
+	{
+		dlclose(handle);
+		return NULL;
+	}
+
+	librsvg_state = LIBRARY_LOADED;
+	return &librsvg;
+}
+
+const struct Lava_librsvg *get_librsvg (void)
+{
+	pthread_mutex_lock(&library_mutex);
+	const struct Lava_librsvg *rsvg = load_librsvg();
+	pthread_mutex_unlock(&library_mutex);
+	return rsvg;
+}
+
+static struct Lava_libgio libgio;
+static enum Library_state libgio_state = LIBRARY_NOT_LOADED;
+
+static const struct Lava_libgio *load_libgio (void)
+{
+	if ( libgio_state != LIBRARY_NOT_LOADED )
+		return libgio_state == LIBRARY_LOADED ? &libgio : NULL;
+
+	libgio_state = LIBRARY_FAILED;
+	void *handle;
+	if ( NULL == (handle = open_library(LIBGIO_SONAME)) )
+		return NULL;
+
+	if ( ! RESOLVE(handle, libgio, settings_schema_source_get_default, "g_settings_schema_source_get_default")
+			|| ! RESOLVE(handle, libgio, settings_schema_source_lookup, "g_settings_schema_source_lookup")
+			|| ! RESOLVE(handle, libgio, settings_schema_unref, "g_settings_schema_unref")
+			|| ! RESOLVE(handle, libgio, settings_new, "g_settings_new")
+			|| ! RESOLVE(handle, libgio, settings_get_string, "g_settings_get_string")
+			|| ! RESOLVE(handle, libgio, object_unref, "g_object_unref")
+			|| ! RESOLVE(handle, libgio, free, "g_free") )
+	{
+		dlclose(handle);
+		return NULL;
+	}
+
+	libgio_state = LIBRARY_LOADED;
+	return &libgio;
+}
+
+const struct Lava_libgio *get_libgio (void)
+{
+	pthread_mutex_lock(&library_mutex);
+	const struct Lava_libgio *gio = load_libgio();
+	pthread_mutex_unlock(&library_mutex);
+	return gio;
+}
+#endif
+
+#if HAS_LIBSFDO
+static struct Lava_libsfdo libsfdo;
+static enum Library_state libsfdo_state = LIBRARY_NOT_LOADED;
+
+static const struct Lava_libsfdo *load_libsfdo (void)
+{
+	if ( libsfdo_state != LIBRARY_NOT_LOADED )
+		return libsfdo_state == LIBRARY_LOADED ? &libsfdo : NULL;
+
+	libsfdo_state = LIBRARY_FAILED;
+	void *basedir, *icon;
+	if ( NULL == (basedir = open_library(LIBSFDO_BASEDIR_SONAME)) )
+		return NULL;
+	if ( NULL == (icon = open_library(LIBSFDO_ICON_SONAME)) )
+	{
+		dlclose(basedir);
+		return NULL;
+	}
+
+	if ( ! RESOLVE(basedir, libsfdo, basedir_ctx_create, "sfdo_basedir_ctx_create")
+			|| ! RESOLVE(basedir, libsfdo, basedir_ctx_destroy, "sfdo_basedir_ctx_destroy")
+			|| ! RESOLVE(icon, libsfdo, icon_ctx_create, "sfdo_icon_ctx_create")
+			|| ! RESOLVE(icon, libsfdo, icon_ctx_destroy, "sfdo_icon_ctx_destroy")
+			|| ! RESOLVE(icon, libsfdo, icon_theme_load, "sfdo_icon_theme_load")
+			|| ! RESOLVE(icon, libsfdo, icon_theme_destroy, "sfdo_icon_theme_destroy")
+			|| ! RESOLVE(icon, libsfdo, icon_theme_lookup, "sfdo_icon_theme_lookup")
+			|| ! RESOLVE(icon, libsfdo, icon_file_get_path, "sfdo_icon_file_get_path")
+			|| ! RESOLVE(icon, libsfdo, icon_file_destroy, "sfdo_icon_file_destroy") )
+	{
+		dlclose(icon);
+		dlclose(basedir);
+		return NULL;
+	}
+
+	libsfdo_state = LIBRARY_LOADED;
+	return &libsfdo;
+}
+
+const struct Lava_libsfdo *get_libsfdo (void)
+{
+	pthread_mutex_lock(&library_mutex);
+	const struct Lava_libsfdo *sfdo = load_libsfdo();
+	pthread_mutex_unlock(&library_mutex);
+	return sfdo;
+}
+#endif
@@ -0,0 +1,89 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LAVALAUNCHER_TYPES_IMAGE_LIBS_H
+#define LAVALAUNCHER_TYPES_IMAGE_LIBS_H
+
+/* The optional image libraries are only loaded once they are actually needed,
+ * so configurations which do not use them do not pay for mapping and
+ * relocating them (and GLib) at startup. The headers are still used at
+ * compile time, only the symbols are resolved at runtime.
+ */
+
+#if SVG_SUPPORT
+#include<librsvg-2.0/librsvg/rsvg.h>
+
+struct Lava_librsvg
+{
+	RsvgHandle *(*handle_new_from_file)(const char *filename, GError **error);
+	void (*handle_get_intrinsic_dimensions)(RsvgHandle *handle,
+			gboolean *out_has_width, RsvgLength *out_width,
+			gboolean *out_has_height, RsvgLength *out_height,
+			gboolean *out_has_viewbox, RsvgRectangle *out_viewbox);
+	gboolean (*handle_get_intrinsic_size_in_pixels)(RsvgHandle *handle,
+			gdouble *out_width, gdouble *out_height);
+	const char *(*handle_get_base_uri)(RsvgHandle *handle);
+	gboolean (*handle_render_document)(RsvgHandle *handle, cairo_t *cr,
+			const RsvgRectangle *viewport, GError **error);
+	gchar *(*filename_from_uri)(const gchar *uri, gchar **hostname, GError **error);
+	void (*object_unref)(gpointer object);
+	void (*error_free)(GError *error);
+	void (*free)(gpointer mem);
+};
+
+struct Lava_libgio
+{
+	GSettingsSchemaSource *(*settings_schema_source_get_default)(void);
+	GSettingsSchema *(*settings_schema_source_lookup)(GSettingsSchemaSource *source,
+			const gchar *schema_id, gboolean recursive);
+	void (*settings_schema_unref)(GSettingsSchema *schema);
+	GSettings *(*settings_new)(const gchar *schema_id);
+	gchar *(*settings_get_string)(GSettings *settings, const gchar *key);
+	void (*object_unref)(gpointer object);
+	void (*free)(gpointer mem);
+};
+
+const struct Lava_librsvg *get_librsvg (void);
+const struct Lava_libgio *get_libgio (void);
+#endif
+
+#if HAS_LIBSFDO
+#include<sfdo-basedir.h>
+#include<sfdo-icon.h>
+
+struct Lava_libsfdo
+{
+	struct sfdo_basedir_ctx *(*basedir_ctx_create)(void);
+	void (*basedir_ctx_destroy)(struct sfdo_basedir_ctx *ctx);
+	struct sfdo_icon_ctx *(*icon_ctx_create)(struct sfdo_basedir_ctx *basedir_ctx);
+	void (*icon_ctx_destroy)(struct sfdo_icon_ctx *ctx);
+	struct sfdo_icon_theme *(*icon_theme_load)(struct sfdo_icon_ctx *ctx,
+			const char *name, int options);
+	void (*icon_theme_destroy)(struct sfdo_icon_theme *theme);
+	struct sfdo_icon_file *(*icon_theme_lookup)(struct sfdo_icon_theme *theme,
+			const char *name, size_t name_len, int size, int scale, int options);
+	const char *(*icon_file_get_path)(struct sfdo_icon_file *file, size_t *len);
+	void (*icon_file_destroy)(struct sfdo_icon_file *file);
+};
+
+const struct Lava_libsfdo *get_libsfdo (void);
+#endif
+
+#endif
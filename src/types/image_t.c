@@ -28,78 +28,52 @@
 #include<errno.h>
 #include<cairo/cairo.h>
 
-#if SVG_SUPPORT
-#include<librsvg-2.0/librsvg/rsvg.h>
-#endif
-#if HAS_LIBSFDO
-#include "bar.h"
-#include <sfdo-basedir.h>
-#include <sfdo-icon.h>
-#endif
-
 #include"str.h"
 #include"lavalauncher.h"
 #include"types/image_t.h"
-
-/* Returns: -1 On error
- *           0 If the file is not a PNG file
- *           1 If the file is a PNG file
- */
-static int is_png_file (const char *path)
-{
-	const size_t buffer_size = 8;
-
-	FILE *file;
-	if ( NULL == (file = fopen(path, "r")) )
-	{
-		log_message(0, "ERROR: Can not open file: %s\n"
-				"ERROR: fopen: %s\n", path, strerror(errno));
-		return -1;
-	}
-
-	unsigned char buffer[buffer_size];
-	size_t ret = fread(buffer, sizeof(unsigned char), buffer_size, file);
-	fclose(file);
-
-	if ( ret == 0 )
-	{
-		log_message(0, "ERROR: fread() failed when trying to fetch file magic.\n");
-		return -1;
-	}
-
-	unsigned char png_magic[8] = { 0x89, 0x50, 0x4e, 0x47, 0x0D, 0x0A, 0x1A, 0x0A };
-	for (int i = 0; i < 8; i++) if ( buffer[i] != png_magic[i] )
-		return 0;
-
-	return 1;
-}
+#include"types/image-formats.h"
+#include"types/image-libs.h"
+#include"decode-helper.h"
 
 #if HAS_LIBSFDO
-static struct sfdo_icon_file *get_icon_file(const char *image_name)
+static struct sfdo_icon_file *get_icon_file(const char *image_name, uint32_t size)
 {
-	const char *icon_theme_name = NULL;
+	const struct Lava_libsfdo *sfdo = get_libsfdo();
+	if ( sfdo == NULL )
+		return NULL;
+
+	char *icon_theme_name = NULL;
 #if SVG_SUPPORT
 	/* Get the default icon theme from GLib if the schema is available.
 	 * It's not necessary but helps find generic icons.
 	 * Obviously this won't work when there's no SVG support, as librsvg is the only thing
 	 * providing access to GLib. */
-	GSettingsSchema *settings_schema = g_settings_schema_source_lookup(g_settings_schema_source_get_default(), "org.gnome.desktop.interface", FALSE);
-	if (settings_schema)
+	const struct Lava_libgio *gio = get_libgio();
+	if ( gio != NULL )
 	{
-		GSettings *gsettings = g_settings_new("org.gnome.desktop.interface");
-		icon_theme_name = (const char *) g_settings_get_string(gsettings, "icon-theme");
+		GSettingsSchema *settings_schema = gio->settings_schema_source_lookup(gio->settings_schema_source_get_default(), "org.gnome.desktop.interface", FALSE);
+		if (settings_schema)
+		{
+			GSettings *gsettings = gio->settings_new("org.gnome.desktop.interface");
+			icon_theme_name = (char *) gio->settings_get_string(gsettings, "icon-theme");
+			gio->object_unref(gsettings);
+			gio->settings_schema_unref(settings_schema);
+		}
 	}
-	g_free(settings_schema);
 #endif
 	//
-	struct sfdo_basedir_ctx *basedir_context = sfdo_basedir_ctx_create();
-	struct sfdo_icon_ctx *icon_context = sfdo_icon_ctx_create(basedir_context);
-	struct sfdo_icon_theme *icon_theme = sfdo_icon_theme_load(icon_context, icon_theme_name, SFDO_ICON_THEME_LOAD_OPTION_RELAXED | SFDO_ICON_THEME_LOAD_OPTION_ALLOW_MISSING);
+	struct sfdo_basedir_ctx *basedir_context = sfdo->basedir_ctx_create();
+	struct sfdo_icon_ctx *icon_context = sfdo->icon_ctx_create(basedir_context);
+	struct sfdo_icon_theme *icon_theme = sfdo->icon_theme_load(icon_context, icon_theme_name, SFDO_ICON_THEME_LOAD_OPTION_RELAXED | SFDO_ICON_THEME_LOAD_OPTION_ALLOW_MISSING);
 	if (icon_theme != NULL)
 	{
 		/* sfdo_icon_theme_load sets errno to 2 for some reason. */
 		errno = 0;
 	}
+#if SVG_SUPPORT
+	if ( icon_theme_name != NULL )
+		gio->free(icon_theme_name);
+#endif
 	const struct sfdo_string names[] = {
 		{ image_name, strlen(image_name) },
 		{ "application-x-executable", 24 },
@@ -112,42 +86,43 @@ static struct sfdo_icon_file *get_icon_file(const char *image_name)
 #else
 		SFDO_ICON_THEME_LOOKUP_OPTION_NO_SVG;
 #endif
-	struct Lava_bar_configuration *config = get_bar_config_for_output(context.last_bar, NULL);
 	/* Not using the simpler sfdo_icon_theme_lookup_best because it often returns the path for
 	 * application[-x]-executable even when the specified icon is available (seemingly by
 	 * design). */
 	struct sfdo_icon_file *icon_file;
 	for (size_t i = 0; i < nnames; i++)
 	{
-		icon_file = sfdo_icon_theme_lookup(icon_theme, names[i].data, names[i].len, (int) config->size, 1, lookup_options);
+		icon_file = sfdo->icon_theme_lookup(icon_theme, names[i].data, names[i].len, (int) size, 1, lookup_options);
 		if (icon_file != NULL)
 			break;
-		sfdo_icon_file_destroy(icon_file);
+		sfdo->icon_file_destroy(icon_file);
 	}
 
-	sfdo_icon_theme_destroy(icon_theme);
-	sfdo_icon_ctx_destroy(icon_context);
-	sfdo_basedir_ctx_destroy(basedir_context);
+	sfdo->icon_theme_destroy(icon_theme);
+	sfdo->icon_ctx_destroy(icon_context);
+	sfdo->basedir_ctx_destroy(basedir_context);
 
 	return icon_file;
 }
-/* Create macros to avoid ifdef soup. */
+/* Create macros to avoid ifdef soup. An icon file only exists if libsfdo
+ * has been loaded.
+ */
 #define DECLARE_ICON_FILE struct sfdo_icon_file *icon_file = NULL;
-#define DESTROY_ICON_FILE sfdo_icon_file_destroy(icon_file);
+#define DESTROY_ICON_FILE if ( icon_file != NULL ) get_libsfdo()->icon_file_destroy(icon_file);
 #else
 #define DECLARE_ICON_FILE
 #define DESTROY_ICON_FILE
 #endif
 
-static bool load_image (image_t *image, const char *path)
+static bool load_image (image_t *image, const char *path, uint32_t size)
 {
 	DECLARE_ICON_FILE
 	if (access(path, F_OK))
 	{
 #if HAS_LIBSFDO
-		icon_file = get_icon_file(path);
+		icon_file = get_icon_file(path, size);
 		if (icon_file != NULL)
-			path = sfdo_icon_file_get_path(icon_file, NULL);
+			path = get_libsfdo()->icon_file_get_path(icon_file, NULL);
 		else
 		{
 			log_message(0, "Failed to resolve path of icon %s\n", path);
@@ -174,10 +149,16 @@ static bool load_image (image_t *image, const char *path)
 		return false;
 	}
 
-	/* PNG */
-	int ret;
-	ret = is_png_file(path);
-	if ( ret == 1 )
+	set_string(&image->path, (char *)path);
+
+	/* Raster formats. */
+	const int format = get_image_format(path);
+	if ( format == -1 )
+	{
+		DESTROY_ICON_FILE
+		return false;
+	}
+	else if ( format == IMAGE_FORMAT_PNG )
 	{
 		if ( NULL == (image->cairo_surface = cairo_image_surface_create_from_png(path)) )
 		{
@@ -193,39 +174,61 @@ static bool load_image (image_t *image, const char *path)
 			return true;
 		}
 	}
-	else if ( ret == -1 )
+	else if ( format != IMAGE_FORMAT_UNKNOWN )
 	{
+		switch ((enum Image_format)format)
+		{
+			case IMAGE_FORMAT_QOI:
+				image->cairo_surface = image_surface_from_qoi(path);
+				break;
+
+			case IMAGE_FORMAT_FARBFELD:
+				image->cairo_surface = image_surface_from_farbfeld(path);
+				break;
+
+			default:
+				image->cairo_surface = image_surface_from_lavaargb(path);
+				break;
+		}
 		DESTROY_ICON_FILE
-		return false;
+		return image->cairo_surface != NULL;
 	}
 
 #if SVG_SUPPORT
-	/* SVG */
-	GError *gerror = NULL;
-	if ( NULL != (image->rsvg_handle = rsvg_handle_new_from_file(path, &gerror)) )
-	{
-		DESTROY_ICON_FILE
-		return true;
-	}
-	else if ( gerror->domain != 123 )
+	/* SVG. librsvg is only loaded once an image actually needs it. */
+	const struct Lava_librsvg *rsvg = get_librsvg();
+	if ( rsvg != NULL )
 	{
+		GError *gerror = NULL;
+		if ( NULL != (image->rsvg_handle = rsvg->handle_new_from_file(path, &gerror)) )
+		{
+			DESTROY_ICON_FILE
+			return true;
+		}
+
 		/* The domain 123 is an XML parse error. Receiving it means that
 		 * the file is likely not an SVG image, a case which must be
 		 * handled differently than other errors.
 		 */
-		log_message(0, "ERROR: Failed to load image: %s\n"
-				"ERROR: rsvg_handle_new_from_file: %d: %s\n",
-				path, gerror->domain, gerror->message);
-		DESTROY_ICON_FILE
-		return false;
+		const bool not_svg = gerror->domain == 123;
+		if (! not_svg)
+			log_message(0, "ERROR: Failed to load image: %s\n"
+					"ERROR: rsvg_handle_new_from_file: %d: %s\n",
+					path, gerror->domain, gerror->message);
+		rsvg->error_free(gerror);
+		if (! not_svg)
+		{
+			DESTROY_ICON_FILE
+			return false;
+		}
 	}
 #endif
 
 	log_message(0, "ERROR: Unsupported file type: %s\n"
 #if SVG_SUPPORT
-			"INFO: LavaLauncher supports PNG and SVG images.\n",
+			"INFO: LavaLauncher supports PNG, QOI, farbfeld, lavaargb and SVG images.\n",
 #else
-			"INFO: LavaLauncher supports PNG images.\n"
+			"INFO: LavaLauncher supports PNG, QOI, farbfeld and lavaargb images.\n"
 			"INFO: LavaLauncher has been compiled without SVG support.\n",
 #endif
 			path);
@@ -234,42 +237,147 @@ static bool load_image (image_t *image, const char *path)
 	return false;
 }
 
-image_t *image_t_create_from_file (const char *path)
+/* The size is only used to pick the best fitting icon when the path is
+ * resolved via the icon theme.
+ */
+static image_t *image_t_create (uint32_t size)
 {
 	TRY_NEW(image_t, image, NULL);
 
 	image->cairo_surface = NULL;
+	image->path          = NULL;
+	image->size          = size;
+	image->raster_scale  = 0;
+	image->generation    = 0;
+	image->watch         = -1;
+	image->changed       = false;
 	image->references    = 1;
 #if SVG_SUPPORT
 	image->rsvg_handle   = NULL;
 #endif
 
-	if (load_image(image, path))
+	return image;
+}
+
+image_t *image_t_create_from_file (const char *path, uint32_t size)
+{
+	image_t *image = image_t_create(size);
+	if ( image == NULL )
+		return NULL;
+
+	if (load_image(image, path, size))
 		return image;
-	
+
+	free_if_set(image->path);
 	free(image);
 	return NULL;
 }
 
-image_t *image_t_reference (image_t *image)
+/* Create an image from an already decoded surface, taking ownership of both
+ * the surface and the path.
+ */
+image_t *image_t_create_from_surface (cairo_surface_t *surface, char *path, uint32_t size,
+		uint32_t raster_scale)
 {
-	image->references++;
+	image_t *image = image_t_create(size);
+	if ( image == NULL )
+	{
+		cairo_surface_destroy(surface);
+		free(path);
+		return NULL;
+	}
+
+	image->cairo_surface = surface;
+	image->path          = path;
+	image->raster_scale  = raster_scale;
 	return image;
 }
 
-void image_t_destroy (image_t *image)
+static void image_t_finish_content (image_t *image)
 {
-	if ( --image->references > 0 )
-		return;
-
 	if ( image->cairo_surface != NULL )
 		cairo_surface_destroy(image->cairo_surface);
 
 #if SVG_SUPPORT
 	if ( image->rsvg_handle != NULL )
-		g_object_unref(image->rsvg_handle);
+		get_librsvg()->object_unref(image->rsvg_handle);
+#endif
+}
+
+/* Replace the content of the image with a surface decoded by a helper,
+ * taking ownership of the surface.
+ */
+void image_t_replace_surface (image_t *image, cairo_surface_t *surface, uint32_t raster_scale)
+{
+	image_t_finish_content(image);
+	image->cairo_surface = surface;
+#if SVG_SUPPORT
+	image->rsvg_handle   = NULL;
+#endif
+	image->raster_scale  = raster_scale;
+	image->generation++;
+}
+
+/* Decode the file of the image again, for example after it has been changed
+ * on disk or an output with a larger scale appeared. The scale is the largest
+ * one of all outputs. If this fails, the image keeps its old content.
+ */
+bool image_t_reload (image_t *image, uint32_t scale)
+{
+	if (context.sandbox_decode)
+	{
+		struct Lava_decode_job job = {
+			.path  = image->path,
+			.size  = image->size,
+			.scale = scale
+		};
+		decode_images_sandboxed(&job, 1);
+		if ( job.surface == NULL )
+			return false;
+		free(job.resolved_path);
+		image_t_replace_surface(image, job.surface, job.raster_scale);
+		return true;
+	}
+
+	image_t new = {
+		.cairo_surface = NULL,
+#if SVG_SUPPORT
+		.rsvg_handle   = NULL,
+#endif
+		.path          = NULL
+	};
+
+	/* The path has already been resolved, so no icon lookup is needed. */
+	if (! load_image(&new, image->path, 0))
+	{
+		free_if_set(new.path);
+		return false;
+	}
+	free_if_set(new.path);
+
+	image_t_finish_content(image);
+	image->cairo_surface = new.cairo_surface;
+#if SVG_SUPPORT
+	image->rsvg_handle   = new.rsvg_handle;
 #endif
+	image->raster_scale  = 0;
+	image->generation++;
+	return true;
+}
+
+image_t *image_t_reference (image_t *image)
+{
+	image->references++;
+	return image;
+}
+
+void image_t_destroy (image_t *image)
+{
+	if ( --image->references > 0 )
+		return;
 
+	image_t_finish_content(image);
+	free_if_set(image->path);
 	free(image);
 }
 
@@ -291,15 +399,16 @@ void image_t_draw_to_cairo (cairo_t *cairo, image_t *image,
 #if SVG_SUPPORT
 	else if ( image->rsvg_handle != NULL )
 	{
+		const struct Lava_librsvg *rsvg = get_librsvg();
 		// TODO maybe set DPI?
 		gboolean has_viewbox;
 		RsvgLength rsvg_width, rsvg_height;
 		RsvgRectangle viewbox = {.x=0, .y=0, .width=48, .height=48};	/* Sensible defaults in case viewBox is missing from file. */
 
-		rsvg_handle_get_intrinsic_dimensions(image->rsvg_handle,
+		rsvg->handle_get_intrinsic_dimensions(image->rsvg_handle,
 				NULL, &rsvg_width, NULL, &rsvg_height,
 				&has_viewbox, &viewbox);
-		const char *filename = g_filename_from_uri(rsvg_handle_get_base_uri(image->rsvg_handle), NULL, NULL);
+		char *filename = rsvg->filename_from_uri(rsvg->handle_get_base_uri(image->rsvg_handle), NULL, NULL);
 		if ( ! has_viewbox )
 		{
 			log_message(1, "[bar] Constructing viewBox for SVG image %s.\n", filename);
@@ -310,7 +419,7 @@ void image_t_draw_to_cairo (cairo_t *cairo, image_t *image,
 			else
 			{
 				gdouble rsvg_width_px;
-				if (rsvg_handle_get_intrinsic_size_in_pixels(image->rsvg_handle, &rsvg_width_px, NULL))
+				if (rsvg->handle_get_intrinsic_size_in_pixels(image->rsvg_handle, &rsvg_width_px, NULL))
 					viewbox.width = rsvg_width_px;
 			}
 			if ( rsvg_height.length == 0 )
@@ -320,7 +429,7 @@ void image_t_draw_to_cairo (cairo_t *cairo, image_t *image,
 			else
 			{
 				gdouble rsvg_height_px;
-				if (rsvg_handle_get_intrinsic_size_in_pixels(image->rsvg_handle, NULL, &rsvg_height_px))
+				if (rsvg->handle_get_intrinsic_size_in_pixels(image->rsvg_handle, NULL, &rsvg_height_px))
 					viewbox.height = rsvg_height_px;
 			}
 			log_message(1, "[bar] Constructed viewBox of SVG image %s: width=%.0f height=%.0f.\n", filename, viewbox.width, viewbox.height);
@@ -330,9 +439,10 @@ void image_t_draw_to_cairo (cairo_t *cairo, image_t *image,
 		cairo_scale(cairo, (float)width / viewbox.width,
 				(float)width / viewbox.height);
 		GError *gerror = NULL;
-		rsvg_handle_render_document(image->rsvg_handle, cairo,
+		rsvg->handle_render_document(image->rsvg_handle, cairo,
 				&viewbox, &gerror);
 		// TODO check value of gerror
+		rsvg->free(filename);
 	}
 #endif
 
@@ -26,6 +26,7 @@
 #define LAVALAUNCHER_TYPES_IMAGE_H
 
 #include<stdint.h>
+#include<stdbool.h>
 #include<cairo/cairo.h>
 
 #if SVG_SUPPORT
@@ -40,10 +41,32 @@ typedef struct
 	RsvgHandle *rsvg_handle;
 #endif
 
+	/* Path of the file the image was loaded from, after icon lookup. */
+	char *path;
+
+	/* The icon size the image was requested for. */
+	uint32_t size;
+
+	/* Output scale a vector image has been rasterized at by a decode
+	 * helper, 0 if the image is not a raster of a vector image.
+	 */
+	uint32_t raster_scale;
+
+	/* Incremented every time the image is re-loaded. */
+	uint32_t generation;
+
+	/* Inotify watch descriptor, -1 if the file is not watched. */
+	int watch;
+	bool changed;
+
 	int references;
 } image_t;
 
-image_t *image_t_create_from_file (const char *path);
+image_t *image_t_create_from_file (const char *path, uint32_t size);
+image_t *image_t_create_from_surface (cairo_surface_t *surface, char *path, uint32_t size,
+		uint32_t raster_scale);
+bool image_t_reload (image_t *image, uint32_t scale);
+void image_t_replace_surface (image_t *image, cairo_surface_t *surface, uint32_t raster_scale);
 image_t *image_t_reference (image_t *image);
 void image_t_destroy (image_t *image);
 void image_t_draw_to_cairo (cairo_t *cairo, image_t *image,
@@ -36,12 +36,16 @@
 #include"river-status-unstable-v1-protocol.h"
 #include"xdg-output-unstable-v1-protocol.h"
 #include"xdg-shell-protocol.h"
+#include"xdg-activation-v1-protocol.h"
+#include"wlr-foreign-toplevel-management-unstable-v1-protocol.h"
 
 #include"lavalauncher.h"
 #include"str.h"
 #include"seat.h"
 #include"output.h"
 #include"event-loop.h"
+#include"item.h"
+#include"foreign-toplevel.h"
 
 
 /**************
@@ -98,6 +102,17 @@ static void registry_handle_global (void *data, struct wl_registry *registry,
 			context.river_status_manager = wl_registry_bind(registry, name,
 				&zriver_status_manager_v1_interface, 1);
 	}
+	else if (! strcmp(interface, zwlr_foreign_toplevel_manager_v1_interface.name))
+	{
+		if ( context.need_foreign_toplevel && ! init_foreign_toplevels(registry, name) )
+			goto error;
+	}
+	else if (! strcmp(interface, xdg_activation_v1_interface.name))
+	{
+		log_message(2, "[registry] Get xdg_activation_v1.\n");
+		context.xdg_activation = wl_registry_bind(registry, name,
+				&xdg_activation_v1_interface, 1);
+	}
 
 	return;
 error:
@@ -143,9 +158,13 @@ static char *check_for_required_interfaces (void)
  *  Connection  *
  *              *
  ****************/
-static bool init_wayland (void)
+/* Connect to the server and request the registry, but do not wait for any
+ * answer. This is done before the configuration file is parsed, so the
+ * compositor can advertise its globals while we are busy with that.
+ */
+bool connect_wayland (void)
 {
-	log_message(1, "[registry] Init Wayland.\n");
+	log_message(1, "[registry] Connect to Wayland.\n");
 
 	/* Connect to Wayland server. */ // TODO does the display really need to be global?
 	log_message(2, "[registry] Connecting to server.\n");
@@ -164,7 +183,38 @@ static bool init_wayland (void)
 	}
 	wl_registry_add_listener(context.registry, &registry_listener, NULL);
 
-	/* Allow registry listeners to catch up. */
+	/* Input gets its own queue, so a burst of output or status events can
+	 * not delay it.
+	 */
+	if ( NULL == (context.input_queue = wl_display_create_queue(context.display)) )
+	{
+		log_message(0, "ERROR: Can not create event queue.\n");
+		return false;
+	}
+
+	/* Send the request right away instead of waiting for the event loop. */
+	if ( wl_display_flush(context.display) == -1 && errno != EAGAIN )
+	{
+		log_message(0, "ERROR: wl_display_flush: %s\n", strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+/* Bind the globals advertised since connect_wayland() and request the
+ * information we need about the outputs. The answers to these requests are
+ * handled by the event loop, so the caller is free to do other work while the
+ * compositor is busy with them.
+ */
+bool init_wayland (void)
+{
+	log_message(1, "[registry] Init Wayland.\n");
+
+	/* Allow registry listeners to catch up. The configuration file has been
+	 * parsed by now, so the globals can be bound according to what it
+	 * requires.
+	 */
 	if ( wl_display_roundtrip(context.display) == -1 )
 	{
 		log_message(0, "ERROR: Roundtrip failed.\n");
@@ -178,6 +228,15 @@ static bool init_wayland (void)
 		return false;
 	}
 
+	/* The input region is copied when it is set, so a single empty one
+	 * serves all surfaces for their entire lifetime.
+	 */
+	if ( NULL == (context.empty_region = wl_compositor_create_region(context.compositor)) )
+	{
+		log_message(0, "ERROR: Compositor did not create wl_region.\n");
+		return false;
+	}
+
 	/* Configure all outputs that were created before xdg_output_manager or
 	 * the layer_shell were available.
 	 */
@@ -188,32 +247,47 @@ static bool init_wayland (void)
 			if (! configure_output(op))
 				return false;
 
+	/* Send the output requests now, so they are answered while the images
+	 * are loaded.
+	 */
+	if ( wl_display_flush(context.display) == -1 && errno != EAGAIN )
+	{
+		log_message(0, "ERROR: wl_display_flush: %s\n", strerror(errno));
+		return false;
+	}
+
 	return true;
 }
 
 /* Finish him! */
-static void finish_wayland (void)
+void finish_wayland (void)
 {
+	if ( context.display == NULL )
+		return;
+
 	log_message(1, "[registry] Finish Wayland.\n");
 
+	finish_pending_launches();
+	finish_foreign_toplevels();
 	destroy_all_outputs();
 	destroy_all_seats();
 
 	log_message(2, "[registry] Destroying Wayland objects.\n");
 
 	DESTROY(context.layer_shell, zwlr_layer_shell_v1_destroy);
+	DESTROY(context.empty_region, wl_region_destroy);
 	DESTROY(context.compositor, wl_compositor_destroy);
 	DESTROY(context.subcompositor, wl_subcompositor_destroy);
 	DESTROY(context.shm, wl_shm_destroy);
 	DESTROY(context.registry, wl_registry_destroy);
 
 	DESTROY(context.river_status_manager, zriver_status_manager_v1_destroy);
+	DESTROY(context.xdg_activation, xdg_activation_v1_destroy);
+	DESTROY(context.input_queue, wl_event_queue_destroy);
 
-	if ( context.display != NULL )
-	{
-		log_message(2, "[registry] Diconnecting from server.\n");
-		wl_display_disconnect(context.display);
-	}
+	log_message(2, "[registry] Diconnecting from server.\n");
+	wl_display_disconnect(context.display);
+	context.display = NULL;
 }
 
 /**************************
@@ -225,9 +299,6 @@ static bool wayland_source_init (struct pollfd *fd)
 {
 	log_message(1, "[loop] Setting up Wayland event source.\n");
 
-	if (! init_wayland())
-		return false;
-
 	fd->events = POLLIN;
 	if ( -1 == (fd->fd = wl_display_get_fd(context.display)) )
 	{
@@ -239,14 +310,30 @@ static bool wayland_source_init (struct pollfd *fd)
 
 static bool wayland_source_finish (struct pollfd *fd)
 {
-	if ( fd->fd != -1 )
-		close(fd->fd);
-	finish_wayland();
+	/* The fd belongs to the display, which is disconnected in finish_wayland(). */
+	return true;
+}
+
+/* Dispatch the events that are already queued, input first. */
+static bool wayland_dispatch_pending (void)
+{
+	if ( wl_display_dispatch_queue_pending(context.display, context.input_queue) == -1
+			|| wl_display_dispatch_pending(context.display) == -1 )
+	{
+		log_message(0, "ERROR: wl_display_dispatch_pending: %s\n", strerror(errno));
+		return false;
+	}
 	return true;
 }
 
 static bool wayland_source_flush (struct pollfd *fd)
 {
+	/* Roundtrips only dispatch the default queue and may have left input
+	 * events behind, which poll() would not wake us up for.
+	 */
+	if (! wayland_dispatch_pending())
+		return false;
+
 	do {
 		if ( wl_display_flush(context.display) == 1 && errno != EAGAIN )
 		{
@@ -260,12 +347,17 @@ static bool wayland_source_flush (struct pollfd *fd)
 
 static bool wayland_source_handle_in (struct pollfd *fd)
 {
-	if ( wl_display_dispatch(context.display) == -1 )
+	/* Read all events, but only dispatch the others once the input events
+	 * have been handled. If the default queue is not empty, nothing can be
+	 * read and the events are read in the next iteration.
+	 */
+	if ( wl_display_prepare_read(context.display) == 0
+			&& wl_display_read_events(context.display) == -1 )
 	{
-		log_message(0, "ERROR: wl_display_dispatch: %s\n", strerror(errno));
+		log_message(0, "ERROR: wl_display_read_events: %s\n", strerror(errno));
 		return false;
 	}
-	return true;
+	return wayland_dispatch_pending();
 }
 
 static bool wayland_source_handle_out (struct pollfd *fd)
@@ -20,9 +20,15 @@
 #ifndef LAVALAUNCHER_WAYLAND_CONNECTION_H
 #define LAVALAUNCHER_WAYLAND_CONNECTION_H
 
+#include<stdbool.h>
+
 struct Lava_ecent_source;
 
 extern struct Lava_event_source wayland_source;
 
+bool connect_wayland (void);
+bool init_wayland (void);
+void finish_wayland (void);
+
 #endif
 